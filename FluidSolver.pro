@@ -5,14 +5,9 @@ TEMPLATE = app
 
 LFLAGS = -static-libgcc
 
+include(solver/solver.pri)
+
 HEADERS += \
-    solver/Segment.hpp \
-    solver/Obstacles.hpp \
-    solver/Matrix3D.hpp \
-    solver/Matrix2D.hpp \
-    solver/Matrix.hpp \
-    solver/FluidSolver2D.hpp \
-    solver/FloatMatrix2D.hpp \
     display/ui_Dialog.h \
     display/SimplePrint.hpp \
     display/Print.hpp \
@@ -21,16 +16,11 @@ HEADERS += \
     display/Dialog.hpp \
     display/CurvePrint.hpp \
     display/ColorPrint.hpp \
-    config.hpp \
     display/Leap.h \
     display/LeapMath.h \
     display/LeapMotion.h
 
 SOURCES += \
-    solver/Segment.cpp \
-    solver/Obstacles.cpp \
-    solver/FluidSolver2D.cpp \
-    solver/FloatMatrix2D.cpp \
     display/SimplePrint.cpp \
     display/Print.cpp \
     display/ParticlesPrint.cpp \
@@ -39,7 +29,6 @@ SOURCES += \
     display/Dialog.cpp \
     display/CurvePrint.cpp \
     display/ColorPrint.cpp \
-    config.cpp \
     display/LeapMotion.cpp
 
 FORMS += \
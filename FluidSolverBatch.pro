@@ -0,0 +1,18 @@
+QT += core xml
+QT -= gui
+
+TARGET = fluidsolver-batch
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= app_bundle
+
+LFLAGS = -static-libgcc
+
+include(solver/solver.pri)
+
+SOURCES += \
+    batch/main.cpp
+
+INCLUDEPATH += $$PWD/
+DEPENDPATH += $$PWD/
@@ -0,0 +1,18 @@
+QT += core xml
+QT -= gui
+
+TARGET = fluidsolver-bench
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= app_bundle
+
+LFLAGS = -static-libgcc
+
+include(solver/solver.pri)
+
+SOURCES += \
+    bench/main.cpp
+
+INCLUDEPATH += $$PWD/
+DEPENDPATH += $$PWD/
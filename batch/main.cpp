@@ -0,0 +1,328 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include "../config.hpp"
+#include "../solver/FluidSolver2D.hpp"
+
+#define DEF_STEPS 100
+
+/*
+ * Prints the informations about the command line
+ *
+ * @param s String which is going to be printed
+ */
+void usage (char *s){
+
+  using namespace std;
+
+  cout << left << setfill(' ') << "Usage : " << s << endl;
+  cout << setw(35) << "\t[-config <name | number>]"
+       << setw(38) << right << "(set the selected config)"
+       << left << endl;
+  cout << setw(35) << "\t[-steps <(integer) number of steps>]" << endl;
+  cout << setw(35) << "\t[-r     <(integer) X resolution>" << endl;
+  cout << setw(35) << "\t\t<(integer) Y resolution>]" << endl;
+  cout << setw(35) << "\t[-dt    <(float) time precision>]" << endl;
+  cout << setw(35) << "\t[-visc  <(float) viscosity>]" << endl;
+  cout << setw(35) << "\t[-diff  <(float) diffusion>]" << endl;
+  cout << setw(35) << "\t[-threads <(integer) solver threads>]"
+       << setw(38) << right << "(0: one per core)" << left << endl;
+  cout << setw(35) << "\t[-pressure  <gaussseidel | redblack | multigrid | pcg | iccg>]"
+       << endl;
+  cout << setw(35) << "\t[-diffusion <gaussseidel | redblack | pcg | iccg>]"
+       << endl;
+  cout << setw(35) << "\t[-tolerance <(float) relative residual>]" << endl;
+  cout << setw(35) << "\t[-iterations <(int) min> <(int) max>]"
+       << setw(38) << right << "(relaxation sweeps)" << left << endl;
+  cout << setw(35) << "\t[-coldstart]" << setw(38) << right
+       << "(pressure solves start from zero)" << left << endl;
+  cout << setw(35) << "\t[-storage <float | half | bfloat>]" << setw(38) << right
+       << "(precision of the density fields)" << left << endl;
+  cout << setw(35) << "\t[-densityscale <(integer) scale>]" << setw(38) << right
+       << "(density cells per velocity cell)" << left << endl;
+  cout << setw(35) << "\t[-cfl   <(float) cells per substep>]" << setw(38) << right
+       << "(split the steps, 0: never)" << left << endl;
+  cout << setw(35) << "\t[-advection <semilagrangian | maccormack>]" << endl;
+  cout << setw(35) << "\t[-activity <(float) threshold>]" << setw(38) << right
+       << "(skip the fluid at rest, 0: never)" << left << endl;
+  cout << setw(35) << "\t[-double]" << setw(38) << right
+       << "(solve in double precision)" << left << endl;
+  cout << setw(35) << "\t[-save  <prefix>]"
+       << setw(38) << right << "(save the final state)" << left << endl;
+  cout << setw(35) << "\t[-h | --help]" << setw(38) << right << "(display this)"
+       << left << endl;
+}
+
+/**
+ * Checks the number of parameters of an option
+ */
+inline void check_nb_params(int arg, int argc, char **argv, int n){
+  if (arg + n >= argc){
+    std::cerr << "Error: Argument '" << argv[arg] << "' requires " << n
+              << " parameters." << std::endl;
+    usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+}
+
+#define ARG_IS(arg_name) (strcmp((argv[arg]+1), arg_name) == 0)
+
+/**
+ * Runs the simulation on a fluid of scalar type T: restores it from the
+ * configuration state files, runs nbSteps steps, reports the throughput and
+ * saves the final state if savePrefix is not NULL.
+ */
+template <typename T>
+void run(Config &configuration, unsigned int nbSteps, const char *savePrefix){
+  /* new fluid, restored from the configuration state files */
+  FluidSolver2D<T> *fluid = new FluidSolver2D<T>(configuration.getWidth(),
+                                                 configuration.getHeight(),
+                                                 configuration);
+  fluid->loadState(configuration);
+  fluid->injectSources();
+
+  /* * * simulation * * */
+  QElapsedTimer timer;
+  unsigned long pressureIterations = 0, diffusionIterations = 0, substeps = 0;
+  unsigned long activeTiles = 0;
+  timer.start();
+  for (unsigned int s = 0; s < nbSteps; s++) {
+    fluid->step(configuration.getViscosity(), configuration.getDiff(),
+                configuration.getDt());
+    pressureIterations += fluid->getPressureStats().iterations;
+    diffusionIterations += fluid->getDiffusionStats().iterations;
+    substeps += fluid->getSubsteps();
+    activeTiles += fluid->getActiveTiles().getNbActive();
+  }
+  const double seconds = timer.nsecsElapsed() * 1e-9;
+
+  /* * * report * * */
+  const double cells = (double) configuration.getWidth()
+    * configuration.getHeight();
+  std::cout << "Ran " << nbSteps << " steps on a "
+            << configuration.getWidth() << "x" << configuration.getHeight()
+            << " grid (" << (sizeof(T) == sizeof(double) ? "double" : "float")
+            << ") in " << seconds << " s" << std::endl;
+  if (fluid->getDensityScale() > 1)
+    std::cout << "  density grid : " << fluid->_dens_src->getSize(1) << "x"
+              << fluid->_dens_src->getSize(0) << std::endl;
+  // the scalar channels, current and previous-step, and their sources
+  const unsigned int channels = fluid->getNbScalarChannels();
+  const unsigned int channelBytes = fluid->compactScalars() ? 2 : sizeof(T);
+  const unsigned int sourceBytes = fluid->compactScalars() ? 2 : 4;
+  std::cout << "  density storage : "
+            << 2 * channels * channelBytes + sourceBytes + (channels - 1) * sizeof(T)
+            << " bytes/cell (" << storagePrecisionName(fluid->_dens_src->getPrecision())
+            << ")" << std::endl;
+  std::cout << "  steps/sec : " << nbSteps / seconds << std::endl;
+  std::cout << "  cells/sec : " << cells * nbSteps / seconds << std::endl;
+  if (nbSteps > 0) {
+    // last pressure and diffusion solves of each step
+    std::cout << "  pressure iterations/solve  : "
+              << (double) pressureIterations / nbSteps << std::endl;
+    std::cout << "  diffusion iterations/solve : "
+              << (double) diffusionIterations / nbSteps << std::endl;
+    if (configuration.getCfl() > 0)
+      std::cout << "  substeps/step : " << (double) substeps / nbSteps << std::endl;
+    if (configuration.getActivityThreshold() > 0)
+      std::cout << "  active tiles  : "
+                << 100.0 * activeTiles / nbSteps / fluid->getActiveTiles().getNbTiles()
+                << " %" << std::endl;
+  }
+
+  if (savePrefix != NULL) {
+    const std::string prefix(savePrefix);
+    if (fluid->compactScalars())
+      fluid->_compactDens->save((prefix + "_density").c_str());
+    else
+      fluid->_dens->save((prefix + "_density").c_str());
+    fluid->_u->save((prefix + "_velX").c_str());
+    fluid->_v->save((prefix + "_velY").c_str());
+  }
+
+  delete fluid;
+}
+
+/**
+ * Headless simulation: loads a configuration and its state files, runs a
+ * given number of steps without any window and reports the throughput.
+ */
+int main(int argc, char *argv[]){
+  QCoreApplication app(argc, argv);
+
+  /* * *  default config * * */
+  Config *configuration = NULL;
+  unsigned int nbSteps = DEF_STEPS;
+  const char *savePrefix = NULL;
+  try {
+    configuration = new Config();
+  }
+  catch(const std::string &error) {
+    std::cerr << "Error : " << error << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  /* * * arguments parsing * * */
+
+  try {
+    for (int arg = 1; arg < argc; arg++) {
+      if (argv[arg][0] != '-'){
+        std::cerr << "Error: wrong parameter provided : '" << argv[arg] << "'."
+                  << std::endl;
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+      // configuration number
+      if(ARG_IS("config")) {
+        if(arg == 1) {
+          check_nb_params(arg, argc, argv, 1);
+          if (!configuration->setConfig(QString(argv[arg+1]))) {
+            std::cerr << "Error : unknown config '" << argv[arg+1] << "'"
+                      << std::endl;
+            exit(EXIT_FAILURE);
+          }
+          configuration->updateConfig();
+        }
+        else {
+          std::cerr << "Error : config should be first argument" << std::endl;
+          exit(EXIT_FAILURE);
+        }
+        arg++;
+      }
+      // steps
+      else if (ARG_IS("steps")){
+        check_nb_params(arg, argc, argv, 1);
+        nbSteps = atoi(argv[arg+1]);
+        arg++;
+      }
+      // r:
+      else if (ARG_IS("r")){
+        check_nb_params(arg, argc, argv,2);
+        configuration->setHeight(atoi(argv[arg + 1]));
+        configuration->setWidth(atoi(argv[arg+2]));
+        arg+=2; // skip the next 2 parameters
+      }
+      // dt:
+      else if (ARG_IS("dt")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setDt(atof(argv[arg+1]));
+        arg++;
+      }
+      // visc
+      else if (ARG_IS("visc")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setViscosity(atof(argv[arg+1]));
+        arg++;
+      }
+      // diff
+      else if (ARG_IS("diff")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setDiff(atof(argv[arg+1]));
+        arg++;
+      }
+      // threads
+      else if (ARG_IS("threads")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setThreads(atoi(argv[arg+1]));
+        arg++;
+      }
+      // pressure solver
+      else if (ARG_IS("pressure")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setPressureSolver(linearSolverFromName(argv[arg+1]));
+        arg++;
+      }
+      // diffusion solver
+      else if (ARG_IS("diffusion")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setDiffusionSolver(linearSolverFromName(argv[arg+1]));
+        arg++;
+      }
+      // tolerance
+      else if (ARG_IS("tolerance")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setTolerance(atof(argv[arg+1]));
+        arg++;
+      }
+      // iterations
+      else if (ARG_IS("iterations")){
+        check_nb_params(arg, argc, argv, 2);
+        configuration->setIterations(atoi(argv[arg+1]), atoi(argv[arg+2]));
+        arg+=2;
+      }
+      // cold start
+      else if (ARG_IS("coldstart")){
+        configuration->setWarmStart(false);
+      }
+      // storage precision
+      else if (ARG_IS("storage")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setStoragePrecision(storagePrecisionFromName(argv[arg+1]));
+        arg++;
+      }
+      // density grid finer than the velocity one
+      else if (ARG_IS("densityscale")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setDensityScale(atoi(argv[arg+1]));
+        arg++;
+      }
+      // substeps
+      else if (ARG_IS("cfl")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setCfl(atof(argv[arg+1]));
+        arg++;
+      }
+      // advection scheme
+      else if (ARG_IS("advection")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setAdvection(advectionSchemeFromName(argv[arg+1]));
+        arg++;
+      }
+      // sparse advection
+      else if (ARG_IS("activity")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setActivityThreshold(atof(argv[arg+1]));
+        arg++;
+      }
+      // double precision
+      else if (ARG_IS("double")){
+        configuration->setDoublePrecision(true);
+      }
+      // save
+      else if (ARG_IS("save")){
+        check_nb_params(arg, argc, argv, 1);
+        savePrefix = argv[arg+1];
+        arg++;
+      }
+      // help
+      else if (ARG_IS("h") || ARG_IS("-help")){
+        usage(argv[0]);
+        exit(EXIT_SUCCESS);
+      }
+      //default:
+      else {
+        std::cerr << "Error: wrong argument '" << argv[arg] << "'.\n"
+                  << std::endl;
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+  catch (const std::invalid_argument &argument) {
+    std::cerr << "Invalid argument : " << argument.what() << std::endl;
+    usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  if (configuration->getDoublePrecision())
+    run<double>(*configuration, nbSteps, savePrefix);
+  else
+    run<float>(*configuration, nbSteps, savePrefix);
+
+  delete configuration;
+  return EXIT_SUCCESS;
+}
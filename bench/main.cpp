@@ -0,0 +1,393 @@
+#include <QElapsedTimer>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include "../solver/FluidSolver2D.hpp"
+#include "../solver/FluidSolver3D.hpp"
+#include "../solver/FloatMatrix2D.hpp"
+#include "../solver/Stencil.hpp"
+
+#define DEF_MIN_SIZE 130
+#define DEF_MAX_SIZE 4096
+#define DEF_REPETITIONS 5
+#define DEF_THREADS 1
+#define BENCH_3D_SIZES {64, 128} // interior cells along each axis
+
+/*
+ * Prints the informations about the command line
+ *
+ * @param s String which is going to be printed
+ */
+void usage (char *s){
+
+  using namespace std;
+
+  cout << left << setfill(' ') << "Usage : " << s << endl;
+  cout << setw(35) << "\t[-max  <(integer) largest grid size>]" << endl;
+  cout << setw(35) << "\t[-reps <(integer) repetitions>]" << endl;
+  cout << setw(35) << "\t[-threads <(integer) solver threads>]"
+       << setw(38) << right << "(0: one per core)" << left << endl;
+  cout << setw(35) << "\t[-double]" << setw(38) << right
+       << "(time the double precision solver)" << left << endl;
+  cout << setw(35) << "\t[-h | --help]" << setw(38) << right << "(display this)"
+       << left << endl;
+}
+
+/**
+ * Checks the number of parameters of an option
+ */
+inline void check_nb_params(int arg, int argc, char **argv, int n){
+  if (arg + n >= argc){
+    std::cerr << "Error: Argument '" << argv[arg] << "' requires " << n
+              << " parameters." << std::endl;
+    usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+}
+
+#define ARG_IS(arg_name) (strcmp((argv[arg]+1), arg_name) == 0)
+
+/**
+ * Cells of the grids along each axis, border included: depth is 1 for the
+ * 2D solver.
+ */
+template <typename T>
+inline void gridSize(const ScalarMatrix2D<T> &m, unsigned int &width,
+                     unsigned int &height, unsigned int &depth){
+  width = m.getSize(1);
+  height = m.getSize(0);
+  depth = 1;
+}
+
+template <typename T>
+inline void gridSize(const Matrix3D<T> &m, unsigned int &width,
+                     unsigned int &height, unsigned int &depth){
+  width = m.getSize(2);
+  height = m.getSize(1);
+  depth = m.getSize(0);
+}
+
+/**
+ * Times one kernel and prints its statistics as a JSON object.
+ *
+ * The bandwidth is derived from the minimal memory traffic of the kernel
+ * (bytesPerCell, given for float fields and scaled for double ones),
+ * assuming every field is streamed once per pass.
+ */
+class KernelBench {
+public:
+  KernelBench(std::ostream &out, unsigned int repetitions)
+    : _out(out), _repetitions(repetitions), _first(true) {}
+
+  template <class Solver, class Kernel>
+  void run(const char *name, const Solver &fluid, bool obstacles,
+           double bytesPerCell, Kernel kernel){
+    unsigned int width, height, depth;
+    gridSize(*fluid._u, width, height, depth);
+    const double cells = (double) width * height * depth;
+    const unsigned int scalarSize = sizeof(*fluid._u->getArray());
+    std::vector<double> nsPerCell;
+    QElapsedTimer timer;
+
+    kernel(); // warm-up
+    for (unsigned int r = 0; r < _repetitions; r++){
+      timer.start();
+      kernel();
+      nsPerCell.push_back(timer.nsecsElapsed() / cells);
+    }
+
+    double mean = 0, variance = 0;
+    for (unsigned int r = 0; r < _repetitions; r++)
+      mean += nsPerCell[r];
+    mean /= _repetitions;
+    for (unsigned int r = 0; r < _repetitions; r++)
+      variance += (nsPerCell[r] - mean) * (nsPerCell[r] - mean);
+    variance /= _repetitions;
+
+    _out << (_first ? "\n" : ",\n")
+         << "    {\"kernel\": \"" << name << "\""
+         << ", \"width\": " << width
+         << ", \"height\": " << height
+         << ", \"depth\": " << depth
+         << ", \"obstacles\": " << (obstacles ? "true" : "false")
+         << ", \"precision\": \"" << (scalarSize == sizeof(float) ? "float" : "double") << "\""
+         << ", \"repetitions\": " << _repetitions
+         << ", \"ns_per_cell\": " << mean
+         << ", \"ns_per_cell_variance\": " << variance
+         << ", \"ns_per_cell_stddev\": " << std::sqrt(variance)
+         << ", \"bandwidth_gbs\": " << bytesPerCell * scalarSize / sizeof(float) / mean
+         << "}";
+    _out.flush();
+    _first = false;
+  }
+
+private:
+  std::ostream &_out;
+  const unsigned int _repetitions;
+  bool _first;
+};
+
+/**
+ * Fills a matrix with pseudo-random values in [-amplitude, amplitude].
+ */
+template <typename T>
+void randomize(ScalarMatrix2D<T> &m, float amplitude){
+  for (unsigned int j = 0; j < m.getSize(0); j++)
+    for (unsigned int i = 0; i < m.getSize(1); i++)
+      m.set(i, j, amplitude * (2.0f * rand() / RAND_MAX - 1.0f));
+}
+
+/**
+ * Adds a row of vertical obstacles across the middle of the grid,
+ * like the VonKarman configurations.
+ */
+template <class Solver>
+void addObstacles(Solver &fluid, unsigned int size){
+  const unsigned int width = size / 20 > 0 ? size / 20 : 1;
+  for (unsigned int k = 1; k <= 6; k++){
+    const unsigned int x = k * size / 8;
+    fluid._obstacles->addSegment(x, 2 * size / 5, x, 3 * size / 5, width);
+  }
+}
+
+/**
+ * Times every kernel of the solver of scalar type T on a size x size grid.
+ */
+template <typename T>
+void benchSize(KernelBench &bench, unsigned int size, bool obstacles,
+               unsigned int threads){
+  FluidSolver2D<T> fluid(size, size);
+  fluid.setThreads(threads);
+  fluid.setWarmStart(false); // each projection solves from scratch
+  if (obstacles)
+    addObstacles(fluid, size);
+
+  const float visc = 1e-5;
+  const float dt   = 1;
+  const float h    = 1.0f / (size - 2);
+
+  randomize(*fluid._u, h);
+  randomize(*fluid._v, h);
+  randomize(*fluid._dens, 1);
+  randomize(*fluid._dens_prev, 1);
+
+  /* bytes per cell: fields read and written by each pass */
+  bench.run("fill", fluid, obstacles, 4, [&] {
+      fluid._u_prev->fill(0);
+    });
+  bench.run("add", fluid, obstacles, 12, [&] {
+      *fluid._u_prev += *fluid._u;
+    });
+  bench.run("addAndMultiply", fluid, obstacles, 12, [&] {
+      *fluid._u_prev = *fluid._u_prev + dt * *fluid._u;
+    });
+  bench.run("inject_sources", fluid, obstacles, 3 * 8, [&] {
+      fluid.injectSources();
+    });
+  // sources, copy (no diffusion) and advection of the density
+  bench.run("dens_step", fluid, obstacles, 12 + 8 + 16, [&] {
+      fluid.densStep(0, dt);
+    });
+  // same, with the density, its previous-step field and its source stored
+  // in 16 bits
+  fluid.setStoragePrecision(STORAGE_HALF);
+  bench.run("inject_sources_half", fluid, obstacles, 2 * 8 + 4, [&] {
+      fluid.injectSources();
+    });
+  bench.run("dens_step_half", fluid, obstacles, 6 + 4 + 14, [&] {
+      fluid.densStep(0, dt);
+    });
+  fluid.setStoragePrecision(STORAGE_BFLOAT);
+  bench.run("inject_sources_bfloat", fluid, obstacles, 2 * 8 + 4, [&] {
+      fluid.injectSources();
+    });
+  bench.run("dens_step_bfloat", fluid, obstacles, 6 + 4 + 14, [&] {
+      fluid.densStep(0, dt);
+    });
+  fluid.setStoragePrecision(STORAGE_FLOAT);
+  randomize(*fluid._dens, 1);
+  randomize(*fluid._dens_prev, 1);
+  bench.run("setBnd", fluid, obstacles, 8 * 4.0 / size, [&] {
+      fluid.setBnd(1, *fluid._u);
+    });
+  bench.run("diffuse", fluid, obstacles, 10 * 12, [&] {
+      fluid.diffuse(0, *fluid._dens, *fluid._dens_prev, visc, dt);
+    });
+  fluid.setDiffusionSolver(SOLVER_RED_BLACK);
+  bench.run("diffuse_redblack", fluid, obstacles, 10 * 2 * 12, [&] {
+      fluid.diffuse(0, *fluid._dens, *fluid._dens_prev, visc, dt);
+    });
+  bench.run("diffuse_velocity_redblack", fluid, obstacles, 2 * 10 * 2 * 12, [&] {
+      fluid.diffuseVelocity(*fluid._u, *fluid._v, *fluid._u_prev, *fluid._v_prev, visc, dt);
+    });
+  // about 70 bytes per cell and per iteration, the count depends on the system
+  fluid.setDiffusionSolver(SOLVER_PCG);
+  bench.run("diffuse_pcg", fluid, obstacles, 50 * 70, [&] {
+      fluid.diffuse(0, *fluid._dens, *fluid._dens_prev, visc, dt);
+    });
+  fluid.setDiffusionSolver(SOLVER_ICCG);
+  bench.run("diffuse_iccg", fluid, obstacles, 20 * 70, [&] {
+      fluid.diffuse(0, *fluid._dens, *fluid._dens_prev, visc, dt);
+    });
+  bench.run("advect", fluid, obstacles, 16, [&] {
+      fluid.advect(0, *fluid._dens, *fluid._dens_prev,
+                   *fluid._u, *fluid._v, dt);
+    });
+  bench.run("advect_velocity", fluid, obstacles, 32, [&] {
+      fluid.advectVelocity(*fluid._u, *fluid._v, *fluid._u_prev, *fluid._v_prev, dt);
+    });
+  // four scalar channels carried together, traced back once
+  fluid.setScalarChannels(4);
+  bench.run("advect_channels_4", fluid, obstacles, 8 + 4 * 8, [&] {
+      fluid.advect(0, fluid._scalars->getChannels(), fluid._scalars_prev->getChannels(), 4,
+                   *fluid._u, *fluid._v, dt);
+    });
+  fluid.setScalarChannels(1);
+  // same, corrected by a second pass over the grid
+  fluid.setAdvection(ADVECTION_MACCORMACK);
+  bench.run("advect_maccormack", fluid, obstacles, 16 + 20, [&] {
+      fluid.advect(0, *fluid._dens, *fluid._dens_prev,
+                   *fluid._u, *fluid._v, dt);
+    });
+  bench.run("advect_velocity_maccormack", fluid, obstacles, 32 + 24, [&] {
+      fluid.advectVelocity(*fluid._u, *fluid._v, *fluid._u_prev, *fluid._v_prev, dt);
+    });
+  fluid.setAdvection(ADVECTION_SEMI_LAGRANGIAN);
+  bench.run("project", fluid, obstacles, 16 + 10 * 12 + 20, [&] {
+      fluid.project(*fluid._u, *fluid._v, *fluid._u_prev, *fluid._v_prev);
+    });
+  fluid.setPressureSolver(SOLVER_RED_BLACK);
+  bench.run("project_redblack", fluid, obstacles, 16 + 10 * 2 * 12 + 20, [&] {
+      fluid.project(*fluid._u, *fluid._v, *fluid._u_prev, *fluid._v_prev);
+    });
+  // about 100 bytes per cell and per V-cycle, 4 cycles for the default tolerance
+  fluid.setPressureSolver(SOLVER_MULTIGRID);
+  bench.run("project_multigrid", fluid, obstacles, 16 + 4 * 100 + 20, [&] {
+      fluid.project(*fluid._u, *fluid._v, *fluid._u_prev, *fluid._v_prev);
+    });
+  fluid.setPressureSolver(SOLVER_PCG);
+  bench.run("project_pcg", fluid, obstacles, 16 + 200 * 70 + 20, [&] {
+      fluid.project(*fluid._u, *fluid._v, *fluid._u_prev, *fluid._v_prev);
+    });
+  fluid.setPressureSolver(SOLVER_ICCG);
+  bench.run("project_iccg", fluid, obstacles, 16 + 100 * 70 + 20, [&] {
+      fluid.project(*fluid._u, *fluid._v, *fluid._u_prev, *fluid._v_prev);
+    });
+}
+
+/**
+ * Fills a 3D field with pseudo-random values in [-amplitude, amplitude].
+ */
+template <typename T>
+void randomize(Matrix3D<T> &m, float amplitude){
+  for (unsigned int c = 0; c < m.length(); c++)
+    m[c] = amplitude * (2.0f * rand() / RAND_MAX - 1.0f);
+}
+
+/**
+ * Times the projection and the whole step of the 3D solver of scalar type
+ * T on a grid of size^3 interior cells.
+ */
+template <typename T>
+void benchSize3D(KernelBench &bench, unsigned int size, unsigned int threads){
+  FluidSolver3D<T> fluid(size + 2, size + 2, size + 2);
+  fluid.setThreads(threads);
+  fluid.setWarmStart(false); // each projection solves from scratch
+
+  const float visc = 1e-5;
+  const float dt   = 1;
+  const float h    = 1.0f / size;
+
+  randomize(*fluid._u, h);
+  randomize(*fluid._v, h);
+  randomize(*fluid._w, h);
+  randomize(*fluid._dens, 1);
+
+  // divergence, 10 red-black iterations, then the gradient
+  bench.run("project_3d", fluid, false, 20 + 10 * 2 * 12 + 28, [&] {
+      fluid.project(*fluid._u, *fluid._v, *fluid._w, *fluid._pressure, *fluid._u_prev);
+    });
+  // about 1400 bytes per cell: mostly the diffusion of the velocity and the
+  // two projections
+  bench.run("step_3d", fluid, false, 1400, [&] {
+      fluid.step(visc, 0, dt);
+    });
+}
+
+/**
+ * Kernel microbenchmarks: sweeps the grid size and prints one JSON record
+ * per kernel, grid size and obstacle setting.
+ */
+int main(int argc, char *argv[]){
+  unsigned int maxSize = DEF_MAX_SIZE;
+  unsigned int repetitions = DEF_REPETITIONS;
+  unsigned int threads = DEF_THREADS;
+  bool doublePrecision = false;
+
+  /* * * arguments parsing * * */
+  for (int arg = 1; arg < argc; arg++) {
+    if (ARG_IS("max")){
+      check_nb_params(arg, argc, argv, 1);
+      maxSize = atoi(argv[arg+1]);
+      arg++;
+    }
+    else if (ARG_IS("reps")){
+      check_nb_params(arg, argc, argv, 1);
+      repetitions = atoi(argv[arg+1]);
+      arg++;
+    }
+    else if (ARG_IS("threads")){
+      check_nb_params(arg, argc, argv, 1);
+      threads = atoi(argv[arg+1]);
+      arg++;
+    }
+    else if (ARG_IS("double")){
+      doublePrecision = true;
+    }
+    else if (ARG_IS("h") || ARG_IS("-help")){
+      usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    }
+    else {
+      std::cerr << "Error: wrong argument '" << argv[arg] << "'.\n"
+                << std::endl;
+      usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (repetitions == 0)
+    repetitions = 1;
+
+  /* grid sizes: the default one, then powers of two */
+  std::vector<unsigned int> sizes;
+  sizes.push_back(DEF_MIN_SIZE);
+  for (unsigned int size = 256; size <= maxSize; size *= 2)
+    sizes.push_back(size);
+
+  KernelBench bench(std::cout, repetitions);
+  std::cout << "{\n  \"instruction_set\": \"" << stencilInstructionSet()
+            << "\",\n  \"benchmarks\": [";
+  for (unsigned int s = 0; s < sizes.size() && sizes[s] <= maxSize; s++){
+    std::cerr << "size " << sizes[s] << "..." << std::endl;
+    for (int obstacles = 0; obstacles < 2; obstacles++){
+      if (doublePrecision)
+        benchSize<double>(bench, sizes[s], obstacles, threads);
+      else
+        benchSize<float>(bench, sizes[s], obstacles, threads);
+    }
+  }
+  const unsigned int sizes3D[] = BENCH_3D_SIZES;
+  for (unsigned int s = 0; s < sizeof(sizes3D) / sizeof(*sizes3D) && sizes3D[s] <= maxSize; s++){
+    std::cerr << "size " << sizes3D[s] << "^3..." << std::endl;
+    if (doublePrecision)
+      benchSize3D<double>(bench, sizes3D[s], threads);
+    else
+      benchSize3D<float>(bench, sizes3D[s], threads);
+  }
+  std::cout << "\n  ]\n}" << std::endl;
+
+  return EXIT_SUCCESS;
+}
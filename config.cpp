@@ -128,6 +128,53 @@ void Config::updateConfig() {
     currentConfig.attribute("dt",
 			    QString("%1").arg(DEF_DT)).toFloat();
 
+  _threads =
+    currentConfig.attribute("threads",
+			    QString("%1").arg(DEF_THREADS)).toInt();
+
+  _pressureSolver = readLinearSolver("pressureSolver", DEF_PRESSURE_SOLVER);
+  _diffusionSolver = readLinearSolver("diffusionSolver", DEF_DIFFUSION_SOLVER);
+
+  _tolerance =
+    currentConfig.attribute("tolerance",
+			    QString("%1").arg(DEF_TOLERANCE)).toFloat();
+
+  _minIterations =
+    currentConfig.attribute("minIterations",
+			    QString("%1").arg(DEF_MIN_ITERATIONS)).toInt();
+
+  _maxIterations =
+    currentConfig.attribute("maxIterations",
+			    QString("%1").arg(DEF_MAX_ITERATIONS)).toInt();
+
+  _warmStart =
+    (currentConfig.attribute("warmStart",
+			     QString(DEF_WARM_START ? "true" : "false"))
+     == QString("true"));
+
+  _storagePrecision = readStoragePrecision("storagePrecision", DEF_STORAGE_PRECISION);
+
+  _doublePrecision =
+    (currentConfig.attribute("doublePrecision",
+			     QString(DEF_DOUBLE_PRECISION ? "true" : "false"))
+     == QString("true"));
+
+  _densityScale =
+    currentConfig.attribute("densityScale",
+			    QString("%1").arg(DEF_DENSITY_SCALE)).toInt();
+  if (_densityScale < 1)
+    _densityScale = 1;
+
+  _cfl =
+    currentConfig.attribute("cfl",
+			    QString("%1").arg(DEF_CFL)).toFloat();
+
+  _advection = readAdvectionScheme("advection", DEF_ADVECTION);
+
+  _activityThreshold =
+    currentConfig.attribute("activityThreshold",
+			    QString("%1").arg(DEF_ACTIVITY_THRESHOLD)).toFloat();
+
   _name =
     currentConfig.attribute("name",
 			    QString("noName"));
@@ -156,6 +203,66 @@ void Config::updateConfig() {
 }
 
 
+/**
+ * Reads the name of a linear solver from an attribute of the current
+ * configuration. Unknown names fall back to the given default.
+ *
+ * @param attribute Name of the XML attribute
+ * @param def Solver used when the attribute is missing or invalid
+ */
+LinearSolver Config::readLinearSolver(const char *attribute, LinearSolver def){
+  QString name = currentConfig.attribute(attribute,
+                                         QString(linearSolverName(def)));
+  try {
+    return linearSolverFromName(name.toStdString());
+  }
+  catch(const std::invalid_argument &error) {
+    std::cerr << "Warning : " << error.what() << ", using '"
+              << linearSolverName(def) << "'" << std::endl;
+    return def;
+  }
+}
+
+/**
+ * Reads the name of a storage precision from an attribute of the current
+ * configuration. Unknown names fall back to the given default.
+ *
+ * @param attribute Name of the XML attribute
+ * @param def Precision used when the attribute is missing or invalid
+ */
+StoragePrecision Config::readStoragePrecision(const char *attribute, StoragePrecision def){
+  QString name = currentConfig.attribute(attribute,
+                                         QString(storagePrecisionName(def)));
+  try {
+    return storagePrecisionFromName(name.toStdString());
+  }
+  catch(const std::invalid_argument &error) {
+    std::cerr << "Warning : " << error.what() << ", using '"
+              << storagePrecisionName(def) << "'" << std::endl;
+    return def;
+  }
+}
+
+/**
+ * Reads the name of an advection scheme from an attribute of the current
+ * configuration. Unknown names fall back to the given default.
+ *
+ * @param attribute Name of the XML attribute
+ * @param def Scheme used when the attribute is missing or invalid
+ */
+AdvectionScheme Config::readAdvectionScheme(const char *attribute, AdvectionScheme def){
+  QString name = currentConfig.attribute(attribute,
+                                         QString(advectionSchemeName(def)));
+  try {
+    return advectionSchemeFromName(name.toStdString());
+  }
+  catch(const std::invalid_argument &error) {
+    std::cerr << "Warning : " << error.what() << ", using '"
+              << advectionSchemeName(def) << "'" << std::endl;
+    return def;
+  }
+}
+
 /**
  * From the current configuration, generates all the attached obstacle segments
  */
@@ -243,6 +350,104 @@ float Config::getDiff() const{
   return _diff; 
 }
 
+/**
+ * Returns the number of threads used by the solver (0 means one per core)
+ */
+unsigned int Config::getThreads() const{
+  return _threads;
+}
+
+/**
+ * Returns the linear solver used by the projection step
+ */
+LinearSolver Config::getPressureSolver() const{
+  return _pressureSolver;
+}
+
+/**
+ * Returns the linear solver used by the diffusion step
+ */
+LinearSolver Config::getDiffusionSolver() const{
+  return _diffusionSolver;
+}
+
+/**
+ * Returns the residual, relative to the right hand side, at which the
+ * iterative solvers stop
+ */
+float Config::getTolerance() const{
+  return _tolerance;
+}
+
+/**
+ * Returns the number of sweeps the relaxation solvers run before checking
+ * the residual
+ */
+unsigned int Config::getMinIterations() const{
+  return _minIterations;
+}
+
+/**
+ * Returns the largest number of sweeps of the relaxation solvers
+ */
+unsigned int Config::getMaxIterations() const{
+  return _maxIterations;
+}
+
+/**
+ * Returns true if the pressure solves start from the pressure of the
+ * previous one
+ */
+bool Config::getWarmStart() const{
+  return _warmStart;
+}
+
+/**
+ * Returns the precision in which the scalar channels and the density
+ * source are stored
+ */
+StoragePrecision Config::getStoragePrecision() const{
+  return _storagePrecision;
+}
+
+/**
+ * Returns true if the solver computes in double rather than float
+ */
+bool Config::getDoublePrecision() const{
+  return _doublePrecision;
+}
+
+/**
+ * Returns the number of cells of the density grid along each axis per cell
+ * of the velocity grid
+ */
+unsigned int Config::getDensityScale() const{
+  return _densityScale;
+}
+
+/**
+ * Returns the largest number of cells the fluid may cross per substep, 0
+ * if the steps are not split
+ */
+float Config::getCfl() const{
+  return _cfl;
+}
+
+/**
+ * Returns the scheme of the advection of the density and of the velocity
+ */
+AdvectionScheme Config::getAdvection() const{
+  return _advection;
+}
+
+/**
+ * Returns the magnitude below which the fluid is considered at rest, 0 if
+ * the whole grid is advected
+ */
+float Config::getActivityThreshold() const{
+  return _activityThreshold;
+}
+
 /**
  * Returns the path of the file where is stored the density of the fluid
  */
@@ -393,6 +598,139 @@ void Config::setProtection(const bool protection) {
   _protected = protection;
 }
 
+/**
+ * Sets the number of threads used by the solver
+ *
+ * @param threads Number of threads, 0 to use one thread per core
+ */
+void Config::setThreads(const unsigned int threads) {
+  _threads = threads;
+}
+
+/**
+ * Sets the linear solver used by the projection step
+ *
+ * @param solver Solver wanted for the pressure
+ */
+void Config::setPressureSolver(const LinearSolver solver) {
+  _pressureSolver = solver;
+}
+
+/**
+ * Sets the linear solver used by the diffusion step
+ *
+ * @param solver Solver wanted for the diffusion
+ */
+void Config::setDiffusionSolver(const LinearSolver solver) {
+  _diffusionSolver = solver;
+}
+
+/**
+ * Sets the residual, relative to the right hand side, at which the
+ * iterative solvers stop
+ *
+ * @param tolerance Relative residual wanted
+ */
+void Config::setTolerance(const float tolerance) {
+  if (tolerance < 0) {
+    throw(std::invalid_argument(std::string("Tolerance should be a positive"
+                                            " number")));
+  }
+  _tolerance = tolerance;
+}
+
+/**
+ * Sets the bounds of the number of sweeps of the relaxation solvers. The
+ * residual is checked after each sweep beyond min, up to max sweeps; with
+ * min equal to max they always run max sweeps.
+ *
+ * @param min Sweeps run before checking the residual
+ * @param max Largest number of sweeps
+ */
+void Config::setIterations(const unsigned int min, const unsigned int max) {
+  if (max == 0 || min > max) {
+    throw(std::invalid_argument(std::string("Iterations should be a strictly"
+                                            " positive maximum, not lower than"
+                                            " the minimum")));
+  }
+  _minIterations = min;
+  _maxIterations = max;
+}
+
+/**
+ * Sets whether the pressure solves start from the pressure of the previous
+ * one (which changes little from one step to the next) or from zero.
+ *
+ * @param warmStart True to start from the previous pressure
+ */
+void Config::setWarmStart(const bool warmStart) {
+  _warmStart = warmStart;
+}
+
+/**
+ * Sets the precision in which the scalar channels and the density source
+ * are stored; the computations are done in float or double whatever the
+ * precision.
+ *
+ * @param precision Float, half float or bfloat16
+ */
+void Config::setStoragePrecision(const StoragePrecision precision) {
+  _storagePrecision = precision;
+}
+
+/**
+ * Sets whether the solver computes in double rather than float. Only the
+ * batch mode honours it: the display works on floats.
+ *
+ * @param doublePrecision True for doubles
+ */
+void Config::setDoublePrecision(const bool doublePrecision) {
+  _doublePrecision = doublePrecision;
+}
+
+/**
+ * Sets how much finer the density grid is than the velocity one: the
+ * width and height are those of the velocity grid, and the density is
+ * advected on a grid of scale x scale cells per velocity cell.
+ *
+ * @param scale Cells of the density grid per velocity cell, along each axis
+ */
+void Config::setDensityScale(const unsigned int scale) {
+  _densityScale = scale < 1 ? 1 : scale;
+}
+
+/**
+ * Sets the CFL number of the steps: each step of dt is split into as many
+ * substeps as needed for the fastest fluid to cross at most cfl cells of
+ * the velocity grid per substep.
+ *
+ * @param cfl Cells per substep, 0 to run each step in one go
+ */
+void Config::setCfl(const float cfl) {
+  _cfl = cfl;
+}
+
+/**
+ * Sets the scheme of the advection: semi-Lagrangian, or MacCormack, which
+ * corrects it with a second pass for much less numerical diffusion.
+ *
+ * @param scheme Semi-Lagrangian or MacCormack
+ */
+void Config::setAdvection(const AdvectionScheme scheme) {
+  _advection = scheme;
+}
+
+/**
+ * Sets the activity threshold: the sources, the diffusion relaxations and
+ * the advections skip the tiles of the grid where the velocity and the
+ * density stay below it.
+ *
+ * @param threshold Magnitude of the fluid at rest, 0 to sweep everywhere
+ */
+void Config::setActivityThreshold(const float threshold) {
+  _activityThreshold = threshold;
+}
+
 /**
  * Sets the adress of the file where the density of the fluid
  * is going to be stored.
@@ -471,6 +809,22 @@ void Config::writeConfig(std::list<Segment*> segList) {
   currentConfig.setAttribute("viscosity", _viscosity);
   currentConfig.setAttribute("dt", _dt);
   currentConfig.setAttribute("diff", _diff);
+  currentConfig.setAttribute("threads", _threads);
+  currentConfig.setAttribute("pressureSolver",
+                             linearSolverName(_pressureSolver));
+  currentConfig.setAttribute("diffusionSolver",
+                             linearSolverName(_diffusionSolver));
+  currentConfig.setAttribute("tolerance", _tolerance);
+  currentConfig.setAttribute("minIterations", _minIterations);
+  currentConfig.setAttribute("maxIterations", _maxIterations);
+  currentConfig.setAttribute("warmStart", _warmStart ? "true" : "false");
+  currentConfig.setAttribute("storagePrecision",
+                             storagePrecisionName(_storagePrecision));
+  currentConfig.setAttribute("doublePrecision", _doublePrecision ? "true" : "false");
+  currentConfig.setAttribute("densityScale", _densityScale);
+  currentConfig.setAttribute("cfl", _cfl);
+  currentConfig.setAttribute("advection", advectionSchemeName(_advection));
+  currentConfig.setAttribute("activityThreshold", _activityThreshold);
 
   if (_protected) {
     currentConfig.setAttribute("protected", "true" );
@@ -602,6 +956,19 @@ void Config::makeDefaultConfig() {
   _viscosity = DEF_VISCOSITY;
   _dt = DEF_DT;
   _diff = DEF_DIFF;
+  _threads = DEF_THREADS;
+  _pressureSolver = DEF_PRESSURE_SOLVER;
+  _diffusionSolver = DEF_DIFFUSION_SOLVER;
+  _tolerance = DEF_TOLERANCE;
+  _minIterations = DEF_MIN_ITERATIONS;
+  _maxIterations = DEF_MAX_ITERATIONS;
+  _warmStart = DEF_WARM_START;
+  _storagePrecision = DEF_STORAGE_PRECISION;
+  _doublePrecision = DEF_DOUBLE_PRECISION;
+  _densityScale = DEF_DENSITY_SCALE;
+  _cfl = DEF_CFL;
+  _advection = DEF_ADVECTION;
+  _activityThreshold = DEF_ACTIVITY_THRESHOLD;
   _name =  QString("default");
 }
 
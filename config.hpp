@@ -10,9 +10,25 @@
 #define DEF_DIFF 0
 #define DEF_PROTECTION false
 #define DEF_SEGMENTNB 0
+#define DEF_THREADS 1
+#define DEF_PRESSURE_SOLVER SOLVER_GAUSS_SEIDEL
+#define DEF_DIFFUSION_SOLVER SOLVER_GAUSS_SEIDEL
+#define DEF_TOLERANCE 1e-3
+#define DEF_MIN_ITERATIONS 10
+#define DEF_MAX_ITERATIONS 10
+#define DEF_WARM_START true
+#define DEF_STORAGE_PRECISION STORAGE_FLOAT
+#define DEF_DOUBLE_PRECISION false
+#define DEF_DENSITY_SCALE 1
+#define DEF_CFL 0
+#define DEF_ADVECTION ADVECTION_SEMI_LAGRANGIAN
+#define DEF_ACTIVITY_THRESHOLD 0
 
 #include <QtXml>
 #include "./solver/Segment.hpp"
+#include "./solver/LinearSolver.hpp"
+#include "./solver/Advection.hpp"
+#include "./solver/CompactMatrix2D.hpp"
 
 /**
  * Class storing all the parameters about the fluid and the simulation
@@ -29,6 +45,19 @@ public:
   float getViscosity() const;
   float getDt() const;
   float getDiff() const;
+  unsigned int getThreads() const;
+  LinearSolver getPressureSolver() const;
+  LinearSolver getDiffusionSolver() const;
+  float getTolerance() const;
+  unsigned int getMinIterations() const;
+  unsigned int getMaxIterations() const;
+  bool getWarmStart() const;
+  StoragePrecision getStoragePrecision() const;
+  bool getDoublePrecision() const;
+  unsigned int getDensityScale() const;
+  float getCfl() const;
+  AdvectionScheme getAdvection() const;
+  float getActivityThreshold() const;
 
   const char *getDensFile();
   const char *getVelXFile();
@@ -48,6 +77,19 @@ public:
   void setDt(const float dt = DEF_DT) ;
   void setDiff(const float diff = DEF_DIFF);
   void setProtection(const bool protection = DEF_PROTECTION);
+  void setThreads(const unsigned int threads = DEF_THREADS);
+  void setPressureSolver(const LinearSolver solver = DEF_PRESSURE_SOLVER);
+  void setDiffusionSolver(const LinearSolver solver = DEF_DIFFUSION_SOLVER);
+  void setTolerance(const float tolerance = DEF_TOLERANCE);
+  void setIterations(const unsigned int min = DEF_MIN_ITERATIONS,
+                     const unsigned int max = DEF_MAX_ITERATIONS);
+  void setWarmStart(const bool warmStart = DEF_WARM_START);
+  void setStoragePrecision(const StoragePrecision precision = DEF_STORAGE_PRECISION);
+  void setDoublePrecision(const bool doublePrecision = DEF_DOUBLE_PRECISION);
+  void setDensityScale(const unsigned int scale = DEF_DENSITY_SCALE);
+  void setCfl(const float cfl = DEF_CFL);
+  void setAdvection(const AdvectionScheme scheme = DEF_ADVECTION);
+  void setActivityThreshold(const float threshold = DEF_ACTIVITY_THRESHOLD);
   void setName(QString name);
 
   void setDensFile(QString);
@@ -79,6 +121,19 @@ private:
   float _viscosity;
   float _dt;
   float _diff;
+  unsigned int _threads;
+  LinearSolver _pressureSolver;
+  LinearSolver _diffusionSolver;
+  float _tolerance;
+  unsigned int _minIterations;
+  unsigned int _maxIterations;
+  bool _warmStart;
+  StoragePrecision _storagePrecision;
+  bool _doublePrecision;
+  unsigned int _densityScale;
+  float _cfl;
+  AdvectionScheme _advection;
+  float _activityThreshold;
   int _segmentNb;
   int **_segmentValues;
   bool _protected;
@@ -101,6 +156,9 @@ private:
  
   bool isNotReadable();
   void updateObstacles();
+  LinearSolver readLinearSolver(const char *attribute, LinearSolver def);
+  StoragePrecision readStoragePrecision(const char *attribute, StoragePrecision def);
+  AdvectionScheme readAdvectionScheme(const char *attribute, AdvectionScheme def);
   void makeConfigFile();
 };
 
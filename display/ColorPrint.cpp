@@ -116,6 +116,19 @@ void ColorPrint::applyColor(float x, float , float ){
 
 }
 
+/**
+ * Applies the color of the cell (i, j) of X, with the velocity of the cell
+ * of u and v which covers it: the grid of X may have scale x scale cells
+ * per cell of the velocity grid (see FluidSolver2D::getDensityScale).
+ */
+template <class Matrix>
+void ColorPrint::applyCellColor(Matrix &X, FloatMatrix2D &u, FloatMatrix2D &v,
+                                unsigned int i, unsigned int j, unsigned int scale){
+  const unsigned int ui = i == 0 ? 0 : (i - 1) / scale + 1;
+  const unsigned int uj = j == 0 ? 0 : (j - 1) / scale + 1;
+  applyColor(X.get(i, j), u.get(ui, uj), v.get(ui, uj));
+}
+
 /** 
  * Display a set of squares which represent the density
  * of particules on the area stored in the matrix X. More
@@ -123,9 +136,20 @@ void ColorPrint::applyColor(float x, float , float ){
  * to make the gradient.
  */
 void ColorPrint::printMatrixScalar(FloatMatrix2D &X,FloatMatrix2D &u,FloatMatrix2D &v){
+  printScalar(X, u, v);
+}
+
+void ColorPrint::printMatrixScalar(CompactMatrix2D &X,FloatMatrix2D &u,FloatMatrix2D &v){
+  printScalar(X, u, v);
+}
+
+template <class Matrix>
+void ColorPrint::printScalar(Matrix &X,FloatMatrix2D &u,FloatMatrix2D &v){
   unsigned int i,j;
   const float n = X.getSize(0);//height
   const float m = X.getSize(1);//width
+  // cells of X per cell of the velocity along each axis
+  const unsigned int scale = (X.getSize(1) - 2) / (u.getSize(1) - 2);
 
   // For each cell of the matrix, draw a square
   for (i = 0; i < m; i += 1){
@@ -133,31 +157,31 @@ void ColorPrint::printMatrixScalar(FloatMatrix2D &X,FloatMatrix2D &u,FloatMatrix
       //Draws a square by defining four points.
       glBegin(GL_QUADS);
       //Defines the color of the square
-      applyColor(X.get(i,j), u.get(i,j), v.get(i,j));
+      applyCellColor(X, u, v, i,j, scale);
 
       glVertex2f(-1.0 + i*(2/m), -1.0 + j*(2/n));
 
       if (_antialiasing){
 	if(i < m-1)
-	  applyColor(X.get(i+1,j), u.get(i+1,j), v.get(i+1,j));
+	  applyCellColor(X, u, v, i+1,j, scale);
 	else
-	  applyColor(X.get(i,j), u.get(i,j), v.get(i,j));
+	  applyCellColor(X, u, v, i,j, scale);
       }
       glVertex2f(-1.0 + (2/m)*(i + 1), -1.0 + j*(2/n));
 
       if (_antialiasing){
 	if(i < m-1 && j < n-1)
-	  applyColor(X.get(i+1,j+1), u.get(i+1,j+1), v.get(i+1,j+1));
+	  applyCellColor(X, u, v, i+1,j+1, scale);
 	else
-	  applyColor(X.get(i,j), u.get(i,j), v.get(i,j));
+	  applyCellColor(X, u, v, i,j, scale);
       }
       glVertex2f(-1.0 + (2/m)*(i + 1), -1.0 + (2/n)*(j + 1));
 
       if (_antialiasing){
 	if(j < n-1)
-	  applyColor(X.get(i,j+1), u.get(i,j+1), v.get(i,j+1));
+	  applyCellColor(X, u, v, i,j+1, scale);
 	else
-	  applyColor(X.get(i,j), u.get(i,j), v.get(i,j));
+	  applyCellColor(X, u, v, i,j, scale);
       }
       glVertex2f(-1.0 + i*(2/m), -1.0 + (2/n)*(j + 1));
 
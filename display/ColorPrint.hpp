@@ -12,9 +12,15 @@ class ColorPrint : public Print {
 public:
   ColorPrint(bool antialiasing = false);
   virtual void printMatrixScalar(FloatMatrix2D &scalar, FloatMatrix2D &u, FloatMatrix2D &v);
+  virtual void printMatrixScalar(CompactMatrix2D &scalar, FloatMatrix2D &u, FloatMatrix2D &v);
   void printMatrixVector(FloatMatrix2D &u, FloatMatrix2D &v) ;
 private:
   inline virtual void applyColor(float x, float u, float v);
+  template <class Matrix> // FloatMatrix2D or CompactMatrix2D
+  void printScalar(Matrix &X, FloatMatrix2D &u, FloatMatrix2D &v);
+  template <class Matrix>
+  void applyCellColor(Matrix &X, FloatMatrix2D &u, FloatMatrix2D &v,
+                      unsigned int i, unsigned int j, unsigned int scale);
   bool _antialiasing;
 };
 
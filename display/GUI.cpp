@@ -51,8 +51,12 @@ GUI::GUI(QWidget *parent,
     fluid->_u_prev->load(configurationDatas.getVelXFile());
   if(strcmp("",configurationDatas.getVelYFile()) != 0)
     fluid->_v_prev->load(configurationDatas.getVelYFile());
-  if(strcmp("",configurationDatas.getDensFile()) != 0)
-    fluid->_dens_prev->load(configurationDatas.getDensFile());
+  if(strcmp("",configurationDatas.getDensFile()) != 0){
+    if (fluid->compactScalars())
+      fluid->_compactDensPrev->load(configurationDatas.getDensFile());
+    else
+      fluid->_dens_prev->load(configurationDatas.getDensFile());
+  }
 
   /* print modes */
   _printModes.append(p);
@@ -126,7 +130,10 @@ void GUI::paintGL(){
 
   /* (1) density  */
 
-  _printModes[_currentPrintMode]->printMatrixScalar(*(fluid->_dens), *(fluid->_u), *(fluid->_v));
+  if (fluid->compactScalars())
+    _printModes[_currentPrintMode]->printMatrixScalar(*(fluid->_compactDens), *(fluid->_u), *(fluid->_v));
+  else
+    _printModes[_currentPrintMode]->printMatrixScalar(*(fluid->_dens), *(fluid->_u), *(fluid->_v));
 
   /* (2) velocity */
 
@@ -141,23 +148,23 @@ void GUI::paintGL(){
 
   /* (3) obstacles   */
 
-  _printModes[_currentPrintMode]->drawObstacle(fluid->_dens->getSize(1),
-                                              fluid->_dens->getSize(0),
+  _printModes[_currentPrintMode]->drawObstacle(fluid->_u->getSize(1),
+                                              fluid->_u->getSize(0),
                                               *(fluid->_obstacles));
 
   /* (4) cursor   */
 
   _printModes[_currentPrintMode]->printSquare(mouseX,
 		     mouseY,
-		     (20 * coef) / fluid->_dens->getSize(1),
-		     (20 * coef) / fluid->_dens->getSize(0),
+		     (20 * coef) / fluid->_u->getSize(1),
+		     (20 * coef) / fluid->_u->getSize(0),
 		     width(),
 		     height());
 
   /* (5) Leap Motion cursors */
   for (int i=0; i < fingers.size(); i++)
-    _printModes[_currentPrintMode]->drawCircle(fingers[i].x / fluid->_dens->getSize(1) * width(),
-                                               fingers[i].y / fluid->_dens->getSize(0) * height(),
+    _printModes[_currentPrintMode]->drawCircle(fingers[i].x / fluid->_u->getSize(1) * width(),
+                                               fingers[i].y / fluid->_u->getSize(0) * height(),
                                                40,
                                                width(), height(),
                                                0.5f, 0.5f, 0.8f);
@@ -171,8 +178,8 @@ void GUI::paintGL(){
  */
 void GUI::addObstacle(float sqrWidth, float sqrHeight){
   /* matrix size */
-  const int n = fluid->_dens->getSize(0);
-  const int m = fluid->_dens->getSize(1);
+  const int n = fluid->_u->getSize(0);
+  const int m = fluid->_u->getSize(1);
   int xPos, yPos;
 
   /* position of the mouse on the grid */
@@ -204,7 +211,9 @@ void GUI::timeOutSlot(){
   calculateFPS();
 
   /* updates window title */
-  dispDens = fluid->_dens->get(dispMouseX, dispMouseY);
+  const unsigned int scale = fluid->getDensityScale();
+  dispDens = fluid->compactScalars() ? fluid->_compactDens->get(dispMouseX * scale, dispMouseY * scale)
+                                     : fluid->_dens->get(dispMouseX * scale, dispMouseY * scale);
   dispVelX = fluid->_u->get(dispMouseX, dispMouseY);
   dispVelY = fluid->_v->get(dispMouseX, dispMouseY);
   QString title;
@@ -223,9 +232,13 @@ void GUI::timeOutSlot(){
   const float _fillingSpeed = 1.0 / 10;
 
   /* Mouse events */
-  if(pressing)
+  if(pressing && fluid->compactScalars())
+    fillSquare(20 * coef, 20 * coef,  configuration.getDt() * _fillingSpeed, fluid->_compactDens);
+  else if(pressing)
     fillSquare(20 * coef, 20 * coef,  configuration.getDt() * _fillingSpeed, fluid->_dens);
-  if(emptying)
+  if(emptying && fluid->compactScalars())
+    fillSquare(20 * coef, 20 * coef, -configuration.getDt() * _fillingSpeed, fluid->_compactDens);
+  else if(emptying)
     fillSquare(20 * coef, 20 * coef, -configuration.getDt() * _fillingSpeed, fluid->_dens);
 
   /* Leap Motion */
@@ -257,8 +270,12 @@ void GUI::timeOutSlot(){
           int delta = 10;
           for (int i=-delta/2; i<delta/2;i++)
             for (int j=-delta/2; j<delta/2; j++)
-              fluid->_dens->set(x-i,y-j, fluid->_dens->get(x-i,y-j)
-                                + (0.5-pointable.touchDistance())/4);
+              if (fluid->compactScalars())
+                fluid->_compactDens->set(x*scale-i,y*scale-j, fluid->_compactDens->get(x*scale-i,y*scale-j)
+                                         + (0.5-pointable.touchDistance())/4);
+              else
+                fluid->_dens->set(x*scale-i,y*scale-j, fluid->_dens->get(x*scale-i,y*scale-j)
+                                  + (0.5-pointable.touchDistance())/4);
         }
 
         fingers.append(normalizedPosition);
@@ -277,19 +294,8 @@ void GUI::timeOutSlot(){
   if (!_pause){
 
     /* Solver computations */
-    fluid->velStep (fluid->_u, fluid->_v, fluid->_u_prev, fluid->_v_prev,
-		    configuration.getViscosity(), configuration.getDt());
-    fluid->densStep(fluid->_dens, fluid->_dens_prev, fluid->_u, fluid->_v,
-                    configuration.getDiff(), configuration.getDt());
-
-    /* Reset matrices */
-    fluid->_u_prev->fill(0);
-    fluid->_v_prev->fill(0);
-    fluid->_dens_prev->fill(0);
-
-    fluid->_dens_prev->add(*(fluid->_dens_src));
-    fluid->_u_prev->add(*(fluid->_u_vel_src));
-    fluid->_v_prev->add(*(fluid->_v_vel_src));
+    fluid->step(configuration.getViscosity(), configuration.getDiff(),
+                configuration.getDt());
   }
 
   /* drawings */
@@ -348,22 +354,31 @@ void GUI::calculateFPS(){
 /**
  * Fills a centered square in the matrix with a specific value
  * 
- * @param sqrWidth Width of the square to fill
- * @param sqrHeight Height of the square to fill
+ * @param sqrWidth Width of the square to fill, in cells of the velocity grid
+ * @param sqrHeight Height of the square to fill, in cells of the velocity grid
  * @param value Value to set in the matrix
  * @param matrix Matrix to modify
  * @param prev Indicates if you are seting a velocity source or not
  */
+template <class Matrix>
 void GUI::fillSquare(unsigned int sqrWidth, 
 		     unsigned int sqrHeight,
 		     float value,
-		     FloatMatrix2D* matrix,
+		     Matrix* matrix,
 		     bool prev){
   /* matrix size */
   const int n = matrix->getSize(0);
   const int m = matrix->getSize(1);
   int xPos, yPos;
 
+  /* the density may be on a finer grid than the velocity */
+  const bool velocityGrid = (m == (int) fluid->_u->getSize(1));
+  const Obstacles &obstacles = velocityGrid ? *(fluid->_obstacles) : fluid->getDensityObstacles();
+  if(!velocityGrid){
+    sqrWidth *= fluid->getDensityScale();
+    sqrHeight *= fluid->getDensityScale();
+  }
+
   if(prev){
   /* previous position of the mouse on the grid */
     xPos =        ((float) firstPosX / width() ) * m;
@@ -396,7 +411,7 @@ void GUI::fillSquare(unsigned int sqrWidth,
       newVal = matrix->get(i, j) + value;
       if(!prev)
         if (newVal < 0) newVal = 0;
-      if(!(fluid->_obstacles->isInObstacles(i,j))){
+      if(!(obstacles.isInObstacles(i,j))){
         matrix->set( i, j, newVal);
       }
     }
@@ -507,8 +522,8 @@ void GUI::mouseReleaseEvent(QMouseEvent *mouseEvent) {
  */
 void GUI::mouseMoveEvent(QMouseEvent *mouseEvent){
   /* matrix size */
-  const unsigned int n = (fluid->_dens)->getSize(0);
-  const unsigned int m = (fluid->_dens)->getSize(1);
+  const unsigned int n = (fluid->_u)->getSize(0);
+  const unsigned int m = (fluid->_u)->getSize(1);
 
   /* mouse position */
   const unsigned int xPos =     (float) mouseEvent->x() / width()  * m;
@@ -548,8 +563,8 @@ void GUI::mouseMoveEvent(QMouseEvent *mouseEvent){
  * @param mouseEvent Event of the mouse related to its wheel
  */
 void GUI::wheelEvent(QWheelEvent *mouseEvent){
-  int n = (fluid->_dens)->getSize(0);
-  int m = (fluid->_dens)->getSize(1);
+  int n = (fluid->_u)->getSize(0);
+  int m = (fluid->_u)->getSize(1);
   int pos = mouseEvent->delta();
   coef += (float) pos/120;
   if(coef > m/20){
@@ -593,7 +608,10 @@ void GUI::saveConfig(){
       + "/" + configName + "_velY_src";
 
     /* save matrices */
-    fluid->_dens->save(densFile.toStdString().c_str());
+    if (fluid->compactScalars())
+      fluid->_compactDens->save(densFile.toStdString().c_str());
+    else
+      fluid->_dens->save(densFile.toStdString().c_str());
     configuration.setDensFile(densFile);
 
     fluid->_u->save(velXFile.toStdString().c_str());
@@ -638,27 +656,11 @@ void GUI::loadConfig(){
     configuration.updateConfig();
 
     /* if files provided, load them */
-    if(strcmp("",configuration.getVelXFile()) != 0)
-      fluid->_u->load(configuration.getVelXFile());
-
-    if(strcmp("",configuration.getVelYFile()) != 0)
-      fluid->_v->load(configuration.getVelYFile());
-
-    if(strcmp("",configuration.getDensFile()) != 0)
-      fluid->_dens->load(configuration.getDensFile());
-
-    if(strcmp("",configuration.getVelXSrcFile()) != 0)
-      fluid->_u_vel_src->load(configuration.getVelXSrcFile());
-
-    if(strcmp("",configuration.getVelYSrcFile()) != 0)
-      fluid->_v_vel_src->load(configuration.getVelYSrcFile());
-
-    if(strcmp("",configuration.getDensSrcFile()) != 0)
-      fluid->_dens_src->load(configuration.getDensSrcFile());
+    fluid->loadState(configuration);
 
     /* overwrite the obstacles */
     delete fluid->_obstacles;
-    fluid->_obstacles = new Obstacles(fluid->_dens->getSize(1),fluid->_dens->getSize(0),configuration);
+    fluid->_obstacles = new Obstacles(fluid->_u->getSize(1),fluid->_u->getSize(0),configuration);
     
     /* resume the simulation */
       _pause = false;
@@ -42,7 +42,8 @@ class GUI : public QGLWidget
   void toggleFullWindow();
   void calculateFPS();
 
-  void fillSquare(unsigned int sqrWidth, unsigned int sqrHeight, float value, FloatMatrix2D* matrix, bool prev = false);
+  template <class Matrix> // FloatMatrix2D or CompactMatrix2D
+  void fillSquare(unsigned int sqrWidth, unsigned int sqrHeight, float value, Matrix* matrix, bool prev = false);
   void addObstacle(float sqrWidth, float sqrHeight);
   void resizeMatrix(FloatMatrix2D &out, const FloatMatrix2D  &in, int k);
   void addPrintMode(Print *p);
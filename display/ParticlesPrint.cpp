@@ -110,9 +110,22 @@ void ParticlesPrint::drawLine(float x, float y, float x2, float y2,
 
 void ParticlesPrint::printMatrixScalar(FloatMatrix2D &X,FloatMatrix2D &u,FloatMatrix2D &v){
   ColorPrint::printMatrixScalar(X, u, v);
+  printParticles(u, v);
+}
 
-  const float n = X.getSize(0);//height
-  const float m = X.getSize(1);//width
+void ParticlesPrint::printMatrixScalar(CompactMatrix2D &X,FloatMatrix2D &u,FloatMatrix2D &v){
+  ColorPrint::printMatrixScalar(X, u, v);
+  printParticles(u, v);
+}
+
+/**
+ * Moves the particles along the velocity (unless paused) and draws them.
+ */
+void ParticlesPrint::printParticles(FloatMatrix2D &u, FloatMatrix2D &v){
+
+  // the particles move on the velocity grid, which may be coarser than X
+  const float n = u.getSize(0);//height
+  const float m = u.getSize(1);//width
 
   float x, y;
   unsigned int ix, iy;
@@ -131,10 +144,6 @@ void ParticlesPrint::printMatrixScalar(FloatMatrix2D &X,FloatMatrix2D &u,FloatMa
     /* ignore out of bounds particles */
     if (!(ix < m && iy < n)) continue;
     
-    /* match particles with density */
-    //if (X.get( (int) x, (int) y) < .5) continue;
-
-
     /* prevent particles to move when simulation is paused */
     if (!_pause){
 
@@ -17,11 +17,13 @@ public:
 		  const bool enableTrail  = false);
   ~ParticlesPrint();
   void printMatrixScalar(FloatMatrix2D &scalar, FloatMatrix2D &u, FloatMatrix2D &v);
+  void printMatrixScalar(CompactMatrix2D &scalar, FloatMatrix2D &u, FloatMatrix2D &v);
   void reset();  
   void pause();
 
 private:
   inline virtual void applyColor(float x, float u, float v);
+  void printParticles(FloatMatrix2D &u, FloatMatrix2D &v);
   void drawLine(float x, float y, float x2, float y2, 
 		float n, float m, int width, 
 		float r, float g, float b, float a);
@@ -2,12 +2,15 @@
 #define PRINT_H
 
 #include "../solver/FloatMatrix2D.hpp"
+#include "../solver/CompactMatrix2D.hpp"
 #include "../solver/Obstacles.hpp"
 
 class Print
 {
 public:
   virtual void printMatrixScalar(FloatMatrix2D &scalar, FloatMatrix2D &u, FloatMatrix2D &v) = 0;
+  // the density in a 16-bit storage precision (see FluidSolver2D::setStoragePrecision)
+  virtual void printMatrixScalar(CompactMatrix2D &scalar, FloatMatrix2D &u, FloatMatrix2D &v) = 0;
   virtual void printMatrixVector(FloatMatrix2D &u, FloatMatrix2D &v) = 0;
   virtual void reset();
   virtual void pause();
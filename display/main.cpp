@@ -32,6 +32,26 @@ void usage (char *s){
   cout << setw(35) << "\t[-dt    <(float) time precision>]" << endl;
   cout << setw(35) << "\t[-visc  <(float) viscosity>]" << endl;
   cout << setw(35) << "\t[-diff  <(float) diffusion>]" << endl;
+  cout << setw(35) << "\t[-threads <(integer) solver threads>]"
+       << setw(38) << right << "(0: one per core)" << left << endl;
+  cout << setw(35) << "\t[-pressure  <gaussseidel | redblack | multigrid | pcg | iccg>]"
+       << endl;
+  cout << setw(35) << "\t[-diffusion <gaussseidel | redblack | pcg | iccg>]"
+       << endl;
+  cout << setw(35) << "\t[-tolerance <(float) relative residual>]" << endl;
+  cout << setw(35) << "\t[-iterations <(int) min> <(int) max>]"
+       << setw(38) << right << "(relaxation sweeps)" << left << endl;
+  cout << setw(35) << "\t[-coldstart]" << setw(38) << right
+       << "(pressure solves start from zero)" << left << endl;
+  cout << setw(35) << "\t[-storage <float | half | bfloat>]" << setw(38) << right
+       << "(precision of the density fields)" << left << endl;
+  cout << setw(35) << "\t[-densityscale <(integer) scale>]" << setw(38) << right
+       << "(density cells per velocity cell)" << left << endl;
+  cout << setw(35) << "\t[-cfl   <(float) cells per substep>]" << setw(38) << right
+       << "(split the steps, 0: never)" << left << endl;
+  cout << setw(35) << "\t[-advection <semilagrangian | maccormack>]" << endl;
+  cout << setw(35) << "\t[-activity <(float) threshold>]" << setw(38) << right
+       << "(skip the fluid at rest, 0: never)" << left << endl;
   cout << setw(35) << "\t[-p     <(int) number of particles>]" << endl;
   cout << setw(35) << "\t[-vectors]" << setw(38) << right
        << "(display velocity field)"
@@ -117,6 +137,70 @@ int main(int argc, char *argv[]){
         configuration->setDiff(atof(argv[arg+1]));
         arg++;
       }
+      // threads
+      else if (ARG_IS("threads")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setThreads(atoi(argv[arg+1]));
+        arg++;
+      }
+      // pressure solver
+      else if (ARG_IS("pressure")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setPressureSolver(linearSolverFromName(argv[arg+1]));
+        arg++;
+      }
+      // diffusion solver
+      else if (ARG_IS("diffusion")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setDiffusionSolver(linearSolverFromName(argv[arg+1]));
+        arg++;
+      }
+      // tolerance
+      else if (ARG_IS("tolerance")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setTolerance(atof(argv[arg+1]));
+        arg++;
+      }
+      // iterations
+      else if (ARG_IS("iterations")){
+        check_nb_params(arg, argc, argv, 2);
+        configuration->setIterations(atoi(argv[arg+1]), atoi(argv[arg+2]));
+        arg+=2;
+      }
+      // cold start
+      else if (ARG_IS("coldstart")){
+        configuration->setWarmStart(false);
+      }
+      // storage precision
+      else if (ARG_IS("storage")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setStoragePrecision(storagePrecisionFromName(argv[arg+1]));
+        arg++;
+      }
+      // density grid finer than the velocity one
+      else if (ARG_IS("densityscale")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setDensityScale(atoi(argv[arg+1]));
+        arg++;
+      }
+      // substeps
+      else if (ARG_IS("cfl")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setCfl(atof(argv[arg+1]));
+        arg++;
+      }
+      // advection scheme
+      else if (ARG_IS("advection")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setAdvection(advectionSchemeFromName(argv[arg+1]));
+        arg++;
+      }
+      // sparse advection
+      else if (ARG_IS("activity")){
+        check_nb_params(arg, argc, argv, 1);
+        configuration->setActivityThreshold(atof(argv[arg+1]));
+        arg++;
+      }
       // scale
       else if (ARG_IS("scale")){
         check_nb_params(arg, argc, argv, 1);
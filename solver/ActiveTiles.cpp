@@ -0,0 +1,108 @@
+#include "ActiveTiles.hpp"
+#include <cmath>
+#include <algorithm>
+
+#define FAR_TILE 255 // beyond any ring
+
+/**
+ * Constructor: tiles of a velocity grid of N_i x N_j interior cells, all
+ * of them marked.
+ */
+ActiveTiles::ActiveTiles(unsigned int N_i, unsigned int N_j)
+  : _N_i(N_i), _N_j(N_j),
+    _nbTiles_i((N_i + ACTIVE_TILE_SIZE - 1) / ACTIVE_TILE_SIZE),
+    _nbTiles_j((N_j + ACTIVE_TILE_SIZE - 1) / ACTIVE_TILE_SIZE),
+    _distances(_nbTiles_i * _nbTiles_j, 0)
+{
+}
+
+unsigned int ActiveTiles::getNbActive(unsigned int reach) const{
+  unsigned int count = 0;
+  for (unsigned int t = 0; t < _distances.size(); t++)
+    if (_distances[t] <= reach)
+      count++;
+  return count;
+}
+
+/**
+ * Unmarks every tile.
+ */
+void ActiveTiles::clear(){
+  std::fill(_distances.begin(), _distances.end(), FAR_TILE);
+}
+
+/**
+ * Marks every tile, so that the sweeps cover the whole grid.
+ */
+void ActiveTiles::markAll(){
+  std::fill(_distances.begin(), _distances.end(), 0);
+}
+
+/**
+ * Marks the tiles where |x| exceeds threshold in at least one interior
+ * cell. The cells of the tiles already marked are not read.
+ *
+ * @param x field on a grid scale times finer than the velocity one
+ */
+template <typename T>
+void ActiveTiles::mark(const ScalarMatrix2D<T> &x, unsigned int scale, T threshold){
+  const unsigned int N_j = x.getSize(0) - 2;
+  for (unsigned int j = 1; j <= N_j; j++)
+    markRow(j, x.getArray() + j * x.getStride(), scale, threshold);
+}
+
+/**
+ * Same as mark for a field in 16-bit storage, widened row by row.
+ */
+void ActiveTiles::mark(const CompactMatrix2D &x, unsigned int scale, float threshold){
+  const unsigned int N_j = x.getSize(0) - 2;
+  std::vector<float> row(x.getSize(1));
+  for (unsigned int j = 1; j <= N_j; j++){
+    x.expandRow(j, 0, row.size(), &row[0]);
+    markRow(j, &row[0], scale, threshold);
+  }
+}
+
+/**
+ * Marks the tiles of the row j of a field of the grid scale times finer,
+ * whose cells are values[0..], which are not yet.
+ */
+template <typename T>
+void ActiveTiles::markRow(unsigned int j, const T *values, unsigned int scale, T threshold){
+  const unsigned int size = ACTIVE_TILE_SIZE * scale;
+  const unsigned int N_i = _N_i * scale;
+  unsigned char *tiles = &_distances[((j - 1) / size) * _nbTiles_i];
+  for (unsigned int t = 0; t < _nbTiles_i; t++){
+    if (tiles[t] == 0)
+      continue;
+    const unsigned int first = 1 + t * size;
+    const unsigned int end = first + size <= N_i + 1 ? first + size : N_i + 1;
+    for (unsigned int k = first; k < end; k++)
+      if (std::fabs(values[k]) > threshold){
+        tiles[t] = 0;
+        break;
+      }
+  }
+}
+
+/**
+ * Gives every tile within rings tiles of a marked one its distance to it.
+ */
+void ActiveTiles::dilate(unsigned int rings){
+  rings = std::min(rings, (unsigned int) FAR_TILE - 1);
+  for (unsigned int r = 1; r <= rings; r++)
+    for (unsigned int tj = 0; tj < _nbTiles_j; tj++)
+      for (unsigned int ti = 0; ti < _nbTiles_i; ti++){
+        unsigned char &distance = _distances[tj * _nbTiles_i + ti];
+        if (distance < r)
+          continue;
+        // next to a tile of the previous ring
+        for (unsigned int nj = tj ? tj - 1 : 0; nj <= tj + 1 && nj < _nbTiles_j; nj++)
+          for (unsigned int ni = ti ? ti - 1 : 0; ni <= ti + 1 && ni < _nbTiles_i; ni++)
+            if (_distances[nj * _nbTiles_i + ni] == r - 1)
+              distance = r;
+      }
+}
+
+template void ActiveTiles::mark(const ScalarMatrix2D<float> &, unsigned int, float);
+template void ActiveTiles::mark(const ScalarMatrix2D<double> &, unsigned int, double);
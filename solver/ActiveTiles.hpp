@@ -0,0 +1,94 @@
+#ifndef ACTIVETILES_HPP_
+#define ACTIVETILES_HPP_
+
+#include <vector>
+#include <algorithm>
+#include "FloatMatrix2D.hpp"
+#include "CompactMatrix2D.hpp"
+
+/**
+ * This class keeps track of the parts of a grid where something happens:
+ * the interior cells are split into square tiles of ACTIVE_TILE_SIZE
+ * cells of the velocity grid, and a tile is marked when one of the fields
+ * given to mark exceeds a threshold in one of its cells. The kernels of the
+ * solver then skip the tiles far from any marked one, where the fluid is
+ * at rest and empty.
+ *
+ * Each tile holds its distance (in tiles, diagonals counting as 1) to the
+ * nearest marked one, computed by dilate up to a number of rings: a sweep
+ * over the tiles within reach 1 covers the marked ones and a ring of
+ * safety around them, in which the fluid may move during the step. The
+ * fields on a finer grid (the density, see FluidSolver2D) have scale x
+ * scale times as many cells per tile.
+ */
+
+#define ACTIVE_TILE_SIZE 16
+
+class ActiveTiles {
+public:
+  ActiveTiles(unsigned int N_i, unsigned int N_j);
+
+  inline unsigned int getNbTiles() const{
+    return _distances.size();
+  }
+
+  /**
+   * Number of tiles within reach of a marked one.
+   */
+  unsigned int getNbActive(unsigned int reach = 1) const;
+
+  void clear();
+  void markAll();
+  template <typename T>
+  void mark(const ScalarMatrix2D<T> &x, unsigned int scale, T threshold);
+  void mark(const CompactMatrix2D &x, unsigned int scale, float threshold);
+  void dilate(unsigned int rings);
+
+  /**
+   * Calls row(j, first, n) for the rows jBegin..jEnd-1 of a grid scale
+   * times finer than the velocity one, on each run of consecutive tiles
+   * within reach of a marked one, which covers the columns
+   * first..first+n-1. Rows whose tiles are all too far are skipped; when
+   * every tile is within reach, each row is a single run.
+   */
+  template <class RowFunction>
+  void forEachRow(unsigned int jBegin, unsigned int jEnd, unsigned int scale,
+                  unsigned int reach, RowFunction row) const{
+    for (unsigned int j = jBegin; j < jEnd; j++)
+      forEachRun(j, 1, _N_i * scale, scale, reach, row);
+  }
+
+  /**
+   * Same as forEachRow for the columns first..first+n-1 of the row j only,
+   * the runs being clipped to them: the segments of the sweeps which walk
+   * the rows tile after tile (see Tiling).
+   */
+  template <class RowFunction>
+  void forEachRun(unsigned int j, unsigned int first, unsigned int n, unsigned int scale,
+                  unsigned int reach, RowFunction row) const{
+    const unsigned int size = ACTIVE_TILE_SIZE * scale, end = first + n;
+    const unsigned char *tiles = &_distances[((j - 1) / size) * _nbTiles_i];
+    for (unsigned int t = (first - 1) / size; 1 + t * size < end; ){
+      if (tiles[t] > reach){
+        t++;
+        continue;
+      }
+      const unsigned int begin = t;
+      while (1 + t * size < end && tiles[t] <= reach)
+        t++;
+      const unsigned int runFirst = std::max(first, 1 + begin * size);
+      const unsigned int runEnd = std::min(end, 1 + t * size);
+      row(j, runFirst, runEnd - runFirst);
+    }
+  }
+
+private:
+  template <typename T>
+  void markRow(unsigned int j, const T *values, unsigned int scale, T threshold);
+
+  unsigned int _N_i, _N_j; // interior cells of the velocity grid
+  unsigned int _nbTiles_i, _nbTiles_j;
+  std::vector<unsigned char> _distances; // row after row of tiles
+};
+
+#endif
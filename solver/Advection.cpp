@@ -0,0 +1,29 @@
+#include "Advection.hpp"
+#include <stdexcept>
+
+static const char *names[] = {
+  "semilagrangian",
+  "maccormack"
+};
+static const unsigned int nbNames = sizeof(names) / sizeof(names[0]);
+
+/**
+ * Returns the advection scheme matching a name, as written in the
+ * configuration file or on the command line.
+ *
+ * @param name Name of the scheme
+ */
+AdvectionScheme advectionSchemeFromName(const std::string &name){
+  for (unsigned int k = 0; k < nbNames; k++)
+    if (name == names[k])
+      return (AdvectionScheme) k;
+  throw(std::invalid_argument(std::string("Unknown advection scheme '")
+                              + name + "'"));
+}
+
+/**
+ * Returns the name of an advection scheme.
+ */
+const char *advectionSchemeName(AdvectionScheme scheme){
+  return names[scheme];
+}
@@ -0,0 +1,17 @@
+#ifndef ADVECTION_HPP_
+#define ADVECTION_HPP_
+
+#include <string>
+
+/**
+ * Schemes of the advection of the density and of the velocity.
+ */
+enum AdvectionScheme {
+  ADVECTION_SEMI_LAGRANGIAN, // bilinear sample at the back-traced position
+  ADVECTION_MACCORMACK       // corrected by a backward pass, limited
+};
+
+AdvectionScheme advectionSchemeFromName(const std::string &name);
+const char *advectionSchemeName(AdvectionScheme scheme);
+
+#endif
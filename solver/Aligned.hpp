@@ -0,0 +1,40 @@
+#ifndef ALIGNED_HPP_
+#define ALIGNED_HPP_
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+#define MEMORY_ALIGN 64 // bytes: a cache line, and the widest vector (AVX-512)
+
+/**
+ * Allocates count zeroed elements at an address which is a multiple of
+ * MEMORY_ALIGN, so that no vector load of an aligned row crosses a cache
+ * line. The block must be released with alignedDelete.
+ *
+ * The offset to the block returned by new is stored in the byte just
+ * before the aligned address (plain new/delete, as no aligned allocation
+ * function is available everywhere in C++11).
+ */
+template <class T>
+T *alignedNew(size_t count){
+  unsigned char *raw = new unsigned char[count * sizeof(T) + MEMORY_ALIGN];
+  const size_t offset = MEMORY_ALIGN - ((uintptr_t) raw) % MEMORY_ALIGN;
+  unsigned char *aligned = raw + offset;
+  aligned[-1] = (unsigned char) offset;
+  memset(aligned, 0, count * sizeof(T));
+  return (T *) aligned;
+}
+
+/**
+ * Releases a block allocated by alignedNew (nothing when NULL).
+ */
+template <class T>
+void alignedDelete(T *block){
+  if (block == NULL)
+    return;
+  unsigned char *aligned = (unsigned char *) block;
+  delete[] (aligned - aligned[-1]);
+}
+
+#endif
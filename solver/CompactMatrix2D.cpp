@@ -0,0 +1,215 @@
+#include "CompactMatrix2D.hpp"
+#include "Stencil.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+static const char *names[] = {
+  "float",
+  "half",
+  "bfloat"
+};
+static const unsigned int nbNames = sizeof(names) / sizeof(names[0]);
+
+/**
+ * Returns the storage precision matching a name, as written in the
+ * configuration file or on the command line.
+ *
+ * @param name Name of the precision
+ */
+StoragePrecision storagePrecisionFromName(const std::string &name){
+  for (unsigned int k = 0; k < nbNames; k++)
+    if (name == names[k])
+      return (StoragePrecision) k;
+  throw(std::invalid_argument(std::string("Unknown storage precision '")
+                              + name + "'"));
+}
+
+/**
+ * Returns the name of a storage precision.
+ */
+const char *storagePrecisionName(StoragePrecision precision){
+  return names[precision];
+}
+
+/**
+ * Converts n cells of storage into floats.
+ */
+static void toFloats(float *dst, const unsigned char *src, unsigned int n,
+                     StoragePrecision precision){
+  switch (precision){
+  case STORAGE_HALF:
+    stencilHalfToFloatRow(dst, (const unsigned short *) src, n);
+    break;
+  case STORAGE_BFLOAT:
+    stencilBfloatToFloatRow(dst, (const unsigned short *) src, n);
+    break;
+  default:
+    memcpy(dst, src, n * sizeof(float));
+  }
+}
+
+/**
+ * Converts n floats into cells of storage.
+ */
+static void fromFloats(unsigned char *dst, const float *src, unsigned int n,
+                       StoragePrecision precision){
+  switch (precision){
+  case STORAGE_HALF:
+    stencilFloatToHalfRow((unsigned short *) dst, src, n);
+    break;
+  case STORAGE_BFLOAT:
+    stencilFloatToBfloatRow((unsigned short *) dst, src, n);
+    break;
+  default:
+    memcpy(dst, src, n * sizeof(float));
+  }
+}
+
+/**
+ * Conversions of cells of the solver matrices: doubles go through floats,
+ * CONVERSION_CHUNK at a time.
+ */
+#define CONVERSION_CHUNK 256
+
+static void compressCells(unsigned char *dst, const float *src, unsigned int n,
+                          StoragePrecision precision){
+  fromFloats(dst, src, n, precision);
+}
+
+static void compressCells(unsigned char *dst, const double *src, unsigned int n,
+                          StoragePrecision precision){
+  const unsigned int elementSize = precision == STORAGE_FLOAT ? sizeof(float) : sizeof(unsigned short);
+  float chunk[CONVERSION_CHUNK];
+  for (unsigned int k = 0; k < n; k += CONVERSION_CHUNK){
+    const unsigned int m = std::min(n - k, (unsigned int) CONVERSION_CHUNK);
+    std::copy(src + k, src + k + m, chunk);
+    fromFloats(dst + k * elementSize, chunk, m, precision);
+  }
+}
+
+static void expandCells(float *dst, const unsigned char *src, unsigned int n,
+                        StoragePrecision precision){
+  toFloats(dst, src, n, precision);
+}
+
+static void expandCells(double *dst, const unsigned char *src, unsigned int n,
+                        StoragePrecision precision){
+  const unsigned int elementSize = precision == STORAGE_FLOAT ? sizeof(float) : sizeof(unsigned short);
+  float chunk[CONVERSION_CHUNK];
+  for (unsigned int k = 0; k < n; k += CONVERSION_CHUNK){
+    const unsigned int m = std::min(n - k, (unsigned int) CONVERSION_CHUNK);
+    toFloats(chunk, src + k * elementSize, m, precision);
+    std::copy(chunk, chunk + m, dst + k);
+  }
+}
+
+/**
+ * Constructor: allocates a zeroed matrix of i columns and j rows, border
+ * included.
+ */
+CompactMatrix2D::CompactMatrix2D(const unsigned int i, const unsigned int j,
+                                 const StoragePrecision precision) :
+_precision(precision), _width(i), _height(j), _stride(FloatMatrix2D::strideFor(i)),
+_elementSize(precision == STORAGE_FLOAT ? sizeof(float) : sizeof(unsigned short))
+{
+  _storage = alignedNew<unsigned char>(getStorageBytes());
+  _values = _storage + FloatMatrix2D::paddingFor() * _elementSize;
+}
+
+CompactMatrix2D::~CompactMatrix2D(){
+  alignedDelete(_storage);
+}
+
+float CompactMatrix2D::get(const unsigned int i, const unsigned int j) const{
+  float value;
+  toFloats(&value, _values + index(i, j) * _elementSize, 1, _precision);
+  return value;
+}
+
+void CompactMatrix2D::set(const unsigned int i, const unsigned int j, const float value){
+  fromFloats(_values + index(i, j) * _elementSize, &value, 1, _precision);
+}
+
+/**
+ * Sets every cell, padding included.
+ */
+void CompactMatrix2D::fill(float v){
+  const unsigned int length = FloatMatrix2D::storageLengthFor(_width, _height);
+  if (v == 0){
+    memset(_storage, 0, length * _elementSize);
+    return;
+  }
+  std::vector<float> row(_stride, v);
+  for (unsigned int k = 0; k < length; k += _stride)
+    fromFloats(_storage + k * _elementSize, &row[0], _stride, _precision);
+}
+
+/**
+ * Stores the rows jBegin..jEnd-1 of m, border included, rounded to the
+ * precision of the matrix. m must have the size of the matrix.
+ */
+template <typename T>
+void CompactMatrix2D::compressRows(const ScalarMatrix2D<T> &m, unsigned int jBegin, unsigned int jEnd){
+  for (unsigned int j = jBegin; j < jEnd; j++)
+    compressCells(_values + index(0, j) * _elementSize, m.getArray() + j * m.getStride(),
+                  _width, _precision);
+}
+
+/**
+ * Writes the rows jBegin..jEnd-1 of the matrix, border included, into m,
+ * which must have the size of the matrix.
+ */
+template <typename T>
+void CompactMatrix2D::expandRows(ScalarMatrix2D<T> &m, unsigned int jBegin, unsigned int jEnd) const{
+  for (unsigned int j = jBegin; j < jEnd; j++)
+    expandCells(m.getArray() + j * m.getStride(), _values + index(0, j) * _elementSize,
+                _width, _precision);
+}
+
+/**
+ * Stores src[0..n-1] into the cells first..first+n-1 of the row j, rounded
+ * to the precision of the matrix.
+ */
+template <typename T>
+void CompactMatrix2D::compressRow(unsigned int j, unsigned int first, unsigned int n, const T *src){
+  compressCells(_values + index(first, j) * _elementSize, src, n, _precision);
+}
+
+/**
+ * Writes the cells first..first+n-1 of the row j into dst[0..n-1].
+ */
+template <typename T>
+void CompactMatrix2D::expandRow(unsigned int j, unsigned int first, unsigned int n, T *dst) const{
+  expandCells(dst, _values + index(first, j) * _elementSize, n, _precision);
+}
+
+/**
+ * Loads a file written by FloatMatrix2D::save (or save), rounding its
+ * values to the precision of the matrix.
+ */
+void CompactMatrix2D::load(const char *file){
+  FloatMatrix2D m(_width, _height);
+  expandRows(m, 0, _height); // keeps the matrix if the file does not fit
+  m.load(file);
+  compressRows(m, 0, _height);
+}
+
+/**
+ * Saves the matrix in the file format of FloatMatrix2D.
+ */
+void CompactMatrix2D::save(const char *file) const{
+  FloatMatrix2D m(_width, _height);
+  expandRows(m, 0, _height);
+  m.save(file);
+}
+
+template void CompactMatrix2D::compressRows(const FloatMatrix2D &, unsigned int, unsigned int);
+template void CompactMatrix2D::compressRows(const DoubleMatrix2D &, unsigned int, unsigned int);
+template void CompactMatrix2D::expandRows(FloatMatrix2D &, unsigned int, unsigned int) const;
+template void CompactMatrix2D::expandRows(DoubleMatrix2D &, unsigned int, unsigned int) const;
+template void CompactMatrix2D::compressRow(unsigned int, unsigned int, unsigned int, const float *);
+template void CompactMatrix2D::compressRow(unsigned int, unsigned int, unsigned int, const double *);
+template void CompactMatrix2D::expandRow(unsigned int, unsigned int, unsigned int, float *) const;
+template void CompactMatrix2D::expandRow(unsigned int, unsigned int, unsigned int, double *) const;
@@ -0,0 +1,107 @@
+#ifndef COMPACTMATRIX2D_HPP_
+#define COMPACTMATRIX2D_HPP_
+
+#include <string>
+#include "FloatMatrix2D.hpp"
+
+/**
+ * Formats in which a CompactMatrix2D stores its cells.
+ */
+enum StoragePrecision {
+  STORAGE_FLOAT,  // 32-bit floats
+  STORAGE_HALF,   // IEEE half floats: 11 bits of mantissa, up to 65504
+  STORAGE_BFLOAT  // bfloat16: 8 bits of mantissa, the range of floats
+};
+
+StoragePrecision storagePrecisionFromName(const std::string &name);
+const char *storagePrecisionName(StoragePrecision precision);
+
+/**
+ * This class implements 2D matrices kept in a chosen precision: 16-bit
+ * storage halves the memory and the bandwidth of the fields which need
+ * little precision (the scalar channels of the solver and their sources),
+ * while the computations stay in float or double. The cells are converted
+ * on get and set, and row by row when a whole matrix, or a segment of a
+ * row, is converted to or from T (at most float precision is stored).
+ *
+ * The cells have the layout of the matrices of the same width (see
+ * FloatMatrix2D), with elements of 2 bytes in the 16-bit formats.
+ */
+
+class CompactMatrix2D {
+private:
+  unsigned char *_storage;
+  unsigned char *_values; // cell (0, 0)
+  const StoragePrecision _precision;
+  const unsigned int _width, _height;
+  const unsigned int _stride;
+  const unsigned int _elementSize;
+
+  inline unsigned int index(const unsigned int i, const unsigned int j) const{
+    return j * _stride + i;
+  }
+public:
+  CompactMatrix2D(const unsigned int i, const unsigned int j, const StoragePrecision precision);
+  ~CompactMatrix2D();
+
+  float get(const unsigned int i, const unsigned int j) const;
+  void set(const unsigned int i, const unsigned int j, const float value);
+
+  inline unsigned int getSize(const unsigned int dim) const{
+    return (dim) ? _width : _height;
+  }
+
+  inline unsigned int getStride() const{
+    return _stride;
+  }
+
+  inline StoragePrecision getPrecision() const{
+    return _precision;
+  }
+
+  /**
+   * Bytes of storage, padding included.
+   */
+  inline unsigned int getStorageBytes() const{
+    return FloatMatrix2D::storageLengthFor(_width, _height) * _elementSize;
+  }
+
+  inline const unsigned char *getStorage() const{
+    return _storage;
+  }
+
+  inline unsigned char *getStorage(){
+    return _storage;
+  }
+
+  /**
+   * Cell (0, 0), in the layout of the matrices of the same width: the
+   * kernels sample the 16-bit cells from there (see StencilHalf).
+   */
+  inline const unsigned char *getCells() const{
+    return _values;
+  }
+
+  inline unsigned char *getCells(){
+    return _values;
+  }
+
+  void fill(float v);
+  template <typename T>
+  void compressRows(const ScalarMatrix2D<T> &m, unsigned int jBegin, unsigned int jEnd);
+  template <typename T>
+  void expandRows(ScalarMatrix2D<T> &m, unsigned int jBegin, unsigned int jEnd) const;
+  template <typename T>
+  void compressRow(unsigned int j, unsigned int first, unsigned int n, const T *src);
+  template <typename T>
+  void expandRow(unsigned int j, unsigned int first, unsigned int n, T *dst) const;
+
+  void load(const char *file);
+  void save(const char *file) const;
+
+private:
+  CompactMatrix2D(const CompactMatrix2D &);
+  CompactMatrix2D &operator= (const CompactMatrix2D &);
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include "ConjugateGradient.hpp"
+#include <cmath>
+
+#define IC_SAFETY 0.25 // floor of the pivots, relative to the diagonal
+
+/**
+ * Constructor: allocates the work vectors.
+ *
+ * @param width Width of the matrices, border included
+ * @param height Height of the matrices, border included
+ * @param stride Row stride of the matrices, the vectors share their layout
+ * @param pool Threads used by the matrix product and the dot products
+ */
+template <typename T>
+ConjugateGradient<T>::ConjugateGradient(unsigned int width, unsigned int height,
+                                        unsigned int stride, ThreadPool &pool)
+  : _N_i(width - 2), _N_j(height - 2), _W(stride), _pool(pool),
+    _obstaclesVersion(0),
+    _fluid(stride * height, 0), _b(stride * height, 0), _r(stride * height, 0),
+    _z(stride * height, 0), _s(stride * height, 0), _q(stride * height, 0),
+    _precond(stride * height, 0), _rowSums(height, 0)
+{
+}
+
+/**
+ * Solves the system with the preconditioned conjugate gradient, starting
+ * from the current content of x, until the residual norm is below
+ * tolerance times the norm of the right hand side. Only the fluid cells of
+ * x are written: the caller still has to apply the boundary conditions.
+ *
+ * @param x unknown, also used as the initial guess
+ * @param x0 right hand side
+ * @param obstacles obstacles of the fluid
+ * @param a coefficient of the neighbours
+ * @param c coefficient of the cell itself
+ * @param neumann true if the cells next to a wall or an obstacle mirror
+ * their value there, false if the current values of x there are kept
+ * @param preconditioner preconditioner used
+ * @param tolerance relative residual wanted
+ * @param maxIterations maximum number of iterations
+ */
+template <typename T>
+SolverStats ConjugateGradient<T>::solve(ScalarMatrix2D<T> &x, ScalarMatrix2D<T> &x0,
+                                        const Obstacles &obstacles,
+                                        T a, T c, bool neumann,
+                                        Preconditioner preconditioner,
+                                        float tolerance,
+                                        unsigned int maxIterations){
+  const unsigned int W = _W;
+  const unsigned char *fluid = &_fluid[0];
+  T *values = x.getArray();
+  const T *rhs = x0.getArray();
+  SolverStats stats = {0, 0};
+
+  if (obstacles.getVersion() != _obstaclesVersion)
+    buildMask(obstacles);
+
+  // right hand side, with the values kept next to the non fluid cells
+  double sum = 0;
+  unsigned int count = 0;
+  for (unsigned int j = 1; j <= _N_j; j++){
+    for (unsigned int i = 1; i <= _N_i; i++){
+      const unsigned int k = j * W + i;
+      if (!fluid[k]){
+        _b[k] = 0;
+        continue;
+      }
+      _b[k] = rhs[k];
+      if (!neumann)
+        _b[k] += a * ((1 - fluid[k-1]) * values[k-1] + (1 - fluid[k+1]) * values[k+1]
+                      + (1 - fluid[k-W]) * values[k-W] + (1 - fluid[k+W]) * values[k+W]);
+      sum += _b[k];
+      count++;
+    }
+  }
+  // pure Neumann problem: x is defined up to a constant, and only the part
+  // of the right hand side with a zero mean can be solved for
+  if (neumann && c <= 4 * a && count > 0){
+    const T mean = sum / count;
+    for (unsigned int k = 0; k < _b.size(); k++)
+      if (fluid[k])
+        _b[k] -= mean;
+  }
+
+  const double bNorm = std::sqrt(dot(&_b[0], &_b[0]));
+  if (bNorm == 0){
+    for (unsigned int k = 0; k < _b.size(); k++)
+      if (fluid[k])
+        values[k] = 0;
+    return stats;
+  }
+
+  // r = b - A.x
+  multiply(values, &_r[0], a, c, neumann);
+  for (unsigned int k = 0; k < _r.size(); k++)
+    _r[k] = _b[k] - _r[k];
+  double rNorm = std::sqrt(dot(&_r[0], &_r[0]));
+
+  buildPreconditioner(a, c, neumann, preconditioner);
+  applyPreconditioner(preconditioner);
+  _s = _z;
+  double rho = dot(&_r[0], &_z[0]);
+
+  while (stats.iterations < maxIterations && rNorm > tolerance * bNorm){
+    multiply(&_s[0], &_q[0], a, c, neumann);
+    const double sq = dot(&_s[0], &_q[0]);
+    if (sq <= 0)
+      break;
+    const T alpha = rho / sq;
+
+    _pool.parallelFor(1, _N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+        for (unsigned int k = jBegin * W; k < jEnd * W; k++){
+          if (fluid[k]){
+            values[k] += alpha * _s[k];
+            _r[k] -= alpha * _q[k];
+          }
+        }
+      });
+    rNorm = std::sqrt(dot(&_r[0], &_r[0]));
+    stats.iterations++;
+
+    applyPreconditioner(preconditioner);
+    const double rhoNew = dot(&_r[0], &_z[0]);
+    const T beta = rhoNew / rho;
+    rho = rhoNew;
+    _pool.parallelFor(1, _N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+        for (unsigned int k = jBegin * W; k < jEnd * W; k++)
+          _s[k] = _z[k] + beta * _s[k];
+      });
+  }
+  stats.residual = rNorm / bNorm;
+  return stats;
+}
+
+/**
+ * Computes the fluid cells from the obstacles. A cell without any fluid
+ * neighbour is left out: with Neumann boundaries its equation is empty.
+ */
+template <typename T>
+void ConjugateGradient<T>::buildMask(const Obstacles &obstacles){
+  const unsigned int W = _W;
+  const unsigned char *cells = obstacles.getCells();
+  for (unsigned int j = 1; j <= _N_j; j++)
+    for (unsigned int i = 1; i <= _N_i; i++)
+      _fluid[j * W + i] = (cells[j * W + i] == Obstacles::CELL_FLUID);
+
+  for (unsigned int j = 1; j <= _N_j; j++){
+    for (unsigned int i = 1; i <= _N_i; i++){
+      const unsigned int k = j * W + i;
+      if (_fluid[k] && !(_fluid[k-1] || _fluid[k+1] || _fluid[k-W] || _fluid[k+W]))
+        _fluid[k] = 0;
+    }
+  }
+  _obstaclesVersion = obstacles.getVersion();
+}
+
+/**
+ * Jacobi: stores the inverse of the diagonal.
+ * Incomplete Cholesky: stores the inverse of the diagonal of the factor L
+ * (A ~ L.L^T, with L as sparse as the lower part of A).
+ */
+template <typename T>
+void ConjugateGradient<T>::buildPreconditioner(T a, T c, bool neumann,
+                                               Preconditioner preconditioner){
+  const unsigned int W = _W;
+  const unsigned char *fluid = &_fluid[0];
+
+  _a = a;
+  for (unsigned int j = 1; j <= _N_j; j++){
+    for (unsigned int i = 1; i <= _N_i; i++){
+      const unsigned int k = j * W + i;
+      if (!fluid[k]){
+        _precond[k] = 0;
+        continue;
+      }
+      T diag = c;
+      if (neumann)
+        diag -= a * (4 - fluid[k-1] - fluid[k+1] - fluid[k-W] - fluid[k+W]);
+
+      if (preconditioner == PRECOND_JACOBI){
+        _precond[k] = 1 / diag;
+        continue;
+      }
+      // the non fluid neighbours have a zero preconditioner
+      const T left = a * _precond[k-1], down = a * _precond[k-W];
+      T e = diag - left * left - down * down;
+      if (e < IC_SAFETY * diag)
+        e = diag;
+      _precond[k] = 1 / std::sqrt(e);
+    }
+  }
+}
+
+/**
+ * Computes z, the residual r multiplied by the inverse of the
+ * preconditioner.
+ */
+template <typename T>
+void ConjugateGradient<T>::applyPreconditioner(Preconditioner preconditioner){
+  const unsigned int W = _W;
+  const T *precond = &_precond[0];
+  const T *r = &_r[0];
+  T *z = &_z[0];
+
+  if (preconditioner == PRECOND_JACOBI){
+    _pool.parallelFor(1, _N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+        for (unsigned int k = jBegin * W; k < jEnd * W; k++)
+          z[k] = r[k] * precond[k];
+      });
+    return;
+  }
+
+  // L.y = r, then L^T.z = y, in place; the off diagonal terms of L are
+  // -a times the inverse diagonal of the upper/left cell
+  const T a = _a;
+  const unsigned int first = W + 1, last = _N_j * W + _N_i;
+  for (unsigned int k = first; k <= last; k++)
+    z[k] = (r[k] + a * (precond[k-1] * z[k-1] + precond[k-W] * z[k-W]))
+      * precond[k];
+  for (unsigned int k = last; k >= first; k--)
+    z[k] = (z[k] + a * precond[k] * (z[k+1] + z[k+W])) * precond[k];
+}
+
+/**
+ * Computes out = A.in on the fluid cells (0 elsewhere), rows split between
+ * the threads.
+ */
+template <typename T>
+void ConjugateGradient<T>::multiply(const T *in, T *out,
+                                    T a, T c, bool neumann){
+  const unsigned int W = _W;
+  const unsigned char *fluid = &_fluid[0];
+
+  _pool.parallelFor(1, _N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+      for (unsigned int j = jBegin; j < jEnd; j++){
+        for (unsigned int i = 1; i <= _N_i; i++){
+          const unsigned int k = j * W + i;
+          if (!fluid[k]){
+            out[k] = 0;
+            continue;
+          }
+          const unsigned int n = fluid[k-1] + fluid[k+1] + fluid[k-W] + fluid[k+W];
+          const T diag = neumann ? c - a * (4 - n) : c;
+          out[k] = diag * in[k]
+            - a * (fluid[k-1] * in[k-1] + fluid[k+1] * in[k+1]
+                   + fluid[k-W] * in[k-W] + fluid[k+W] * in[k+W]);
+        }
+      }
+    });
+}
+
+/**
+ * Dot product over the interior cells, summed row by row so that the
+ * result does not depend on the number of threads.
+ */
+template <typename T>
+double ConjugateGradient<T>::dot(const T *u, const T *v){
+  const unsigned int W = _W;
+  _pool.parallelFor(1, _N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+      for (unsigned int j = jBegin; j < jEnd; j++){
+        double partial = 0;
+        for (unsigned int k = j * W + 1; k <= j * W + _N_i; k++)
+          partial += (double) u[k] * v[k];
+        _rowSums[j] = partial;
+      }
+    });
+
+  double total = 0;
+  for (unsigned int j = 1; j <= _N_j; j++)
+    total += _rowSums[j];
+  return total;
+}
+
+template class ConjugateGradient<float>;
+template class ConjugateGradient<double>;
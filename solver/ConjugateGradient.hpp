@@ -0,0 +1,63 @@
+#ifndef CONJUGATEGRADIENT_HPP_
+#define CONJUGATEGRADIENT_HPP_
+
+#include <vector>
+#include "FloatMatrix2D.hpp"
+#include "Obstacles.hpp"
+#include "ThreadPool.hpp"
+#include "LinearSolver.hpp"
+
+/**
+ * This class implements a preconditioned conjugate gradient solver for the
+ * systems of the diffusion and projection steps:
+ *   c.x(i,j) - a.(sum of the neighbours of x) = x0(i,j)
+ * restricted to the fluid cells. A neighbour which is not fluid (wall or
+ * obstacle) either mirrors the cell (Neumann boundary, as setBnd does for
+ * scalars) or keeps its current value, which then moves to the right hand
+ * side (the velocity boundaries are applied by the caller afterwards).
+ *
+ * The Jacobi preconditioner is split between the threads; the incomplete
+ * Cholesky one (no fill-in) is sequential but needs far fewer iterations.
+ * T is the scalar type of the matrices and of the work vectors.
+ */
+
+template <typename T>
+class ConjugateGradient {
+public:
+  enum Preconditioner {
+    PRECOND_JACOBI,
+    PRECOND_INCOMPLETE_CHOLESKY
+  };
+
+  ConjugateGradient(unsigned int width, unsigned int height, unsigned int stride,
+                    ThreadPool &pool);
+
+  SolverStats solve(ScalarMatrix2D<T> &x, ScalarMatrix2D<T> &x0,
+                    const Obstacles &obstacles, T a, T c,
+                    bool neumann, Preconditioner preconditioner,
+                    float tolerance, unsigned int maxIterations);
+
+private:
+  void buildMask(const Obstacles &obstacles);
+  void buildPreconditioner(T a, T c, bool neumann,
+                           Preconditioner preconditioner);
+  void applyPreconditioner(Preconditioner preconditioner);
+  void multiply(const T *in, T *out, T a, T c, bool neumann);
+  double dot(const T *u, const T *v);
+
+  unsigned int _N_i, _N_j, _W;
+  ThreadPool &_pool;
+  unsigned long _obstaclesVersion;
+  T _a; // coefficient of the neighbours of the current system
+
+  std::vector<unsigned char> _fluid;  // 1 for fluid cells, 0 elsewhere
+  std::vector<T> _b;                  // right hand side
+  std::vector<T> _r;                  // residual
+  std::vector<T> _z;                  // preconditioned residual
+  std::vector<T> _s;                  // search direction
+  std::vector<T> _q;                  // matrix times search direction
+  std::vector<T> _precond;            // inverse diagonal of the preconditioner
+  std::vector<double> _rowSums;       // partial dot products, one per row
+};
+
+#endif
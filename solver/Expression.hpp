@@ -0,0 +1,175 @@
+#ifndef EXPRESSION_HPP_
+#define EXPRESSION_HPP_
+
+#include <stdexcept>
+
+/**
+ * Expression templates of the element-wise arithmetic of the matrices
+ * (Matrix and ScalarMatrix2D): a + b, a - b, a * b, a / b between matrices
+ * and scalars build a tree of small nodes instead of matrices, and the
+ * assignment of the tree to a matrix evaluates it in one loop over the
+ * cells, without temporaries:
+ *
+ *   dens = dens + dt * src;   // dens[k] = dens[k] + dt * src[k]
+ *
+ * The matrices are the leaves of the tree, held by reference: they must
+ * outlive the expression, which they do when it is assigned in the
+ * statement which builds it. The cell k of an expression is the cell k of
+ * the storage of each matrix, so they must all have the same layout
+ * (sizes, and ghost layers for ScalarMatrix2D): each node checks that its
+ * operands have as many cells, and the assignment that the tree has as
+ * many as the matrix.
+ */
+
+/**
+ * Base of the nodes: E is the class of the node (curiously recurring
+ * template), which provides
+ *   T operator[](unsigned int k) const   the cell k
+ *   unsigned int length() const          the number of cells, 0 for a scalar
+ */
+template <typename T, class E>
+class Expression {
+public:
+  inline const E &self() const{
+    return static_cast<const E &>(*this);
+  }
+
+  inline T operator[](const unsigned int k) const{
+    return self()[k];
+  }
+
+  inline unsigned int length() const{
+    return self().length();
+  }
+};
+
+/**
+ * Scalar broadcast to every cell.
+ */
+template <typename T>
+class ScalarExpression : public Expression<T, ScalarExpression<T> > {
+private:
+  const T _value;
+public:
+  explicit ScalarExpression(const T value) : _value(value){
+  }
+
+  inline T operator[](const unsigned int) const{
+    return _value;
+  }
+
+  inline unsigned int length() const{
+    return 0;
+  }
+};
+
+/**
+ * Leaves are held by reference (matrices), the other nodes by value (they
+ * are temporaries of the statement).
+ */
+template <class E>
+struct ExpressionOperand {
+  typedef const E &Type;
+};
+
+template <typename T>
+struct ExpressionOperand<ScalarExpression<T> > {
+  typedef const ScalarExpression<T> Type;
+};
+
+template <typename T, class A, class B, class Op>
+class BinaryExpression;
+
+template <typename T, class A, class B, class Op>
+struct ExpressionOperand<BinaryExpression<T, A, B, Op> > {
+  typedef const BinaryExpression<T, A, B, Op> Type;
+};
+
+/**
+ * Element-wise operations of the binary nodes.
+ */
+struct ExpressionAdd {
+  template <typename T>
+  static inline T apply(const T a, const T b){ return a + b; }
+};
+
+struct ExpressionSub {
+  template <typename T>
+  static inline T apply(const T a, const T b){ return a - b; }
+};
+
+struct ExpressionMul {
+  template <typename T>
+  static inline T apply(const T a, const T b){ return a * b; }
+};
+
+struct ExpressionDiv {
+  template <typename T>
+  static inline T apply(const T a, const T b){ return a / b; }
+};
+
+template <typename T, class A, class B, class Op>
+class BinaryExpression : public Expression<T, BinaryExpression<T, A, B, Op> > {
+private:
+  typename ExpressionOperand<A>::Type _a;
+  typename ExpressionOperand<B>::Type _b;
+public:
+  /**
+   * Throws std::invalid_argument when a and b both have cells, but not as
+   * many: the length of the node is then the one of either of them.
+   */
+  BinaryExpression(const A &a, const B &b) : _a(a), _b(b){
+    if (_a.length() != 0 && _b.length() != 0 && _a.length() != _b.length())
+      throw(std::invalid_argument("Expression: the operands do not have the same number of cells"));
+  }
+
+  inline T operator[](const unsigned int k) const{
+    return Op::apply(_a[k], _b[k]);
+  }
+
+  inline unsigned int length() const{
+    return _a.length() ? _a.length() : _b.length();
+  }
+};
+
+/**
+ * Scalar type of the scalar operands, not deduced from them: dt * m builds
+ * a float expression from a float matrix whatever the type of dt.
+ */
+template <typename T>
+struct ExpressionScalar {
+  typedef T Type;
+};
+
+/*
+ * The operands are taken as their base Expression<T, E> and cast back to
+ * E, so that a node holds its operands with their own class.
+ */
+
+#define EXPRESSION_OPERATOR(op, Op)                                                   \
+  template <typename T, class A, class B>                                             \
+  inline BinaryExpression<T, A, B, Op>                                                \
+  operator op (const Expression<T, A> &a, const Expression<T, B> &b){                 \
+    return BinaryExpression<T, A, B, Op>(a.self(), b.self());                         \
+  }                                                                                   \
+  template <typename T, class A>                                                      \
+  inline BinaryExpression<T, A, ScalarExpression<T>, Op>                              \
+  operator op (const Expression<T, A> &a, const typename ExpressionScalar<T>::Type b){ \
+    return BinaryExpression<T, A, ScalarExpression<T>, Op>(a.self(),                  \
+                                                           ScalarExpression<T>(b));   \
+  }                                                                                   \
+  template <typename T, class B>                                                      \
+  inline BinaryExpression<T, ScalarExpression<T>, B, Op>                              \
+  operator op (const typename ExpressionScalar<T>::Type a, const Expression<T, B> &b){ \
+    return BinaryExpression<T, ScalarExpression<T>, B, Op>(ScalarExpression<T>(a),    \
+                                                           b.self());                 \
+  }
+
+EXPRESSION_OPERATOR(+, ExpressionAdd)
+EXPRESSION_OPERATOR(-, ExpressionSub)
+EXPRESSION_OPERATOR(*, ExpressionMul)
+EXPRESSION_OPERATOR(/, ExpressionDiv)
+
+#undef EXPRESSION_OPERATOR
+
+#endif
@@ -0,0 +1,106 @@
+#include "FieldArena.hpp"
+#include <cstring>
+#include <stdint.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#define HUGE_PAGE_BYTES 2097152 // x86-64 huge page
+
+/**
+ * Constructor: allocates the zeroed fields.
+ *
+ * @param nbFields Number of matrices
+ * @param width Width of the matrices, border included
+ * @param height Height of the matrices, border included
+ * @param ghost Number of ghost layers of the matrices
+ */
+template <typename T>
+FieldArena<T>::FieldArena(unsigned int nbFields, unsigned int width, unsigned int height,
+                          unsigned int ghost)
+  : _block(NULL), _mapping(NULL), _mappedBytes(0), _hugePages(false)
+{
+  // a multiple of a cache line: every field starts aligned like the first
+  _fieldLength = FloatMatrix2D::storageLengthFor(width, height, ghost);
+  const size_t bytes = _fieldLength * nbFields * sizeof(T);
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (bytes >= HUGE_PAGE_BYTES){
+    // one huge page more, to start the block on a huge page
+    const size_t mapped = bytes + HUGE_PAGE_BYTES;
+    void *area = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area != MAP_FAILED){
+      _mapping = area;
+      _mappedBytes = mapped;
+      _block = (T *) (((uintptr_t) area + HUGE_PAGE_BYTES - 1)
+                      / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES);
+      _hugePages = (madvise(_block, bytes, MADV_HUGEPAGE) == 0);
+    }
+  }
+#endif
+  if (_block == NULL)
+    _block = alignedNew<T>(_fieldLength * nbFields);
+
+  for (unsigned int k = 0; k < nbFields; k++)
+    _fields.push_back(new ScalarMatrix2D<T>(width, height, ghost, _block + k * _fieldLength));
+}
+
+template <typename T>
+FieldArena<T>::~FieldArena(){
+  for (unsigned int k = 0; k < _fields.size(); k++)
+    delete _fields[k];
+#ifdef __linux__
+  if (_mapping != NULL){
+    munmap(_mapping, _mappedBytes);
+    return;
+  }
+#endif
+  alignedDelete(_block);
+}
+
+/**
+ * Sets every cell of the fields first..first+count-1, padding included.
+ */
+template <typename T>
+void FieldArena<T>::fill(unsigned int first, unsigned int count, T v){
+  T *begin = _block + first * _fieldLength;
+  const size_t length = count * _fieldLength;
+  if (v == 0){
+    memset(begin, 0, length * sizeof(T));
+    return;
+  }
+  for (size_t k = 0; k < length; k++)
+    begin[k] = v;
+}
+
+/**
+ * Copies the fields from..from+count-1 onto the fields to..to+count-1
+ * (the ranges must not overlap).
+ */
+template <typename T>
+void FieldArena<T>::copy(unsigned int from, unsigned int to, unsigned int count){
+  memcpy(_block + to * _fieldLength, _block + from * _fieldLength,
+         count * _fieldLength * sizeof(T));
+}
+
+/**
+ * Copies the fields first..first+count-1 to buffer, which must hold
+ * count * getFieldLength() cells.
+ */
+template <typename T>
+void FieldArena<T>::save(unsigned int first, unsigned int count, T *buffer) const{
+  memcpy(buffer, _block + first * _fieldLength, count * _fieldLength * sizeof(T));
+}
+
+/**
+ * Copies back into the fields first..first+count-1 the count *
+ * getFieldLength() cells of a buffer filled by save with the same fields.
+ */
+template <typename T>
+void FieldArena<T>::restore(unsigned int first, unsigned int count, const T *buffer){
+  memcpy(_block + first * _fieldLength, buffer, count * _fieldLength * sizeof(T));
+}
+
+template class FieldArena<float>;
+template class FieldArena<double>;
@@ -0,0 +1,64 @@
+#ifndef FIELDARENA_HPP_
+#define FIELDARENA_HPP_
+
+#include <vector>
+#include <cstddef>
+#include "FloatMatrix2D.hpp"
+
+/**
+ * This class owns a set of matrices of the same size carved one after the
+ * other from a single block of memory, in the order of their indices.
+ *
+ * The fields a pass streams together are then neighbours in memory, which
+ * the hardware prefetchers follow, and a range of consecutive fields can
+ * be reset, saved or restored with a single pass over one buffer. On Linux
+ * a block of several huge pages is aligned on them and the kernel is asked
+ * to back it with huge pages, which saves TLB misses on large grids.
+ *
+ * T is the scalar type of the matrices (float or double).
+ */
+
+template <typename T>
+class FieldArena {
+public:
+  FieldArena(unsigned int nbFields, unsigned int width, unsigned int height,
+             unsigned int ghost = 0);
+  ~FieldArena();
+
+  inline ScalarMatrix2D<T> *getField(unsigned int k) const{
+    return _fields[k];
+  }
+
+  inline unsigned int getNbFields() const{
+    return _fields.size();
+  }
+
+  /**
+   * Cells of storage of each field, padding included.
+   */
+  inline size_t getFieldLength() const{
+    return _fieldLength;
+  }
+
+  inline bool usesHugePages() const{
+    return _hugePages;
+  }
+
+  void fill(unsigned int first, unsigned int count, T v);
+  void copy(unsigned int from, unsigned int to, unsigned int count);
+  void save(unsigned int first, unsigned int count, T *buffer) const;
+  void restore(unsigned int first, unsigned int count, const T *buffer);
+
+private:
+  FieldArena(const FieldArena &);
+  FieldArena &operator= (const FieldArena &);
+
+  T *_block;
+  size_t _fieldLength;
+  void *_mapping;      // NULL unless the block was mapped for huge pages
+  size_t _mappedBytes;
+  bool _hugePages;
+  std::vector<ScalarMatrix2D<T> *> _fields;
+};
+
+#endif
@@ -1,53 +1,78 @@
 #include "FloatMatrix2D.hpp"
-
-
-FloatMatrix2D::FloatMatrix2D(const unsigned int i, const unsigned int j) : 
-_width(i), _height(j), _length(i*j)
+#include <vector>
+#include <algorithm>
+
+
+/**
+ * Constructor: allocates a zeroed matrix of i columns and j rows, border
+ * included.
+ *
+ * @param ghost Number of ghost layers kept beyond the border
+ */
+template <typename T>
+ScalarMatrix2D<T>::ScalarMatrix2D(const unsigned int i, const unsigned int j, const unsigned int ghost) :
+_width(i), _height(j), _length(i*j), _ghost(ghost), _stride(strideFor(i, ghost)),
+_storageLength(storageLengthFor(i, j, ghost)), _ownsStorage(true)
 {
-  _values = new float[_length];
-  this->fill(0);
+  _storage = alignedNew<T>(_storageLength);
+  _values = _storage + _ghost * _stride + paddingFor(_ghost);
 }
 
-FloatMatrix2D::FloatMatrix2D(const FloatMatrix2D &m) : 
-_width(m._width), _height(m._height), _length(m._length)
+/**
+ * Constructor: builds a matrix over storage owned by the caller (see
+ * FieldArena), which must hold storageLengthFor(i, j, ghost) cells,
+ * start at a multiple of MEMORY_ALIGN and outlive the matrix. The content
+ * is left as it is.
+ */
+template <typename T>
+ScalarMatrix2D<T>::ScalarMatrix2D(const unsigned int i, const unsigned int j, const unsigned int ghost,
+                                  T *storage) :
+_storage(storage), _width(i), _height(j), _length(i*j), _ghost(ghost), _stride(strideFor(i, ghost)),
+_storageLength(storageLengthFor(i, j, ghost)), _ownsStorage(false)
 {
-  std::cerr << "copy\n" << std::endl;
-  _values = new float[_length];
-  for (unsigned int k = 0; k < _length; k++)
-    _values[k] = m._values[k];
+  _values = _storage + _ghost * _stride + paddingFor(_ghost);
 }
 
-
-FloatMatrix2D::~FloatMatrix2D(){
-  delete[] _values;
+template <typename T>
+ScalarMatrix2D<T>::ScalarMatrix2D(const ScalarMatrix2D &m) : 
+_width(m._width), _height(m._height), _length(m._length), _ghost(m._ghost),
+_stride(m._stride), _storageLength(m._storageLength), _ownsStorage(true)
+{
+  _storage = alignedNew<T>(_storageLength);
+  _values = _storage + (m._values - m._storage);
+  for (unsigned int k = 0; k < _storageLength; k++)
+    _storage[k] = m._storage[k];
 }
 
-void FloatMatrix2D::fill(float v){
-  for (unsigned int k=0; k < _length; k++)
-    _values[k]=v;
-}
 
-void FloatMatrix2D::add(float v){
-  for (unsigned int k = 0; k < _length; k++)
-    _values[k] += v;
+template <typename T>
+ScalarMatrix2D<T>::~ScalarMatrix2D(){
+  if (_ownsStorage)
+    alignedDelete(_storage);
 }
 
-void FloatMatrix2D::add(const FloatMatrix2D &m){
-  for (unsigned int k = 0; k < _length; k++)
-    _values[k] += m._values[k];
+/**
+ * Fills the whole storage, padding included, with v.
+ */
+template <typename T>
+void ScalarMatrix2D<T>::fill(T v){
+  for (unsigned int k=0; k < _storageLength; k++)
+    _storage[k]=v;
 }
 
-void FloatMatrix2D::multiplyBy(float v){
-  for (unsigned int k = 0; k < _length; k++)
-    _values[k] *= v;
+/**
+ * Copies the values of m, which must have the same layout (the storage
+ * stays where it is).
+ */
+template <typename T>
+ScalarMatrix2D<T> &ScalarMatrix2D<T>::operator=(const ScalarMatrix2D &m){
+  if (this != &m)
+    *this = static_cast<const Expression<T, ScalarMatrix2D> &>(m);
+  return *this;
 }
 
-void FloatMatrix2D::addAndMultiply(const FloatMatrix2D &add, float v){
-  for (unsigned int k = 0; k < _length; k++)
-    _values[k] += add._values[k] * v;
-}
-
-std::ostream &operator<< (std::ostream &stream, const FloatMatrix2D &toPrint){
+template <typename T>
+std::ostream &operator<< (std::ostream &stream, const ScalarMatrix2D<T> &toPrint){
   for(unsigned int i = 0; i < toPrint.getSize(0); i++){
     for(unsigned int j = 0; j < toPrint.getSize(1); j++)
       stream << std::fixed << std::setprecision(4) << toPrint.get(i,j) << "c";
@@ -57,8 +82,12 @@ std::ostream &operator<< (std::ostream &stream, const FloatMatrix2D &toPrint){
   return stream;
 }
 
+/*
+ * The files hold floats whatever the scalar type, without padding.
+ */
 
-void FloatMatrix2D::load(const char *file){
+template <typename T>
+void ScalarMatrix2D<T>::load(const char *file){
   std::ifstream input;
   input.open(file, std::ios::in | std::ios::binary);
 
@@ -72,12 +101,16 @@ void FloatMatrix2D::load(const char *file){
     return;
   }
 
-  input.read((char *) _values, sizeof(float) * _length);
+  std::vector<float> row(_width);
+  for (unsigned int j = 0; j < _height; j++){
+    input.read((char *) &row[0], sizeof(float) * _width);
+    std::copy(row.begin(), row.end(), _values + j * _stride);
+  }
   input.close();
 }
 
-
-void FloatMatrix2D::save(const char *file) const{
+template <typename T>
+void ScalarMatrix2D<T>::save(const char *file) const{
   std::ofstream output;
   output.open(file, std::ios::out | std::ios::binary);
 
@@ -86,7 +119,16 @@ void FloatMatrix2D::save(const char *file) const{
   output.write((char *) &n, sizeof(unsigned int));
   output.write((char *) &l, sizeof(unsigned int));
 
-  output.write((char *) _values, sizeof(float) * _length);
+  std::vector<float> row(_width);
+  for (unsigned int j = 0; j < _height; j++){
+    std::copy(_values + j * _stride, _values + j * _stride + _width, row.begin());
+    output.write((char *) &row[0], sizeof(float) * _width);
+  }
 
   output.close();
 }
+
+template class ScalarMatrix2D<float>;
+template class ScalarMatrix2D<double>;
+template std::ostream &operator<< (std::ostream &, const ScalarMatrix2D<float> &);
+template std::ostream &operator<< (std::ostream &, const ScalarMatrix2D<double> &);
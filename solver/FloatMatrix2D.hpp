@@ -4,31 +4,119 @@
 #include <iostream>
 #include <fstream>
 #include <iomanip> // setprecision
+#include <stdexcept>
+#include "Aligned.hpp"
+#include "Expression.hpp"
+
+// cells of a cache line for floats, the row alignment of every scalar type
+#define MATRIX_ROW_ALIGN (MEMORY_ALIGN / sizeof(float))
+
+/**
+ * Interior cells of a matrix, its border excluded: row(j) points to the
+ * first interior cell of the j-th interior row (j from 0), which starts a
+ * cache line.
+ */
+template <typename T>
+struct ScalarMatrixView {
+  T *values;            // first interior cell
+  unsigned int width;   // interior cells of a row
+  unsigned int height;  // interior rows
+  unsigned int stride;  // cells from one row to the next
+
+  inline T *row(const unsigned int j) const{
+    return values + j * stride;
+  }
+  inline T &operator()(const unsigned int i, const unsigned int j) const{
+    return values[j * stride + i];
+  }
+};
 
 /**
- * This class implements 2D matrices of floats
+ * This class implements 2D matrices of scalars, floats or doubles (see the
+ * typedefs below), with explicit instantiations for both.
+ *
+ * The rows are stored stride cells apart, with stride a multiple of a cache
+ * line, and the storage is aligned so that the first interior cell of every
+ * row (i = 1) starts a cache line: a vector kernel running over the interior
+ * cells of a row never splits a load over two lines. The cells between the
+ * rows are padding, which get and set never reach but which the row kernels
+ * may read past the ends of a row (see Stencil).
  *
+ * Beyond the border of the grid (i or j = 0 and size - 1, set by the
+ * boundary conditions) a matrix can keep ghost layers: that many more rows
+ * and columns on each side, for stencils wider than one cell. They are
+ * reached with get and set at negative indices or past the size, wrapped
+ * to unsigned.
+ *
+ * The layout, in cells, does not depend on the scalar type: the arrays
+ * indexed like the matrices (see Obstacles) serve both, and the rows of
+ * doubles start a cache line as well.
+ *
+ * The element-wise arithmetic goes through expression templates (see
+ * Expression), over the whole storage, padding included, in one
+ * branch-free loop: the matrices of an expression must share the same size
+ * and ghost width.
  */
 
-class FloatMatrix2D {
+template <typename T>
+class ScalarMatrix2D : public Expression<T, ScalarMatrix2D<T> > {
 private:
-  float *_values;
+  T *_storage; // aligned block, padding and ghost layers included
+  T *_values;  // cell (0, 0)
   const unsigned int _width, _height;
   const unsigned int _length;
+  const unsigned int _ghost;
+  const unsigned int _stride;
+  const unsigned int _storageLength;
+  const bool _ownsStorage;
 public:
-  FloatMatrix2D(const unsigned int i, const unsigned int j);
-  FloatMatrix2D(const FloatMatrix2D &m);
-  ~FloatMatrix2D();
+  ScalarMatrix2D(const unsigned int i, const unsigned int j, const unsigned int ghost = 0);
+  ScalarMatrix2D(const unsigned int i, const unsigned int j, const unsigned int ghost, T *storage);
+  ScalarMatrix2D(const ScalarMatrix2D &m);
+  ~ScalarMatrix2D();
+
+  /**
+   * Cells stored before the cell i = 0 of a row, so that the cell i = 1
+   * starts a cache line; at least ghost.
+   */
+  static inline unsigned int paddingFor(const unsigned int ghost = 0){
+    return (ghost / MATRIX_ROW_ALIGN + 1) * MATRIX_ROW_ALIGN - 1;
+  }
+
+  /**
+   * Row stride of the matrices of the given width: any array sharing it
+   * (see Obstacles) can be indexed like their cells.
+   */
+  static inline unsigned int strideFor(const unsigned int width, const unsigned int ghost = 0){
+    const unsigned int cells = paddingFor(ghost) + width + ghost;
+    return (cells + MATRIX_ROW_ALIGN - 1) / MATRIX_ROW_ALIGN * MATRIX_ROW_ALIGN;
+  }
+
+  /**
+   * Number of cells of the storage of a matrix, see the constructor taking
+   * the storage.
+   */
+  static inline unsigned int storageLengthFor(const unsigned int width, const unsigned int height,
+                                              const unsigned int ghost = 0){
+    return strideFor(width, ghost) * (height + 2 * ghost);
+  }
+
+  inline T get(const unsigned int i, const unsigned int j) const{
+    return _values[(int) j * (int) _stride + (int) i];
+  }
 
-  inline float get(const unsigned int i, const unsigned int j) const{
-    return _values[j * _width + i];
+  inline void set(const unsigned int i, const unsigned int j, const T value){
+    _values[(int) j * (int) _stride + (int) i] = value;
   }
 
-  inline void set(const unsigned int i, const unsigned int j, const float value){
-    _values[j * _width + i] = value;
+  /**
+   * Returns the cell (0, 0): the cell (i, j) is at j * getStride() + i.
+   */
+  inline T *getArray(){
+    return _values;
   }
 
-  inline float *getArray(){
+  inline const T *getArray() const{
     return _values;
   }
 
@@ -40,19 +128,102 @@ public:
     return _length; 
   }
 
-  void fill(float v);
+  inline unsigned int getStride() const{
+    return _stride;
+  }
+
+  inline unsigned int getGhost() const{
+    return _ghost;
+  }
 
-  
-  void add(float v);
-  void add(const FloatMatrix2D &m);
-  inline void multiplyBy(float v);
-  void addAndMultiply(const FloatMatrix2D &add, float v);
+  inline ScalarMatrixView<T> getInterior(){
+    ScalarMatrixView<T> view = {_values + _stride + 1, _width - 2, _height - 2, _stride};
+    return view;
+  }
+
+  void fill(T v);
+
+  /**
+   * Cell k of the storage (not of the grid), the leaf of the expressions.
+   */
+  inline T &operator[](const unsigned int k){
+    return _storage[k];
+  }
+
+  inline T operator[](const unsigned int k) const{
+    return _storage[k];
+  }
+
+  /**
+   * Number of cells of the storage, see storageLengthFor.
+   */
+  inline unsigned int length() const{
+    return _storageLength;
+  }
+
+  ScalarMatrix2D &operator=(const ScalarMatrix2D &m);
+
+  template <class E>
+  inline ScalarMatrix2D &operator=(const Expression<T, E> &e){
+    const E &expression = checkLength(e);
+    for (unsigned int k = 0; k < _storageLength; k++)
+      _storage[k] = expression[k];
+    return *this;
+  }
+
+  template <class E>
+  inline ScalarMatrix2D &operator+=(const Expression<T, E> &e){
+    const E &expression = checkLength(e);
+    for (unsigned int k = 0; k < _storageLength; k++)
+      _storage[k] += expression[k];
+    return *this;
+  }
+
+  template <class E>
+  inline ScalarMatrix2D &operator-=(const Expression<T, E> &e){
+    const E &expression = checkLength(e);
+    for (unsigned int k = 0; k < _storageLength; k++)
+      _storage[k] -= expression[k];
+    return *this;
+  }
+
+  template <class E>
+  inline ScalarMatrix2D &operator*=(const Expression<T, E> &e){
+    const E &expression = checkLength(e);
+    for (unsigned int k = 0; k < _storageLength; k++)
+      _storage[k] *= expression[k];
+    return *this;
+  }
+
+  inline ScalarMatrix2D &operator+=(const T v){
+    return *this += ScalarExpression<T>(v);
+  }
+
+  inline ScalarMatrix2D &operator*=(const T v){
+    return *this *= ScalarExpression<T>(v);
+  }
 
   void load(const char *file);
   void save(const char *file) const;
 
+private:
+  /**
+   * Returns the node of e, after checking that it covers the storage of
+   * the matrix (or is a scalar): throws std::invalid_argument otherwise.
+   */
+  template <class E>
+  inline const E &checkLength(const Expression<T, E> &e) const{
+    if (e.length() != 0 && e.length() != _storageLength)
+      throw(std::invalid_argument("ScalarMatrix2D: the matrices of the expression do not have the same layout"));
+    return e.self();
+  }
 };
 
-std::ostream &operator<< (std::ostream &stream, const FloatMatrix2D &toPrint);
+template <typename T>
+std::ostream &operator<< (std::ostream &stream, const ScalarMatrix2D<T> &toPrint);
+
+typedef ScalarMatrix2D<float> FloatMatrix2D;
+typedef ScalarMatrix2D<double> DoubleMatrix2D;
+typedef ScalarMatrixView<float> FloatMatrixView;
 
 #endif
@@ -1,56 +1,293 @@
 #include "FluidSolver2D.hpp"
+#include "Stencil.hpp"
+#include "Tiling.hpp"
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
 
 
-#define SWAP(x0,x) {FloatMatrix2D *tmp = x0; x0 = x; x = tmp;} // Uses pointers
+#define SWAP(x0,x) {Matrix *tmp = x0; x0 = x; x = tmp;} // Uses pointers
+
+#define MULTIGRID_MAX_CYCLES 20
+#define PCG_MAX_ITERATIONS 200
+#define MAX_SUBSTEPS 16
 
 /** Constructor
  */
-FluidSolver::FluidSolver(unsigned int i, unsigned int j, Config &config){
-  _u         = new FloatMatrix2D (i, j);
-  _v         = new FloatMatrix2D (i, j);
-  _u_prev    = new FloatMatrix2D (i, j);
-  _v_prev    = new FloatMatrix2D (i, j);
-  _dens      = new FloatMatrix2D (i, j);
-  _dens_prev = new FloatMatrix2D (i, j);
-  _dens_src  = new FloatMatrix2D (i, j);
-  _u_vel_src = new FloatMatrix2D (i, j);
-  _v_vel_src = new FloatMatrix2D (i, j);
+template <typename T>
+FluidSolver2D<T>::FluidSolver2D(unsigned int i, unsigned int j, Config &config){
+  allocateFields(i, j, config.getStoragePrecision(), config.getDensityScale());
   _obstacles = new Obstacles(i,j,config);
+  _pool      = new ThreadPool(config.getThreads());
+  _pressureSolver  = config.getPressureSolver();
+  _diffusionSolver = config.getDiffusionSolver();
+  _tolerance = config.getTolerance();
+  _minIterations = config.getMinIterations();
+  _maxIterations = config.getMaxIterations();
+  _warmStart = config.getWarmStart();
+  _cfl = config.getCfl();
+  _advection = config.getAdvection();
+  _activityThreshold = config.getActivityThreshold();
+  _advectionReach = 1;
+  _substeps = 0;
+  _multigrid = NULL;
+  _conjugateGradient = NULL;
+  _densityConjugateGradient = NULL;
+  _u_forward = _v_forward = NULL;
+  _dens_diffused = _dens_sum = NULL;
+  _pressureStats.iterations = _diffusionStats.iterations = 0;
+  _pressureStats.residual = _diffusionStats.residual = -1;
 }
 
-FluidSolver::FluidSolver(unsigned int i, unsigned int j){
-  _u         = new FloatMatrix2D (i, j);
-  _v         = new FloatMatrix2D (i, j);
-  _u_prev    = new FloatMatrix2D (i, j);
-  _v_prev    = new FloatMatrix2D (i, j);
-  _dens      = new FloatMatrix2D (i, j);
-  _dens_prev = new FloatMatrix2D (i, j);
-  _dens_src  = new FloatMatrix2D (i, j);
-  _u_vel_src = new FloatMatrix2D (i, j);
-  _v_vel_src = new FloatMatrix2D (i, j);
-  _obstacles = new Obstacles();
+template <typename T>
+FluidSolver2D<T>::FluidSolver2D(unsigned int i, unsigned int j){
+  allocateFields(i, j, DEF_STORAGE_PRECISION, 1);
+  _obstacles = new Obstacles(i, j);
+  _pool      = new ThreadPool(1);
+  _pressureSolver  = SOLVER_GAUSS_SEIDEL;
+  _diffusionSolver = SOLVER_GAUSS_SEIDEL;
+  _tolerance = DEF_TOLERANCE;
+  _minIterations = DEF_MIN_ITERATIONS;
+  _maxIterations = DEF_MAX_ITERATIONS;
+  _warmStart = DEF_WARM_START;
+  _cfl = DEF_CFL;
+  _advection = DEF_ADVECTION;
+  _activityThreshold = DEF_ACTIVITY_THRESHOLD;
+  _advectionReach = 1;
+  _substeps = 0;
+  _multigrid = NULL;
+  _conjugateGradient = NULL;
+  _densityConjugateGradient = NULL;
+  _u_forward = _v_forward = NULL;
+  _dens_diffused = _dens_sum = NULL;
+  _pressureStats.iterations = _diffusionStats.iterations = 0;
+  _pressureStats.residual = _diffusionStats.residual = -1;
 }
 
+/**
+ * Allocates the matrices of the velocity grid of i x j cells from a single
+ * arena, in the order of Field, the density from another one on the
+ * density grid (see allocateScalars), and the density source in the given
+ * precision.
+ */
+template <typename T>
+void FluidSolver2D<T>::allocateFields(unsigned int i, unsigned int j, StoragePrecision precision,
+                                      unsigned int densityScale){
+  const unsigned int densityWidth  = (i - 2) * densityScale + 2;
+  const unsigned int densityHeight = (j - 2) * densityScale + 2;
+  _densityScale = densityScale;
+  _densityObstacles = NULL;
+  _densityObstaclesVersion = 0;
+
+  _fields = new FieldArena<T>(NB_FIELDS, i, j);
+  allocateScalars(densityWidth, densityHeight, 1, precision);
+  _u         = _fields->getField(FIELD_U);
+  _v         = _fields->getField(FIELD_V);
+  _u_prev    = _fields->getField(FIELD_U_PREV);
+  _v_prev    = _fields->getField(FIELD_V_PREV);
+  _dens_src  = new CompactMatrix2D(densityWidth, densityHeight, precision);
+  _u_vel_src = _fields->getField(FIELD_U_VEL_SRC);
+  _v_vel_src = _fields->getField(FIELD_V_VEL_SRC);
+  _pressure  = _fields->getField(FIELD_PRESSURE);
+  _pressure_diff = _fields->getField(FIELD_PRESSURE_DIFF);
+  _activeTiles = new ActiveTiles(i - 2, j - 2);
+
+  // the cell c of the density grid is at (c - 1/2) / densityScale + 1/2 in
+  // the velocity one
+  _upsampleColumns.resize(densityWidth);
+  _upsampleWeights.resize(densityWidth);
+  for (unsigned int c = 0; c < densityWidth; c++){
+    const double x = (c - 0.5) / densityScale + 0.5;
+    _upsampleColumns[c] = (unsigned int) x;
+    _upsampleWeights[c] = x - _upsampleColumns[c];
+  }
+}
 
-FluidSolver::~FluidSolver(){
-  delete _u;
-  delete _v;
-  delete _u_prev;
-  delete _v_prev;
-  delete _dens;
-  delete _dens_prev;
+/**
+ * Allocates the arena of nbChannels scalar channels of width x height
+ * cells, with their previous-step fields and the sources of the channels
+ * after the density, in the order given with Field. In a 16-bit storage
+ * precision, the arena only holds the sources, and the channels are
+ * CompactMatrix2D of that precision.
+ */
+template <typename T>
+void FluidSolver2D<T>::allocateScalars(unsigned int width, unsigned int height,
+                                       unsigned int nbChannels, StoragePrecision precision){
+  _nbScalarChannels = nbChannels;
+  _compactScalars.clear();
+  _compactScalarsPrev.clear();
+  if (precision == STORAGE_FLOAT){
+    _densityFields = new FieldArena<T>(3 * nbChannels - 1, width, height);
+    _scalars = new ScalarChannels2D<T>(*_densityFields, 0, nbChannels);
+    _scalars_prev = new ScalarChannels2D<T>(*_densityFields, nbChannels, nbChannels);
+    _dens      = _scalars->getChannel(0);
+    _dens_prev = _scalars_prev->getChannel(0);
+    _compactDens = _compactDensPrev = NULL;
+    return;
+  }
+  _densityFields = new FieldArena<T>(nbChannels - 1, width, height);
+  _scalars = _scalars_prev = NULL;
+  _dens = _dens_prev = NULL;
+  for (unsigned int c = 0; c < nbChannels; c++){
+    _compactScalars.push_back(new CompactMatrix2D(width, height, precision));
+    _compactScalarsPrev.push_back(new CompactMatrix2D(width, height, precision));
+  }
+  _compactDens     = _compactScalars[0];
+  _compactDensPrev = _compactScalarsPrev[0];
+}
+
+/**
+ * Allocates the scalar channels again for nbChannels channels stored in
+ * the given precision. The first kept channels, current and previous-step,
+ * and their sources are carried over, converted if need be; the others
+ * start empty.
+ */
+template <typename T>
+void FluidSolver2D<T>::reallocateScalars(unsigned int nbChannels, StoragePrecision precision,
+                                         unsigned int kept){
+  FieldArena<T> *fields = _densityFields;
+  ScalarChannels2D<T> *scalars[2] = {_scalars, _scalars_prev};
+  std::vector<CompactMatrix2D *> compact[2] = {_compactScalars, _compactScalarsPrev};
+  const unsigned int sources = compactScalars() ? 0 : 2 * getNbScalarChannels();
+  const unsigned int width = _dens_src->getSize(1), height = _dens_src->getSize(0);
+  kept = std::min(kept, std::min(nbChannels, getNbScalarChannels()));
+
+  allocateScalars(width, height, nbChannels, precision);
+  Matrix *widened = NULL; // between two 16-bit precisions
+  for (unsigned int c = 0; c < kept; c++)
+    for (unsigned int k = 0; k < 2; k++){
+      CompactMatrix2D *from = compact[k].empty() ? NULL : compact[k][c];
+      CompactMatrix2D *to = !compactScalars() ? NULL
+                            : (k == 0 ? _compactScalars : _compactScalarsPrev)[c];
+      Matrix *fromMatrix = from == NULL ? scalars[k]->getChannel(c) : NULL;
+      Matrix *toMatrix = to == NULL ? (k == 0 ? _scalars : _scalars_prev)->getChannel(c) : NULL;
+      if (from == NULL && to == NULL)
+        *toMatrix = *fromMatrix;
+      else if (to == NULL)
+        from->expandRows(*toMatrix, 0, height);
+      else if (from == NULL)
+        to->compressRows(*fromMatrix, 0, height);
+      else if (from->getPrecision() == to->getPrecision())
+        memcpy(to->getStorage(), from->getStorage(), from->getStorageBytes());
+      else {
+        if (widened == NULL)
+          widened = new Matrix(width, height);
+        from->expandRows(*widened, 0, height);
+        to->compressRows(*widened, 0, height);
+      }
+    }
+  for (unsigned int c = 1; c < kept; c++)
+    *getScalarSource(c) = *fields->getField(sources + c - 1);
+
+  delete widened;
+  for (unsigned int k = 0; k < 2; k++){
+    delete scalars[k];
+    for (unsigned int c = 0; c < compact[k].size(); c++)
+      delete compact[k][c];
+  }
+  delete fields;
+}
+
+template <typename T>
+FluidSolver2D<T>::~FluidSolver2D(){
+  delete _fields;
+  delete _scalars;
+  delete _scalars_prev;
+  for (unsigned int c = 0; c < _compactScalars.size(); c++){
+    delete _compactScalars[c];
+    delete _compactScalarsPrev[c];
+  }
+  delete _densityFields;
   delete _dens_src;
+  delete _activeTiles;
   delete _obstacles;
+  delete _densityObstacles;
+  delete _multigrid;
+  delete _conjugateGradient;
+  delete _densityConjugateGradient;
+  for (unsigned int f = 0; f < _dens_forward.size(); f++)
+    delete _dens_forward[f];
+  delete _u_forward;
+  delete _v_forward;
+  delete _dens_diffused;
+  delete _dens_sum;
+  delete _pool;
+}
+
+/**
+ * Returns the obstacles of the density grid, refined again from the ones of
+ * the velocity grid each time those change.
+ */
+template <typename T>
+Obstacles &FluidSolver2D<T>::getDensityObstacles(){
+  if (_densityScale == 1)
+    return *_obstacles;
+  if (_densityObstacles == NULL || _densityObstaclesVersion != _obstacles->getVersion()){
+    delete _densityObstacles;
+    _densityObstacles = new Obstacles(*_obstacles, _densityScale);
+    _densityObstaclesVersion = _obstacles->getVersion();
+  }
+  return *_densityObstacles;
+}
+
+/**
+ * Returns the obstacles of the grid of x: the velocity grid or the density
+ * one.
+ */
+template <typename T>
+Obstacles &FluidSolver2D<T>::obstaclesFor(const Matrix &x){
+  return x.getSize(1) == _u->getSize(1) ? *_obstacles : getDensityObstacles();
 }
 
 /**
- * Update density matrix from a given source matrix.
+ * Update density matrix from a given source matrix, on the interior cells
+ * of the tiles near activity (see setActivityThreshold). When every tile
+ * is swept, the sum is a single expression over the whole storage: the
+ * borders it also updates are set by the boundary conditions before they
+ * are read.
  * @param x density matrix
  * @param s source matrix
  * @param dt time interval
  */
-void FluidSolver::addSource ( FloatMatrix2D &x, FloatMatrix2D &s, float dt ){
-  x.addAndMultiply(s, dt);
+template <typename T>
+void FluidSolver2D<T>::addSource ( Matrix &x, Matrix &s, T dt ){
+  if (_activityThreshold <= 0){
+    x = x + dt * s;
+    return;
+  }
+  const unsigned int N_j = x.getSize(0) - 2;
+  const unsigned int W = x.getStride();
+  T *values = x.getArray();
+  const T *sources = s.getArray();
+  _pool->parallelFor(1, N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+      _activeTiles->forEachRow(jBegin, jEnd, scaleOf(x), 1,
+                               [&](unsigned int j, unsigned int first, unsigned int n){
+        for (unsigned int k = j * W + first; k < j * W + first + n; k++ )
+          values[k] = values[k] + dt * sources[k];
+      });
+    });
+}
+
+/**
+ * Same as addSource for a channel and its source stored in 16 bits: the
+ * segments of the rows swept are widened to T, summed, and stored back.
+ */
+template <typename T>
+void FluidSolver2D<T>::addSource ( CompactMatrix2D &x, const CompactMatrix2D &s, T dt ){
+  const unsigned int N_i = x.getSize(1) - 2;
+  const unsigned int N_j = x.getSize(0) - 2;
+  _pool->parallelFor(1, N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+      std::vector<T> values(N_i + 2), sources(N_i + 2);
+      _activeTiles->forEachRow(jBegin, jEnd, _densityScale, 1,
+                               [&](unsigned int j, unsigned int first, unsigned int n){
+        x.expandRow(j, first, n, &values[0]);
+        s.expandRow(j, first, n, &sources[0]);
+        for (unsigned int k = 0; k < n; k++)
+          values[k] = values[k] + dt * sources[k];
+        x.compressRow(j, first, n, &values[0]);
+      });
+    });
 }
 
 /**
@@ -62,25 +299,434 @@ void FluidSolver::addSource ( FloatMatrix2D &x, FloatMatrix2D &s, float dt ){
  * @param diff Diffusion coefficient
  * @param dt time interval
  */
-void FluidSolver::diffuse ( int b, FloatMatrix2D &x, FloatMatrix2D &x0, float diff, float dt){
-  unsigned int i, j, k;
-  float a = dt * diff * (x.getSize(0)-2) * (x.getSize(1)-2);
+template <typename T>
+SolverStats FluidSolver2D<T>::diffuse ( int b, Matrix &x, Matrix &x0, T diff, T dt){
+  T a = dt * diff * (x.getSize(0)-2) * (x.getSize(1)-2);
+
+  if(a == 0){ // no diffusion: a single copy is enough
+    const unsigned int N_j = x.getSize(0) - 2;
+    const unsigned int W = x.getStride();
+    const unsigned int *mask = obstaclesFor(x).getFluidMask();
+    T *values = x.getArray();
+    const T *values0 = x0.getArray();
+    _pool->parallelFor(1, N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+        _activeTiles->forEachRow(jBegin, jEnd, scaleOf(x), 1,
+                                 [&](unsigned int j, unsigned int first, unsigned int n){
+          for (unsigned int k = j * W + first; k < j * W + first + n; k++ )
+            if (mask[k])
+              values[k] = values0[k];
+        });
+      });
+    setBnd (b, x);
+    SolverStats stats = {1, 0};
+    return _diffusionStats = stats;
+  }
 
-  for ( k=0 ; k < 10; k++) {
-    for ( i=1 ; i <= x.getSize(1)-2 ; i++ ){
-      for ( j=1 ; j <= x.getSize(0)-2 ; j++ ){
-        if(!(_obstacles->isInObstacles(i,j))){
-	if(a == 0)
-	  x.set(i,j, x0.get(i,j));
-	else
-	  x.set(i,j, (x0.get(i,j) + a*(x.get(i-1,j)+x.get(i+1,j)+ x.get(i,j-1)+x.get(i,j+1)))/(1+4*a));
+  return _diffusionStats = linSolve (b, x, x0, a, 1+4*a, _diffusionSolver, true);
 }
-      }
+
+/**
+ * Diffusion of both components of the velocity. The relaxation solvers
+ * update u and v within the same sweeps, which halves the number of passes
+ * and thread synchronisations; the other solvers diffuse them in turn.
+ * @param u first coordinate of the velocity at t
+ * @param v second coordinate of the velocity at t
+ * @param u0 first coordinate of the velocity at t-dt
+ * @param v0 second coordinate of the velocity at t-dt
+ * @param visc Viscosity
+ * @param dt time interval
+ */
+template <typename T>
+SolverStats FluidSolver2D<T>::diffuseVelocity ( Matrix &u, Matrix &v, Matrix &u0, Matrix &v0, T visc, T dt){
+  T a = dt * visc * (u.getSize(0)-2) * (u.getSize(1)-2);
+
+  if (a != 0){
+    switch(_diffusionSolver){
+    case SOLVER_GAUSS_SEIDEL:
+      return _diffusionStats = relaxGaussSeidelVelocity (u, v, u0, v0, a, 1+4*a);
+    case SOLVER_RED_BLACK:
+    case SOLVER_MULTIGRID:
+      return _diffusionStats = relaxRedBlackVelocity (u, v, u0, v0, a, 1+4*a);
+    default:
+      break;
     }
+  }
+
+  SolverStats stats = diffuse (1, u, u0, visc, dt);
+  SolverStats statsV = diffuse (2, v, v0, visc, dt);
+  if (statsV.iterations > stats.iterations) stats.iterations = statsV.iterations;
+  if (statsV.residual > stats.residual) stats.residual = statsV.residual;
+  return _diffusionStats = stats;
+}
+
+/**
+ * Solves c.x - a.(sum of the 4 neighbours of x) = x0 on the fluid cells,
+ * with the boundary conditions b applied after each iteration. With local,
+ * the relaxations only sweep the tiles near activity (see
+ * setActivityThreshold), the other cells keeping their values; the
+ * conjugate gradients, whose dot products span the whole grid, ignore it.
+ * @param b Enumeration describing the boundary conditions
+ * @param x unknown, also used as the initial guess
+ * @param x0 right hand side
+ * @param a coefficient of the neighbours
+ * @param c coefficient of the cell itself
+ * @param solver method used to solve the system (the multigrid solver is
+ * specific to the pressure, see project)
+ * @param local whether to sweep the tiles near activity only
+ */
+template <typename T>
+SolverStats FluidSolver2D<T>::linSolve ( int b, Matrix &x, Matrix &x0, T a, T c, LinearSolver solver,
+                                         bool local){
+  switch(solver){
+  case SOLVER_RED_BLACK:
+  case SOLVER_MULTIGRID:
+    return relaxRedBlack (b, x, x0, a, c, local);
+  case SOLVER_PCG:
+    return solveConjugateGradient (b, x, x0, a, c, ConjugateGradient<T>::PRECOND_JACOBI);
+  case SOLVER_ICCG:
+    return solveConjugateGradient (b, x, x0, a, c, ConjugateGradient<T>::PRECOND_INCOMPLETE_CHOLESKY);
+  case SOLVER_GAUSS_SEIDEL:
+  default:
+    return relaxGaussSeidel (b, x, x0, a, c, local);
+  }
+}
+
+/**
+ * Gauss-Seidel relaxation: in place sweeps in memory order, tile after tile
+ * (see Tiling), between the minimum and maximum numbers of iterations (see
+ * residualCheckDue).
+ */
+template <typename T>
+SolverStats FluidSolver2D<T>::relaxGaussSeidel ( int b, Matrix &x, Matrix &x0, T a, T c, bool local){
+  const unsigned int N_i = x.getSize(1) - 2;
+  const unsigned int N_j = x.getSize(0) - 2;
+  const unsigned int W = x.getStride();
+  const unsigned int *mask = obstaclesFor(x).getFluidMask();
+  const Tiling tiles(N_i, 3);
+  auto relaxRow = [&](unsigned int j, unsigned int first, unsigned int n){
+    const unsigned int o = j * W + first - 1;
+    stencilGaussSeidelRow(x.getArray() + o, x0.getArray() + o, mask + o, n, W, a, c);
+  };
+
+  SolverStats stats = {0, -1};
+  unsigned int k;
+
+  for ( k=0 ; k < _maxIterations; ) {
+    tiles.forEachRow(1, N_j + 1, [&](unsigned int j, unsigned int first, unsigned int n){
+        if (local)
+          _activeTiles->forEachRun(j, first, n, scaleOf(x), 1, relaxRow);
+        else
+          relaxRow(j, first, n);
+      });
+    setBnd (b, x);
+    if (residualCheckDue (++k)) {
+      stats.residual = relativeResidual (b, x, x0, a, c, false, local);
+      if (stats.residual <= _tolerance)
+        break;
+    }
+  }
+  stats.iterations = k;
+  return stats;
+}
+
+/**
+ * Red-black Gauss-Seidel relaxation: each sweep first updates
+ * the cells where i+j is even, then the other ones. The walls and obstacles
+ * are part of the stencil (see stencilRelaxRow), so the sweeps between two
+ * residual checks run back to back, and setBnd is only needed after each
+ * check.
+ */
+template <typename T>
+SolverStats FluidSolver2D<T>::relaxRedBlack ( int b, Matrix &x, Matrix &x0, T a, T c, bool local){
+  Matrix *fields[1] = {&x}, *rhs[1] = {&x0};
+  const int bnd[1] = {b};
+
+  SolverStats stats = {0, -1};
+  unsigned int k;
+
+  for (k = 0; k < _maxIterations; ) {
+    const unsigned int next = nextResidualCheck (k);
+    relaxRedBlackSweeps (fields, rhs, bnd, 1, a, c, next - k, local);
+    k = next;
+    if (residualCheckDue (k))
+      stats.residual = relativeResidual (b, x, x0, a, c, true, local);
     setBnd (b, x);
+    if (residualCheckDue (k) && stats.residual <= _tolerance)
+      break;
+  }
+  stats.iterations = k;
+  return stats;
+}
+
+/**
+ * Runs red-black sweeps on several fields with the same coefficients.
+ *
+ * With several threads, each half sweep splits the rows between them and
+ * goes through the whole grid. With a single thread and more than one
+ * sweep, the half sweeps are pipelined instead (temporal blocking): within
+ * a column tile, the half sweep h updates the row j while h + 1 updates the
+ * row j - 1, so that each row of the tile gets all the sweeps while it is
+ * still in the cache rather than once per trip through memory. The tile of
+ * the half sweep h is shifted left by h columns, so that its cells at the
+ * edges of the tile find their neighbours in the state a full sweep would
+ * give them. Both ways give the same values. With local, the segments of
+ * the rows are clipped to the tiles near activity (see linSolve).
+ *
+ * @param x fields
+ * @param x0 their right hand sides
+ * @param b their boundary conditions (0, 1 or 2)
+ * @param nbFields number of fields
+ * @param sweeps number of sweeps (both colors)
+ * @param local whether to sweep the tiles near activity only
+ */
+template <typename T>
+void FluidSolver2D<T>::relaxRedBlackSweeps ( Matrix **x, Matrix **x0, const int *b, unsigned int nbFields,
+                                             T a, T c, unsigned int sweeps, bool local){
+  const unsigned int N_i = x[0]->getSize(1) - 2;
+  const unsigned int N_j = x[0]->getSize(0) - 2;
+  const unsigned int W = x[0]->getStride();
+  const Obstacles &obstacles = obstaclesFor(*x[0]);
+  const unsigned int *mask = obstacles.getFluidMask();
+  const std::vector<unsigned int> &walls = obstacles.getWallCells();
+  const unsigned int halfSweeps = 2 * sweeps;
+
+  // the walls are mirrored by the kernel, and rebuilt by setBnd afterwards
+  for (unsigned int f = 0; f < nbFields; f++)
+    for (unsigned int k = 0; k < walls.size(); k++)
+      x[f]->getArray()[walls[k]] = 0;
+
+  // half sweep h (color h % 2) of the columns first..first+n-1 of the row j
+  auto relaxRow = [&](unsigned int h, unsigned int j, unsigned int first, unsigned int n){
+    auto relaxRun = [&](unsigned int j, unsigned int first, unsigned int n){
+      const unsigned int o = j * W + first - 1;
+      for (unsigned int f = 0; f < nbFields; f++)
+        stencilRelaxRow(x[f]->getArray() + o, x0[f]->getArray() + o, mask + o,
+                        obstacles.getMirror(b[f]) + o, n, W, j + h + first - 1, a, c);
+    };
+    if (local)
+      _activeTiles->forEachRun(j, first, n, scaleOf(*x[0]), 1, relaxRun);
+    else
+      relaxRun(j, first, n);
+  };
+
+  if (sweeps == 1 || _pool->getNbThreads() > 1) {
+    const Tiling tiles(N_i, 3 * nbFields + 1);
+    for (unsigned int h = 0; h < halfSweeps; h++)
+      _pool->parallelFor(1, N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+          tiles.forEachRow(jBegin, jEnd, [&](unsigned int j, unsigned int first, unsigned int n){
+              relaxRow(h, j, first, n);
+            });
+        });
+    return;
+  }
+
+  const Tiling tiles(N_i, 3 * nbFields + 1, halfSweeps + 2);
+  const int width = tiles.getTileWidth();
+  for (unsigned int t = 0; t < tiles.getNbTiles(); t++) {
+    const bool last = (t + 1 == tiles.getNbTiles());
+    for (unsigned int step = 1; step < N_j + halfSweeps; step++) {
+      for (unsigned int h = 0; h < halfSweeps && h < step; h++) {
+        const unsigned int j = step - h;
+        if (j > N_j)
+          continue;
+        const int first = std::max(1, 1 + (int) (t * width) - (int) h);
+        const int end = last ? (int) N_i + 1 : 1 + (int) ((t + 1) * width) - (int) h;
+        if (end > first)
+          relaxRow(h, j, first, end - first);
+      }
+    }
+  }
+}
+
+/**
+ * Residual norm of c.x - a.(sum of the 4 neighbours of x) = x0 over the
+ * fluid cells, relative to the norm of x0. For the pressure equation
+ * (Neumann boundaries, c = 4a) the mean of the residual is left out, as no
+ * iteration can reduce it.
+ * With mirrored, the walls and obstacles hold 0 and the boundary
+ * conditions are those of the red-black sweeps (see stencilRelaxRow);
+ * otherwise they hold the values of setBnd. With local, only the cells of
+ * the tiles the relaxations sweep count.
+ */
+template <typename T>
+float FluidSolver2D<T>::relativeResidual ( int b, Matrix &x, Matrix &x0, T a, T c, bool mirrored,
+                                           bool local){
+  const unsigned int N_i = x.getSize(1) - 2;
+  const unsigned int N_j = x.getSize(0) - 2;
+  const unsigned int W = x.getStride();
+  const Obstacles &obstacles = obstaclesFor(x);
+  const unsigned int *mask = obstacles.getFluidMask();
+  const float *mirror = mirrored ? obstacles.getMirror(b) : NULL;
+  std::vector<StencilSums> rows(N_j + 2); // summed in order afterwards
+
+  _pool->parallelFor(1, N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+      if (!local){
+        for (unsigned int j = jBegin; j < jEnd; j++)
+          stencilResidualRow(x.getArray() + j * W, x0.getArray() + j * W, mask + j * W,
+                             mirror == NULL ? NULL : mirror + j * W, N_i, W, a, c, rows[j]);
+        return;
+      }
+      _activeTiles->forEachRow(jBegin, jEnd, scaleOf(x), 1,
+                               [&](unsigned int j, unsigned int first, unsigned int n){
+        const unsigned int o = j * W + first - 1;
+        StencilSums run;
+        stencilResidualRow(x.getArray() + o, x0.getArray() + o, mask + o,
+                           mirror == NULL ? NULL : mirror + o, n, W, a, c, run);
+        rows[j].residual += run.residual;
+        rows[j].residualSquares += run.residualSquares;
+        rows[j].rhsSquares += run.rhsSquares;
+        rows[j].count += run.count;
+      });
+    });
+
+  double residual = 0, residualSquares = 0, rhsSquares = 0;
+  unsigned int count = 0;
+  for (unsigned int j = 1; j <= N_j; j++){
+    residual += rows[j].residual;
+    residualSquares += rows[j].residualSquares;
+    rhsSquares += rows[j].rhsSquares;
+    count += rows[j].count;
+  }
+  if (b == 0 && c <= 4 * a && count > 0)
+    residualSquares -= residual * residual / count;
+  if (residualSquares < 0)
+    residualSquares = 0;
+  return rhsSquares > 0 ? sqrt(residualSquares / rhsSquares) : sqrt(residualSquares);
+}
+
+/**
+ * Gauss-Seidel relaxation of the diffusion of u and v, in the same sweeps,
+ * over the tiles near activity.
+ */
+template <typename T>
+SolverStats FluidSolver2D<T>::relaxGaussSeidelVelocity ( Matrix &u, Matrix &v, Matrix &u0, Matrix &v0, T a, T c){
+  const unsigned int N_i = u.getSize(1) - 2;
+  const unsigned int N_j = u.getSize(0) - 2;
+  const unsigned int W = u.getStride();
+  const unsigned int *mask = _obstacles->getFluidMask();
+  const Tiling tiles(N_i, 5);
+  auto relaxRow = [&](unsigned int j, unsigned int first, unsigned int n){
+    const unsigned int o = j * W + first - 1;
+    stencilGaussSeidelRow(u.getArray() + o, u0.getArray() + o, mask + o, n, W, a, c);
+    stencilGaussSeidelRow(v.getArray() + o, v0.getArray() + o, mask + o, n, W, a, c);
+  };
+
+  SolverStats stats = {0, -1};
+  unsigned int k;
+
+  for ( k=0 ; k < _maxIterations; ) {
+    tiles.forEachRow(1, N_j + 1, [&](unsigned int j, unsigned int first, unsigned int n){
+        _activeTiles->forEachRun(j, first, n, 1, 1, relaxRow);
+      });
+    setBnd (1, u); setBnd (2, v);
+    if (residualCheckDue (++k)) {
+      stats.residual = std::max (relativeResidual (1, u, u0, a, c, false, true),
+                                 relativeResidual (2, v, v0, a, c, false, true));
+      if (stats.residual <= _tolerance)
+        break;
+    }
+  }
+  stats.iterations = k;
+  return stats;
+}
+
+/**
+ * Red-black relaxation of the diffusion of u and v, in the same sweeps,
+ * over the tiles near activity.
+ */
+template <typename T>
+SolverStats FluidSolver2D<T>::relaxRedBlackVelocity ( Matrix &u, Matrix &v, Matrix &u0, Matrix &v0, T a, T c){
+  Matrix *fields[2] = {&u, &v}, *rhs[2] = {&u0, &v0};
+  const int bnd[2] = {1, 2};
+
+  SolverStats stats = {0, -1};
+  unsigned int k;
+
+  for (k = 0; k < _maxIterations; ) {
+    const unsigned int next = nextResidualCheck (k);
+    relaxRedBlackSweeps (fields, rhs, bnd, 2, a, c, next - k, true);
+    k = next;
+    if (residualCheckDue (k))
+      stats.residual = std::max (relativeResidual (1, u, u0, a, c, true, true),
+                                 relativeResidual (2, v, v0, a, c, true, true));
+    setBnd (1, u); setBnd (2, v);
+    if (residualCheckDue (k) && stats.residual <= _tolerance)
+      break;
+  }
+  stats.iterations = k;
+  return stats;
+}
+
+/**
+ * Preconditioned conjugate gradient, run until the residual drops below the
+ * tolerance. The boundary conditions 0 are Neumann ones and are part of the
+ * system; for the others the values next to the walls and obstacles are
+ * those of the previous step.
+ */
+template <typename T>
+SolverStats FluidSolver2D<T>::solveConjugateGradient ( int b, Matrix &x, Matrix &x0, T a, T c,
+                                                       typename ConjugateGradient<T>::Preconditioner preconditioner){
+  ConjugateGradient<T> *&solver =
+    x.getSize(1) == _u->getSize(1) ? _conjugateGradient : _densityConjugateGradient;
+  if (solver == NULL)
+    solver = new ConjugateGradient<T>(x.getSize(1), x.getSize(0), x.getStride(), *_pool);
+  SolverStats stats =
+    solver->solve(x, x0, obstaclesFor(x), a, c, b == 0, preconditioner,
+                  _tolerance, PCG_MAX_ITERATIONS);
+  setBnd (b, x);
+  return stats;
+}
+
+
+/**
+ * Returns the matrix *scratch, allocated with the sizes of x the first
+ * time (or again when they differ).
+ */
+template <typename T>
+typename FluidSolver2D<T>::Matrix &FluidSolver2D<T>::scratchFor ( Matrix *&scratch, const Matrix &x ){
+  return scratchFor (scratch, x.getSize(1), x.getSize(0));
+}
+
+template <typename T>
+typename FluidSolver2D<T>::Matrix &FluidSolver2D<T>::scratchFor ( Matrix *&scratch,
+                                                                  unsigned int width,
+                                                                  unsigned int height ){
+  if (scratch == NULL || scratch->getSize(1) != width || scratch->getSize(0) != height){
+    delete scratch;
+    scratch = new Matrix(width, height);
   }
+  return *scratch;
 }
 
+/**
+ * Points uj and vj to the velocity of the row j of the fields advected:
+ * the row j of u and v when they are on the same grid, else the row
+ * interpolated into uRow and vRow, sized for the finer density grid, of
+ * which rowHeld is the row they hold.
+ */
+template <typename T>
+void FluidSolver2D<T>::velocityRow ( Matrix &u, Matrix &v, unsigned int j,
+                                     std::vector<T> &uRow, std::vector<T> &vRow,
+                                     unsigned int &rowHeld, const T *&uj, const T *&vj ){
+  const unsigned int W_u = u.getStride();
+  if (uRow.empty()){
+    uj = u.getArray() + j * W_u;
+    vj = v.getArray() + j * W_u;
+    return;
+  }
+  if (rowHeld != j){
+    // the row j lies between the velocity rows j0 and j0 + 1
+    const T y = (j - (T) 0.5) / _densityScale + (T) 0.5;
+    const unsigned int j0 = (unsigned int) y, o = j0 * W_u;
+    stencilUpsampleRow(&uRow[0], u.getArray() + o, u.getArray() + o + W_u, y - j0,
+                       &_upsampleColumns[0], &_upsampleWeights[0], uRow.size());
+    stencilUpsampleRow(&vRow[0], v.getArray() + o, v.getArray() + o + W_u, y - j0,
+                       &_upsampleColumns[0], &_upsampleWeights[0], vRow.size());
+    rowHeld = j;
+  }
+  uj = &uRow[0];
+  vj = &vRow[0];
+}
 
 /**
  * Advection, ie. movement of the density of particules along the velocity field.
@@ -93,124 +739,564 @@ void FluidSolver::diffuse ( int b, FloatMatrix2D &x, FloatMatrix2D &x0, float di
  * @param diff Diffusion coefficient
  * @param dt time interval
  */
-void FluidSolver::advect (int b, FloatMatrix2D &d, FloatMatrix2D &d0, FloatMatrix2D &u, FloatMatrix2D &v, float dt ){
-  unsigned int i, j, i0, j0, i1, j1;
-  float x, y, s0, t0, s1, t1;
-  const unsigned int N_i = d.getSize(1) - 2;
-  const unsigned int N_j = d.getSize(0) - 2;
+template <typename T>
+void FluidSolver2D<T>::advect (int b, Matrix &d, Matrix &d0, Matrix &u, Matrix &v, T dt ){
+  Matrix *fields = &d, *fields0 = &d0;
+  advect (b, &fields, &fields0, 1, u, v, dt);
+}
 
-  const unsigned int  dt0_x = dt * N_i;
-  const unsigned int  dt0_y = dt * N_j;
+/**
+ * Advection of nbFields scalar fields d from d0 along the same velocity, in
+ * one pass: each cell is traced back once for all of them. When the fields
+ * are on the density grid and it is finer than the velocity one, the
+ * velocity of each row is interpolated from u and v on the fly.
+ * With the MacCormack scheme (see setAdvection), the semi-Lagrangian pass
+ * writes scratch matrices, which a second pass over the same rows
+ * corrects into d. Only the tiles near activity are swept (see
+ * setActivityThreshold): the cells of the other ones keep their values.
+ */
+template <typename T>
+void FluidSolver2D<T>::advect (int b, Matrix **d, Matrix **d0, unsigned int nbFields,
+                               Matrix &u, Matrix &v, T dt ){
+  const unsigned int N_i = d[0]->getSize(1) - 2;
+  const unsigned int N_j = d[0]->getSize(0) - 2;
+  const unsigned int W = d[0]->getStride();
+  const unsigned int *mask = obstaclesFor(*d[0]).getFluidMask();
+  const bool upsampled = d[0]->getSize(1) != u.getSize(1);
+  const unsigned int scale = N_i / (u.getSize(1) - 2);
 
-  for (i=1; i <= N_i; i++){
-    for (j=1; j <= N_j; j++){
-      if(!(_obstacles->isInObstacles(i,j))){
-      x = i - dt0_x * u.get(i,j);
-      y = j - dt0_y * v.get(i,j);
+  const T dt0_x = dt * N_i;
+  const T dt0_y = dt * N_j;
 
-      if (x < 0.5) x = 0.5;
-      if (x > N_i + 0.5) x = N_i + 0.5;
+  // the semi-Lagrangian pass writes d1, d itself unless it is corrected
+  const bool macCormack = _advection == ADVECTION_MACCORMACK;
+  if (macCormack && _dens_forward.size() < nbFields)
+    _dens_forward.resize(nbFields, NULL);
+  std::vector<Matrix *> d1(nbFields);
+  std::vector<T *> dArrays(nbFields), d1Arrays(nbFields);
+  std::vector<const T *> d0Arrays(nbFields);
+  for (unsigned int f = 0; f < nbFields; f++){
+    d1[f] = macCormack ? &scratchFor(_dens_forward[f], *d[f]) : d[f];
+    dArrays[f] = d[f]->getArray();
+    d1Arrays[f] = d1[f]->getArray();
+    d0Arrays[f] = d0[f]->getArray();
+  }
 
-      i0 = (int)x; i1 = i0 + 1;
+  for (unsigned int pass = 0; pass < (macCormack ? 2 : 1); pass++){
+    // the correction samples d1 around the cells it covers: the forward
+    // pass covers one more ring of tiles
+    const unsigned int reach = _advectionReach + (macCormack && pass == 0 ? 1 : 0);
+    _pool->parallelFor(1, N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+        std::vector<T> uRow(upsampled ? N_i + 2 : 0), vRow(upsampled ? N_i + 2 : 0);
+        unsigned int upsampledRow = 0; // the one uRow and vRow hold
+        _activeTiles->forEachRow(jBegin, jEnd, scale, reach,
+                                 [&](unsigned int j, unsigned int first, unsigned int n){
+          const T *uj, *vj;
+          velocityRow (u, v, j, uRow, vRow, upsampledRow, uj, vj);
+          if (pass == 0)
+            stencilAdvectChannelsRow(&d1Arrays[0], &d0Arrays[0], nbFields, uj, vj,
+                                     mask, j, first, n, N_i, N_j, W, dt0_x, dt0_y);
+          else
+            stencilMacCormackChannelsRow(&dArrays[0], &d0Arrays[0], &d1Arrays[0], nbFields,
+                                         uj, vj, mask, j, first, n, N_i, N_j, W,
+                                         dt0_x, dt0_y);
+        });
+      });
+    for (unsigned int f = 0; f < nbFields; f++)
+      setBnd (b, pass == 0 ? *d1[f] : *d[f]);
+  }
+}
 
-      if (y < 0.5) y = 0.5;
-      if (y > N_j + 0.5) y = N_j + 0.5;
+/**
+ * Same as advect for nbFields channels stored in 16 bits (see
+ * setStoragePrecision), of the precision of d0: see advectCompact.
+ */
+template <typename T>
+void FluidSolver2D<T>::advect (int b, CompactMatrix2D **d, CompactMatrix2D **d0,
+                               unsigned int nbFields, Matrix &u, Matrix &v, T dt ){
+  if (d0[0]->getPrecision() == STORAGE_HALF){
+    std::vector<const StencilHalf *> cells(nbFields);
+    for (unsigned int f = 0; f < nbFields; f++)
+      cells[f] = (const StencilHalf *) d0[f]->getCells();
+    advectCompact (b, d, &cells[0], nbFields, u, v, dt);
+  }
+  else {
+    std::vector<const StencilBfloat *> cells(nbFields);
+    for (unsigned int f = 0; f < nbFields; f++)
+      cells[f] = (const StencilBfloat *) d0[f]->getCells();
+    advectCompact (b, d, &cells[0], nbFields, u, v, dt);
+  }
+}
 
-      j0 = (int)y; j1 = j0 + 1;
+/**
+ * Advection of nbFields channels d stored in 16 bits from the cells d0 (of
+ * S, see stencilAdvectChannelsToRow), which the kernels widen as they
+ * sample them. Each row segment swept is widened into a row of T, advected
+ * there and stored back, so that the channels are never widened as a
+ * whole: the advection streams 2 bytes per cell of each channel in each
+ * direction instead of 4 (or 8). The forward pass of MacCormack writes the
+ * same scratch matrices of T as advect.
+ */
+template <typename T>
+template <typename S>
+void FluidSolver2D<T>::advectCompact (int b, CompactMatrix2D **d, const S *const *d0,
+                                      unsigned int nbFields, Matrix &u, Matrix &v, T dt ){
+  const unsigned int N_i = d[0]->getSize(1) - 2;
+  const unsigned int N_j = d[0]->getSize(0) - 2;
+  const unsigned int W = d[0]->getStride();
+  const unsigned int *mask = getDensityObstacles().getFluidMask();
+  const bool upsampled = d[0]->getSize(1) != u.getSize(1);
 
-      s1 = x - i0;
-      s0 = 1 - s1;
-      t1 = y - j0;
-      t0 = 1 - t1;
+  const T dt0_x = dt * N_i;
+  const T dt0_y = dt * N_j;
 
-      if(!(_obstacles->isInObstacles(i0,j0))
-	 && !(_obstacles->isInObstacles(i1,j1))
-	 && !(_obstacles->isInObstacles(i0,j1))
-	 && !(_obstacles->isInObstacles(i1,j0))){
-        d.set(i,j, s0 * (t0 * d0.get(i0,j0) + t1 * d0.get(i0,j1)) + s1 * (t0 * d0.get(i1,j0) + t1 * d0.get(i1,j1)));
-      }
-      else{
-        d.set(i,j, d0.get(i,j));
-      }
-    }
+  const bool macCormack = _advection == ADVECTION_MACCORMACK;
+  if (macCormack && _dens_forward.size() < nbFields)
+    _dens_forward.resize(nbFields, NULL);
+  std::vector<const T *> d1Arrays(nbFields);
+  for (unsigned int f = 0; f < nbFields; f++)
+    if (macCormack)
+      d1Arrays[f] = scratchFor(_dens_forward[f], N_i + 2, N_j + 2).getArray();
+
+  for (unsigned int pass = 0; pass < (macCormack ? 2 : 1); pass++){
+    const bool forward = macCormack && pass == 0;
+    _pool->parallelFor(1, N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+        std::vector<T> uRow(upsampled ? N_i + 2 : 0), vRow(upsampled ? N_i + 2 : 0);
+        std::vector<T> rows(forward ? 0 : nbFields * (N_i + 2));
+        std::vector<T *> dRows(nbFields);
+        unsigned int upsampledRow = 0;
+        _activeTiles->forEachRow(jBegin, jEnd, _densityScale,
+                                 _advectionReach + (forward ? 1 : 0),
+                                 [&](unsigned int j, unsigned int first, unsigned int n){
+          const T *uj, *vj;
+          velocityRow (u, v, j, uRow, vRow, upsampledRow, uj, vj);
+          if (forward){
+            for (unsigned int f = 0; f < nbFields; f++)
+              dRows[f] = _dens_forward[f]->getArray() + j * W;
+            stencilAdvectChannelsToRow(&dRows[0], d0, nbFields, uj, vj,
+                                       mask, j, first, n, N_i, N_j, W, dt0_x, dt0_y);
+            return;
+          }
+          // the cells which are not fluid keep their values
+          for (unsigned int f = 0; f < nbFields; f++){
+            dRows[f] = &rows[f * (N_i + 2)];
+            d[f]->expandRow(j, first, n, dRows[f] + first);
+          }
+          if (pass == 0)
+            stencilAdvectChannelsToRow(&dRows[0], d0, nbFields, uj, vj,
+                                       mask, j, first, n, N_i, N_j, W, dt0_x, dt0_y);
+          else
+            stencilMacCormackChannelsToRow(&dRows[0], d0, &d1Arrays[0], nbFields, uj, vj,
+                                           mask, j, first, n, N_i, N_j, W, dt0_x, dt0_y);
+          for (unsigned int f = 0; f < nbFields; f++)
+            d[f]->compressRow(j, first, n, dRows[f] + first);
+        });
+      });
+    for (unsigned int f = 0; f < nbFields; f++){
+      if (forward)
+        setBnd (b, *_dens_forward[f]);
+      else
+        setBnd (b, *d[f]);
     }
   }
-  setBnd (b, d);
 }
 
 
 /**
- * Updates the density during a step of dt.
+ * Advection of the velocity along itself: u and v share the back-traced
+ * positions, computed once per cell in a single pass. With the MacCormack
+ * scheme, the semi-Lagrangian pass writes scratch matrices, which a second
+ * pass corrects into u and v. As for the density, only the tiles near
+ * activity are swept.
+ * @param u first coordinate of the velocity at t
+ * @param v second coordinate of the velocity at t
+ * @param u0 first coordinate of the velocity at t-dt
+ * @param v0 second coordinate of the velocity at t-dt
+ * @param dt time interval
  */
-void FluidSolver::densStep ( FloatMatrix2D *x, FloatMatrix2D *x0, FloatMatrix2D *u, FloatMatrix2D *v, float diff, float dt){
+template <typename T>
+void FluidSolver2D<T>::advectVelocity ( Matrix &u, Matrix &v, Matrix &u0, Matrix &v0, T dt ){
+  const unsigned int N_i = u.getSize(1) - 2;
+  const unsigned int N_j = u.getSize(0) - 2;
+  const unsigned int W = u.getStride();
+  const unsigned int *mask = _obstacles->getFluidMask();
+
+  const T dt0_x = dt * N_i;
+  const T dt0_y = dt * N_j;
+
+  const bool macCormack = _advection == ADVECTION_MACCORMACK;
+  Matrix &u1 = macCormack ? scratchFor(_u_forward, u) : u;
+  Matrix &v1 = macCormack ? scratchFor(_v_forward, v) : v;
+
+  _pool->parallelFor(1, N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+      _activeTiles->forEachRow(jBegin, jEnd, 1, _advectionReach + (macCormack ? 1 : 0),
+                               [&](unsigned int j, unsigned int first, unsigned int n){
+        stencilAdvectVelocityRow(u1.getArray(), v1.getArray(), u0.getArray(), v0.getArray(),
+                                 mask, j, first, n, N_i, N_j, W, dt0_x, dt0_y);
+      });
+    });
+  if (macCormack){
+    setBnd (1, u1); setBnd (2, v1);
+    _pool->parallelFor(1, N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+        _activeTiles->forEachRow(jBegin, jEnd, 1, _advectionReach,
+                                 [&](unsigned int j, unsigned int first, unsigned int n){
+          stencilMacCormackVelocityRow(u.getArray(), v.getArray(), u0.getArray(), v0.getArray(),
+                                       u1.getArray(), v1.getArray(), mask, j, first, n,
+                                       N_i, N_j, W, dt0_x, dt0_y);
+        });
+      });
+  }
+  setBnd (1, u); setBnd (2, v);
+}
+
+/**
+ * Updates the density during a step of dt: x and x0 are on the density
+ * grid, u and v on the velocity one.
+ */
+template <typename T>
+void FluidSolver2D<T>::densStep ( Matrix *x, Matrix *x0, Matrix *u, Matrix *v, T diff, T dt){
   addSource (*x, *x0, dt);
   SWAP (x0, x); diffuse (0, *x, *x0, diff, dt );
   SWAP (x0, x); advect  (0, *x, *x0, *u, *v, dt );
 }
 
+/**
+ * Same as densStep for all the channels of x and x0 at once: their sources
+ * are added and they are diffused one after the other, then advected
+ * together, in one pass which traces each cell back once and reads the
+ * velocity once for all of them.
+ */
+template <typename T>
+void FluidSolver2D<T>::densStep ( ScalarChannels2D<T> *x, ScalarChannels2D<T> *x0,
+                                  Matrix *u, Matrix *v, T diff, T dt){
+  const unsigned int n = x->getNbChannels();
+  for (unsigned int c = 0; c < n; c++)
+    addSource (*x->getChannel(c), *x0->getChannel(c), dt);
+  std::swap (x0, x);
+  for (unsigned int c = 0; c < n; c++)
+    diffuse (0, *x->getChannel(c), *x0->getChannel(c), diff, dt);
+  std::swap (x0, x);
+  advect (0, x->getChannels(), x0->getChannels(), n, *u, *v, dt);
+}
+
+/**
+ * Updates the scalar channels of the solver during a step of dt, with the
+ * velocity of the solver: see densStep above. In a 16-bit storage
+ * precision (see setStoragePrecision), the sources are added and the
+ * channels advected row by row in T (see advectCompact); each channel is
+ * diffused in turn in two scratch matrices of T shared by all of them, as
+ * the relaxations sweep the whole field many times, and stored back into
+ * its previous-step field, from which the channels are advected together.
+ */
+template <typename T>
+void FluidSolver2D<T>::densStep ( T diff, T dt ){
+  if (!compactScalars()){
+    densStep (_scalars, _scalars_prev, _u, _v, diff, dt);
+    return;
+  }
+  const unsigned int nbChannels = getNbScalarChannels();
+  const unsigned int N_i = _compactDens->getSize(1) - 2;
+  const unsigned int N_j = _compactDens->getSize(0) - 2;
+  const T a = dt * diff * N_j * N_i;
+  for (unsigned int c = 0; c < nbChannels; c++)
+    addSource (*_compactScalars[c], *_compactScalarsPrev[c], dt);
+
+  for (unsigned int c = 0; c < nbChannels; c++){
+    CompactMatrix2D &x = *_compactScalarsPrev[c], &x0 = *_compactScalars[c];
+    if (a == 0){ // no diffusion: a copy of the fluid cells is enough
+      const unsigned int W = x.getStride();
+      const unsigned int *mask = getDensityObstacles().getFluidMask();
+      unsigned short *cells = (unsigned short *) x.getCells();
+      const unsigned short *cells0 = (const unsigned short *) x0.getCells();
+      _pool->parallelFor(1, N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+          _activeTiles->forEachRow(jBegin, jEnd, _densityScale, 1,
+                                   [&](unsigned int j, unsigned int first, unsigned int n){
+            for (unsigned int k = j * W + first; k < j * W + first + n; k++ )
+              if (mask[k])
+                cells[k] = cells0[k];
+          });
+        });
+      setBnd (0, x);
+      SolverStats stats = {1, 0};
+      _diffusionStats = stats;
+      continue;
+    }
+    Matrix &field = scratchFor(_dens_diffused, N_i + 2, N_j + 2);
+    Matrix &rhs = scratchFor(_dens_sum, N_i + 2, N_j + 2);
+    _pool->parallelFor(0, N_j + 2, [&](unsigned int jBegin, unsigned int jEnd){
+        x.expandRows(field, jBegin, jEnd);
+        x0.expandRows(rhs, jBegin, jEnd);
+      });
+    _diffusionStats = linSolve (0, field, rhs, a, 1+4*a, _diffusionSolver, true);
+    _pool->parallelFor(0, N_j + 2, [&](unsigned int jBegin, unsigned int jEnd){
+        x.compressRows(field, jBegin, jEnd);
+      });
+  }
+
+  advect (0, &_compactScalars[0], &_compactScalarsPrev[0], nbChannels, *_u, *_v, dt);
+}
+
 
 /**
  * Projection, ie. computation of the velocity field.
+ *
+ * Unless warm start is disabled, the pressure p is not reset: its current
+ * content, the pressure of the previous projection, is the initial guess
+ * of the solver.
  */
-void FluidSolver::project (FloatMatrix2D &u, FloatMatrix2D &v, FloatMatrix2D &p, FloatMatrix2D &div )
+template <typename T>
+SolverStats FluidSolver2D<T>::project (Matrix &u, Matrix &v, Matrix &p, Matrix &div )
 {
-  unsigned int i, j, k;
-  float h_u, h_v;
+  const unsigned int N_i = u.getSize(1) - 2;
+  const unsigned int N_j = u.getSize(0) - 2;
+  T h_u, h_v;
 
   h_u = 1.0 / (u.getSize(1)-2);
   h_v = 1.0 / (v.getSize(1)-2);
 
-  for ( i=1 ; i <= u.getSize(1) - 2; i++ ) {
-    for ( j=1 ; j <= u.getSize(0) - 2; j++ ) {
-      if(!(_obstacles->isInObstacles(i,j))){
-      div.set(i,j, -0.5 * h_u * (u.get(i+1,j) - u.get(i-1,j)) - 0.5 * h_v * (v.get(i,j+1) - v.get(i,j-1)));
-      p.set(i, j, 0);
-    }
-    }
-  }
+  const unsigned int W = u.getStride();
+  const unsigned int *mask = _obstacles->getFluidMask();
+  const Tiling tiles(N_i, 5);
+
+  _pool->parallelFor(1, N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+      tiles.forEachRow(jBegin, jEnd, [&](unsigned int j, unsigned int first, unsigned int n){
+          const unsigned int o = j * W + first - 1;
+          stencilDivergenceRow(div.getArray() + o,
+                               _warmStart ? NULL : p.getArray() + o,
+                               u.getArray() + o, v.getArray() + o,
+                               mask + o, n, W, h_u, h_v);
+        });
+    });
   setBnd (0, div); setBnd (0, p);
 
-  for ( k = 0 ; k < 10 ; k++ ) {
-    for ( i = 1; i <= u.getSize(1) - 2; i++ ) {
-      for (j = 1; j <= u.getSize(0) - 2; j++ ) {
-        if(!(_obstacles->isInObstacles(i,j))){
-	p.set(i,j, (div.get(i,j) + p.get(i-1,j) + p.get(i+1,j) + p.get(i,j-1) + p.get(i,j+1)) / 4);
-}
-      }
-    }
+  SolverStats stats;
+  if (_pressureSolver == SOLVER_MULTIGRID){
+    if (_multigrid == NULL)
+      _multigrid = new Multigrid<T>(p.getSize(1), p.getSize(0), *_pool);
+    stats = _multigrid->solve(p, div, *_obstacles, _tolerance, MULTIGRID_MAX_CYCLES);
     setBnd (0, p);
   }
-  for ( i=1 ; i <= u.getSize(1) - 2; i++ ) {
-    for ( j=1 ; j <= u.getSize(0) - 2; j++ ) {
-      if(!(_obstacles->isInObstacles(i,j))){
-      u.set(i,j, u.get(i,j) - 0.5 * (p.get(i+1,j) - p.get(i-1,j)) / h_u);
-      v.set(i,j, v.get(i,j) - 0.5 * (p.get(i,j+1) - p.get(i,j-1)) / h_v);
-    }
-    }
-  }
+  else
+    stats = linSolve (0, p, div, 1, 4, _pressureSolver, false);
+  if (_warmStart)
+    removeMean (p);
+
+  _pool->parallelFor(1, N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+      tiles.forEachRow(jBegin, jEnd, [&](unsigned int j, unsigned int first, unsigned int n){
+          const unsigned int o = j * W + first - 1;
+          stencilGradientRow(u.getArray() + o, v.getArray() + o,
+                             p.getArray() + o, mask + o, n, W, h_u, h_v);
+        });
+    });
   setBnd (1, u); setBnd (2, v);
+  return _pressureStats = stats;
+}
+
+/**
+ * Subtracts from x its mean over the fluid cells. The pressure is only
+ * defined up to a constant, which the relaxations let drift from one solve
+ * to the next when they start from the previous pressure.
+ */
+template <typename T>
+void FluidSolver2D<T>::removeMean (Matrix &x)
+{
+  const ScalarMatrixView<T> interior = x.getInterior();
+  // the mask has the layout of the matrix
+  const unsigned int *mask = _obstacles->getFluidMask() + interior.stride + 1;
+  std::vector<double> rowSums(interior.height, 0);
+  std::vector<unsigned int> rowCounts(interior.height, 0);
+
+  // summed row by row so that the result does not depend on the threads
+  _pool->parallelFor(0, interior.height, [&](unsigned int jBegin, unsigned int jEnd){
+      for (unsigned int j = jBegin; j < jEnd; j++ ){
+        const T *row = interior.row(j);
+        const unsigned int *maskRow = mask + j * interior.stride;
+        for (unsigned int i = 0; i < interior.width; i++ ){
+          if (maskRow[i]){
+            rowSums[j] += row[i];
+            rowCounts[j]++;
+          }
+        }
+      }
+    });
+  double sum = 0;
+  unsigned int count = 0;
+  for (unsigned int j = 0; j < interior.height; j++ ){
+    sum += rowSums[j];
+    count += rowCounts[j];
+  }
+  if (count == 0)
+    return;
+
+  const T mean = sum / count;
+  _pool->parallelFor(0, interior.height, [&](unsigned int jBegin, unsigned int jEnd){
+      for (unsigned int j = jBegin; j < jEnd; j++ ){
+        T *row = interior.row(j);
+        const unsigned int *maskRow = mask + j * interior.stride;
+        for (unsigned int i = 0; i < interior.width; i++ )
+          if (maskRow[i])
+            row[i] -= mean;
+      }
+    });
+  setBnd (0, x);
 }
 
 /**
- * Updates the velocity field during a step of dt.
+ * Updates the velocity field during a step of dt. With an activity
+ * threshold, the active tiles are updated again before the advection,
+ * from the velocity it follows.
  */
-void FluidSolver::velStep (FloatMatrix2D *u, FloatMatrix2D *v, FloatMatrix2D *u0, FloatMatrix2D *v0, float visc, float dt ){
+template <typename T>
+void FluidSolver2D<T>::velStep (Matrix *u, Matrix *v, Matrix *u0, Matrix *v0, T visc, T dt ){
   addSource (*u, *u0, dt);
   addSource (*v, *v0, dt);
-  SWAP (u0, u); diffuse (1, *u, *u0, visc, dt);
-  SWAP (v0, v); diffuse (2, *v, *v0, visc, dt);
+  SWAP (u0, u); SWAP (v0, v);
+  diffuseVelocity (*u, *v, *u0, *v0, visc, dt);
 
-  project (*u, *v, *u0, *v0);
+  project (*u, *v, *_pressure_diff, *u0);
   SWAP (u0, u); SWAP (v0, v);
-  advect (1, *u, *u0, *u0, *v0, dt);
-  advect (2, *v, *v0, *u0, *v0, dt);
-  project (*u, *v, *u0, *v0);
+  if (_activityThreshold > 0) // the velocity the advection follows
+    updateActiveTiles (*u0, *v0, dt);
+  advectVelocity (*u, *v, *u0, *v0, dt);
+  project (*u, *v, *_pressure, *u0);
 }
 
 /**
- * Applies the Boundary conditions.
+ * Number of cells of the velocity grid the fastest fluid of (u0, v0)
+ * crosses in dt.
  */
-void FluidSolver::setBnd (int b, FloatMatrix2D &x ) {
+template <typename T>
+T FluidSolver2D<T>::courantNumber (Matrix &u0, Matrix &v0, T dt){
+  const ScalarMatrixView<T> u = u0.getInterior(), v = v0.getInterior();
+  std::vector<T> rowSpeeds(u.height, 0);
+
+  _pool->parallelFor(0, u.height, [&](unsigned int jBegin, unsigned int jEnd){
+      for (unsigned int j = jBegin; j < jEnd; j++ ){
+        const T *uRow = u.row(j), *vRow = v.row(j);
+        T speed = 0;
+        for (unsigned int i = 0; i < u.width; i++ ){
+          speed = std::max(speed, std::fabs(uRow[i]) * u.width);
+          speed = std::max(speed, std::fabs(vRow[i]) * u.height);
+        }
+        rowSpeeds[j] = speed;
+      }
+    });
+  return dt * *std::max_element(rowSpeeds.begin(), rowSpeeds.end());
+}
+
+/**
+ * Runs a whole simulation step on the fields owned by the solver, the
+ * sources being injected after each substep.
+ *
+ * With a CFL number (see setCfl), the step is split into substeps in
+ * which the fastest fluid crosses at most that many cells: before each
+ * substep, the rest of the step is divided evenly at the current speed, so
+ * that a calm flow takes the whole step at once. The number of substeps
+ * left only grows when the fluid speeds up, and the last one takes exactly
+ * what is left of the step, so that the rounding of the substeps never
+ * adds one. There are at most MAX_SUBSTEPS substeps.
+ * With an activity threshold, the active tiles are updated before each
+ * substep, and again before the density step, from the velocity its
+ * advection follows.
+ *
+ * @param visc Viscosity of the fluid
+ * @param diff Diffusion coefficient
+ * @param dt time interval
+ */
+template <typename T>
+void FluidSolver2D<T>::step (T visc, T diff, T dt){
+  T remaining = dt;
+  unsigned int planned = 1; // substeps left, this one included
+  _substeps = 0;
+
+  do {
+    if (_cfl > 0 && planned < MAX_SUBSTEPS - _substeps){
+      const T courant = courantNumber (*_u, *_v, remaining);
+      const unsigned int left = MAX_SUBSTEPS - _substeps;
+      const T n = std::ceil (courant / _cfl);
+      if (n > planned)
+        planned = n < left ? (unsigned int) n : left;
+    }
+    const T substep = planned == 1 ? remaining : remaining / planned;
+    if (_activityThreshold > 0)
+      updateActiveTiles (*_u, *_v, substep);
+    velStep (_u, _v, _u_prev, _v_prev, visc, substep);
+    if (_activityThreshold > 0)
+      updateActiveTiles (*_u, *_v, substep);
+    densStep(diff, substep);
+    injectSources();
+    remaining -= substep;
+    _substeps++;
+  } while (--planned > 0);
+}
+
+/**
+ * Marks the tiles where the velocity or one of the scalar channels,
+ * current or previous-step (which holds the sources), exceeds the activity
+ * threshold, and the rings of tiles around them which the fluid may reach
+ * in a substep of dt at the velocity (u, v): the advections sweep them,
+ * the forward pass of MacCormack one more ring, and the other local passes
+ * the first ring only. A cell r rings away lies at least
+ * (r - 1) * ACTIVE_TILE_SIZE + 1 cells from a marked tile, and the
+ * semi-Lagrangian advection samples the cells up to the Courant number
+ * (rounded up) away.
+ */
+template <typename T>
+void FluidSolver2D<T>::updateActiveTiles(Matrix &u, Matrix &v, T dt){
+  const T threshold = _activityThreshold;
+  _activeTiles->clear();
+  _activeTiles->mark(*_u, 1, threshold);
+  _activeTiles->mark(*_v, 1, threshold);
+  _activeTiles->mark(*_u_prev, 1, threshold);
+  _activeTiles->mark(*_v_prev, 1, threshold);
+  for (unsigned int c = 0; c < getNbScalarChannels(); c++){
+    if (compactScalars()){
+      _activeTiles->mark(*_compactScalars[c], _densityScale, _activityThreshold);
+      _activeTiles->mark(*_compactScalarsPrev[c], _densityScale, _activityThreshold);
+      continue;
+    }
+    _activeTiles->mark(*_scalars->getChannel(c), _densityScale, threshold);
+    _activeTiles->mark(*_scalars_prev->getChannel(c), _densityScale, threshold);
+  }
+  const unsigned int N = std::max(_u->getSize(0), _u->getSize(1)) - 2;
+  const unsigned int across = (N + ACTIVE_TILE_SIZE - 1) / ACTIVE_TILE_SIZE;
+  const T cells = std::min(std::ceil(courantNumber (u, v, dt)),
+                           (T) (across * ACTIVE_TILE_SIZE));
+  _advectionReach = 1 + (cells > 1 ? (unsigned int) cells - 1 : 0) / ACTIVE_TILE_SIZE;
+  _activeTiles->dilate(_advectionReach + 1);
+}
+
+/**
+ * Resets the previous-step matrices to the sources, which will be added
+ * to the fluid during the next step.
+ */
+template <typename T>
+void FluidSolver2D<T>::injectSources(){
+  // the velocity sources follow the previous-step fields in the same order
+  _fields->copy(FIELD_U_VEL_SRC, FIELD_U_PREV, NB_SOURCE_FIELDS);
+  const unsigned int n = getNbScalarChannels();
+  if (compactScalars()){
+    // the density source is stored in the precision of the channels
+    memcpy(_compactDensPrev->getStorage(), _dens_src->getStorage(), _dens_src->getStorageBytes());
+    for (unsigned int c = 1; c < n; c++)
+      _pool->parallelFor(0, _compactDensPrev->getSize(0), [&](unsigned int jBegin, unsigned int jEnd){
+          _compactScalarsPrev[c]->compressRows(*getScalarSource(c), jBegin, jEnd);
+        });
+    return;
+  }
+  _pool->parallelFor(0, _dens_prev->getSize(0), [&](unsigned int jBegin, unsigned int jEnd){
+      _dens_src->expandRows(*_dens_prev, jBegin, jEnd);
+    });
+  // and so do the sources of the other scalar channels
+  _densityFields->copy(2 * n, n + 1, n - 1);
+}
+
+/**
+ * Applies the Boundary conditions to x, of the grid of the obstacles:
+ * a matrix of T or a channel stored in 16 bits.
+ */
+template <class M>
+static void setBoundaries (int b, M &x, Obstacles &obstacles) {
   unsigned int i, N_x = x.getSize(1), N_y = x.getSize(0);
 
   if (b<3){
@@ -263,30 +1349,276 @@ void FluidSolver::setBnd (int b, FloatMatrix2D &x ) {
   x.set(N_x - 1, N_y - 1, 0.5 * (x.get(N_x - 2, N_y - 1) 
 				 + x.get(N_x - 1, N_y - 2)));
 
-  _obstacles->setObstacles(b, x);
+  obstacles.setObstacles(b, x);
 }
 
-void FluidSolver::resetFluid(){
-  _u->fill(0);
-  _v->fill(0);
-  _u_prev->fill(0);
-  _v_prev->fill(0);
-  _dens->fill(0);
-  _dens_prev->fill(0);
+/**
+ * Applies the Boundary conditions.
+ */
+template <typename T>
+void FluidSolver2D<T>::setBnd (int b, Matrix &x ) {
+  setBoundaries (b, x, obstaclesFor(x));
 }
 
-void FluidSolver::resetSources(){
+template <typename T>
+void FluidSolver2D<T>::setBnd (int b, CompactMatrix2D &x ) {
+  setBoundaries (b, x, getDensityObstacles());
+}
+
+template <typename T>
+void FluidSolver2D<T>::resetFluid(){
+  _fields->fill(0, NB_STATE_FIELDS, 0);
+  if (!compactScalars()){
+    _densityFields->fill(0, 2 * getNbScalarChannels(), 0);
+    return;
+  }
+  for (unsigned int c = 0; c < getNbScalarChannels(); c++){
+    _compactScalars[c]->fill(0);
+    _compactScalarsPrev[c]->fill(0);
+  }
+}
+
+template <typename T>
+void FluidSolver2D<T>::resetSources(){
+  _fields->fill(FIELD_U_VEL_SRC, NB_SOURCE_FIELDS, 0);
   _dens_src->fill(0);
-  _u_vel_src->fill(0);
-  _v_vel_src->fill(0);
+  const unsigned int n = getNbScalarChannels();
+  _densityFields->fill(compactScalars() ? 0 : 2 * n, n - 1, 0);
+}
+
+/**
+ * Copies the state of the fluid and the sources into state, resized once:
+ * each arena in one pass straight to its offset, followed by the storage
+ * of the density source and, in a 16-bit storage precision, by the one of
+ * the channels and of the previous-step ones.
+ */
+template <typename T>
+void FluidSolver2D<T>::saveCheckpoint(std::vector<T> &state) const{
+  const size_t arena = NB_FIELDS * _fields->getFieldLength();
+  const size_t arenas = arena + _densityFields->getNbFields() * _densityFields->getFieldLength();
+  const size_t bytes = _dens_src->getStorageBytes();
+  const unsigned int compact = _compactScalars.size();
+  state.resize(arenas + ((1 + 2 * compact) * bytes + sizeof(T) - 1) / sizeof(T));
+  _fields->save(0, NB_FIELDS, &state[0]);
+  _densityFields->save(0, _densityFields->getNbFields(), &state[arena]);
+  unsigned char *storage = (unsigned char *) &state[arenas];
+  memcpy(storage, _dens_src->getStorage(), bytes);
+  for (unsigned int c = 0; c < compact; c++){
+    memcpy(storage + (1 + c) * bytes, _compactScalars[c]->getStorage(), bytes);
+    memcpy(storage + (1 + compact + c) * bytes, _compactScalarsPrev[c]->getStorage(), bytes);
+  }
 }
 
-void FluidSolver::reset(){
+/**
+ * Brings back the fluid and the sources saved by saveCheckpoint on a solver
+ * of the same sizes and storage precision; other checkpoints are ignored.
+ */
+template <typename T>
+void FluidSolver2D<T>::restoreCheckpoint(const std::vector<T> &state){
+  const size_t arena = NB_FIELDS * _fields->getFieldLength();
+  const size_t arenas = arena + _densityFields->getNbFields() * _densityFields->getFieldLength();
+  const size_t bytes = _dens_src->getStorageBytes();
+  const unsigned int compact = _compactScalars.size();
+  if (state.size() != arenas + ((1 + 2 * compact) * bytes + sizeof(T) - 1) / sizeof(T))
+    return;
+  _fields->restore(0, NB_FIELDS, &state[0]);
+  _densityFields->restore(0, _densityFields->getNbFields(), &state[arena]);
+  const unsigned char *storage = (const unsigned char *) &state[arenas];
+  memcpy(_dens_src->getStorage(), storage, bytes);
+  for (unsigned int c = 0; c < compact; c++){
+    memcpy(_compactScalars[c]->getStorage(), storage + (1 + c) * bytes, bytes);
+    memcpy(_compactScalarsPrev[c]->getStorage(), storage + (1 + compact + c) * bytes, bytes);
+  }
+}
+
+/**
+ * Loads the fluid state and the sources stored in the files of a
+ * configuration. Empty file names are ignored.
+ *
+ * @param config Configuration giving the state files
+ */
+template <typename T>
+void FluidSolver2D<T>::loadState(Config &config){
+  if(strcmp("",config.getVelXFile()) != 0)
+    _u->load(config.getVelXFile());
+
+  if(strcmp("",config.getVelYFile()) != 0)
+    _v->load(config.getVelYFile());
+
+  if(strcmp("",config.getDensFile()) != 0){
+    if (compactScalars())
+      _compactDens->load(config.getDensFile());
+    else
+      _dens->load(config.getDensFile());
+  }
+
+  if(strcmp("",config.getVelXSrcFile()) != 0)
+    _u_vel_src->load(config.getVelXSrcFile());
+
+  if(strcmp("",config.getVelYSrcFile()) != 0)
+    _v_vel_src->load(config.getVelYSrcFile());
+
+  if(strcmp("",config.getDensSrcFile()) != 0)
+    _dens_src->load(config.getDensSrcFile());
+}
+
+/**
+ * Sets the number of threads sharing the solver computations.
+ *
+ * @param nbThreads Number of threads, 0 to use one thread per core
+ */
+template <typename T>
+void FluidSolver2D<T>::setThreads(unsigned int nbThreads){
+  delete _multigrid; // uses the pool
+  _multigrid = NULL;
+  delete _conjugateGradient;
+  _conjugateGradient = NULL;
+  delete _densityConjugateGradient;
+  _densityConjugateGradient = NULL;
+  delete _pool;
+  _pool = new ThreadPool(nbThreads);
+}
+
+/**
+ * Sets the linear solver used by the projection step.
+ */
+template <typename T>
+void FluidSolver2D<T>::setPressureSolver(LinearSolver solver){
+  _pressureSolver = solver;
+}
+
+/**
+ * Sets the linear solver used by the diffusion step.
+ */
+template <typename T>
+void FluidSolver2D<T>::setDiffusionSolver(LinearSolver solver){
+  _diffusionSolver = solver;
+}
+
+/**
+ * Sets the bounds of the number of sweeps of the relaxation solvers: they
+ * check the residual after each sweep beyond min, and stop when it is
+ * below the tolerance or after max sweeps.
+ */
+template <typename T>
+void FluidSolver2D<T>::setIterations(unsigned int min, unsigned int max){
+  _minIterations = min;
+  _maxIterations = max;
+}
+
+/**
+ * Sets the residual, relative to the right hand side, at which the
+ * iterative solvers stop.
+ */
+template <typename T>
+void FluidSolver2D<T>::setTolerance(float tolerance){
+  _tolerance = tolerance;
+}
+
+/**
+ * Sets whether the projections start from the pressure of the previous one
+ * or from zero.
+ */
+template <typename T>
+void FluidSolver2D<T>::setWarmStart(bool warmStart){
+  _warmStart = warmStart;
+}
+
+/**
+ * Sets the precision in which the scalar channels, current and
+ * previous-step, and the density source are stored. Half floats and
+ * bfloat16 halve their memory and the traffic of the passes of densStep
+ * over them, which widen them row by row into T; the rounding is far below
+ * what the colormap shows. The channels and the source are converted.
+ */
+template <typename T>
+void FluidSolver2D<T>::setStoragePrecision(StoragePrecision precision){
+  if (precision == _dens_src->getPrecision())
+    return;
+  const unsigned int width = _dens_src->getSize(1), height = _dens_src->getSize(0);
+  Matrix source(width, height);
+  _dens_src->expandRows(source, 0, height);
+  delete _dens_src;
+  _dens_src = new CompactMatrix2D(width, height, precision);
+  _dens_src->compressRows(source, 0, height);
+  reallocateScalars(getNbScalarChannels(), precision, getNbScalarChannels());
+}
+
+/**
+ * Sets the largest number of cells of the velocity grid the fluid may
+ * cross per substep (see step), 0 to run each step in one go.
+ */
+template <typename T>
+void FluidSolver2D<T>::setCfl(float cfl){
+  _cfl = cfl;
+}
+
+/**
+ * Sets the scheme of the advection of the density and of the velocity.
+ * MacCormack adds a second pass over the grid to each advection, about
+ * twice their cost, for much less numerical diffusion: the vortices and
+ * the edges of the density keep on a grid of half the width and height.
+ */
+template <typename T>
+void FluidSolver2D<T>::setAdvection(AdvectionScheme scheme){
+  _advection = scheme;
+}
+
+/**
+ * Sets the activity threshold: the local passes (the sources, the
+ * diffusion relaxations and the advections) then skip the tiles of the
+ * grid (see ActiveTiles) where the velocity and the scalars stay below it
+ * in magnitude, and which have no such activity within a tile (within the
+ * distance the fluid may cross in a substep for the advections, see
+ * updateActiveTiles), so that a plume in a large empty domain costs in
+ * proportion to the plume. The
+ * cells skipped are left as they are, below the threshold. The projection
+ * still covers the whole grid, the pressure reaching everywhere at once,
+ * and so do the conjugate gradients and the injection of the sources,
+ * which may appear anywhere. 0 sweeps every tile.
+ */
+template <typename T>
+void FluidSolver2D<T>::setActivityThreshold(float threshold){
+  _activityThreshold = threshold;
+  if (threshold <= 0)
+    _activeTiles->markAll();
+}
+
+/**
+ * Sets the number of channels of the scalar field carried by the fluid,
+ * 1 for the density alone: the other channels are diffused and advected
+ * with it at each step, from their own sources (see getScalarSource). The
+ * density and its source are kept, the other channels start empty.
+ */
+template <typename T>
+void FluidSolver2D<T>::setScalarChannels(unsigned int nbChannels){
+  if (nbChannels < 1)
+    nbChannels = 1;
+  if (nbChannels == getNbScalarChannels())
+    return;
+  reallocateScalars(nbChannels, _dens_src->getPrecision(), 1);
+}
+
+template <typename T>
+void FluidSolver2D<T>::reset(){
   resetFluid();
   resetSources();
 }
 
-std::ostream &operator<< (std::ostream &stream, const FluidSolver &toPrint){
+template <typename T>
+std::ostream &operator<< (std::ostream &stream, const FluidSolver2D<T> &toPrint){
+  if (toPrint.compactScalars()){
+    const CompactMatrix2D &dens = *toPrint._compactDens;
+    typename FluidSolver2D<T>::Matrix widened(dens.getSize(1), dens.getSize(0));
+    dens.expandRows(widened, 0, dens.getSize(0));
+    stream << widened;
+    return stream;
+  }
   stream << *(toPrint._dens);
   return stream;
 }
+
+template class FluidSolver2D<float>;
+template class FluidSolver2D<double>;
+template std::ostream &operator<< (std::ostream &, const FluidSolver2D<float> &);
+template std::ostream &operator<< (std::ostream &, const FluidSolver2D<double> &);
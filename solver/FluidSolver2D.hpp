@@ -2,43 +2,241 @@
 #define FLUIDSOLVER2D_HPP_
 
 #include "FloatMatrix2D.hpp"
+#include "FieldArena.hpp"
+#include "ScalarChannels2D.hpp"
+#include "ActiveTiles.hpp"
+#include "CompactMatrix2D.hpp"
 #include "Obstacles.hpp"
+#include "ThreadPool.hpp"
+#include "LinearSolver.hpp"
+#include "Advection.hpp"
+#include "Multigrid.hpp"
+#include "ConjugateGradient.hpp"
 #include "../config.hpp"
 
 /**
  * This class implements functions used to solve fluid equations.
  * Currently, only 2D fluids are considered.
+ *
+ * T is the scalar type of the fields. Floats are enough for the display;
+ * doubles keep the small terms of long runs at a very low viscosity, which
+ * floats round away against the pressure and the velocity. Both share the
+ * same kernels (see Stencil).
+ *
+ * The density may live on a finer grid than the velocity, the pressure and
+ * the obstacles, with densityScale x densityScale cells per velocity cell
+ * (see Config::setDensityScale): the detail of the density shows much more
+ * than the one of the velocity, whose projection costs most of a step. The
+ * velocity is then interpolated during the advection of the density, and
+ * the obstacles are refined for the density grid.
+ *
+ * The density is the first channel of a multi-channel scalar field (see
+ * setScalarChannels): further channels (dyes, a temperature, tracers) are
+ * diffused and advected with it, each cell being traced back once per
+ * step for all of them. With a 16-bit storage precision (see
+ * setStoragePrecision), the channels are CompactMatrix2D rather than
+ * matrices of T: _scalars, _scalars_prev, _dens and _dens_prev are then
+ * NULL, and _compactDens and _compactDensPrev hold the density.
  */
 
-class FluidSolver{
+template <typename T>
+class FluidSolver2D{
 public:
-  FluidSolver(unsigned int i, unsigned int j); // Designed for testing
-  FluidSolver(unsigned int i, unsigned int j, Config &config);
-  ~FluidSolver();
+  typedef ScalarMatrix2D<T> Matrix;
 
-  void velStep (FloatMatrix2D *u, FloatMatrix2D *v, FloatMatrix2D *u0, FloatMatrix2D *v0, float visc, float dt );
-  void densStep (FloatMatrix2D *x, FloatMatrix2D *x0, FloatMatrix2D *u, FloatMatrix2D *v, float diff, float dt);
+  FluidSolver2D(unsigned int i, unsigned int j); // Designed for testing
+  FluidSolver2D(unsigned int i, unsigned int j, Config &config);
+  ~FluidSolver2D();
+
+  void velStep (Matrix *u, Matrix *v, Matrix *u0, Matrix *v0, T visc, T dt );
+  void densStep (Matrix *x, Matrix *x0, Matrix *u, Matrix *v, T diff, T dt);
+  void densStep (ScalarChannels2D<T> *x, ScalarChannels2D<T> *x0, Matrix *u, Matrix *v,
+                 T diff, T dt);
+  void densStep (T diff, T dt);
+  void step (T visc, T diff, T dt);
+  void injectSources();
+
+  void loadState(Config &config);
 
   void reset();
   void resetFluid();
   void resetSources();
+  void saveCheckpoint(std::vector<T> &state) const;
+  void restoreCheckpoint(const std::vector<T> &state);
+
+  void setThreads(unsigned int nbThreads);
+  void setPressureSolver(LinearSolver solver);
+  void setDiffusionSolver(LinearSolver solver);
+  void setTolerance(float tolerance);
+  void setIterations(unsigned int min, unsigned int max);
+  void setWarmStart(bool warmStart);
+  void setStoragePrecision(StoragePrecision precision);
+  void setCfl(float cfl);
+  void setAdvection(AdvectionScheme scheme);
+  void setActivityThreshold(float threshold);
+  inline const ActiveTiles &getActiveTiles() const{
+    return *_activeTiles;
+  }
+  void setScalarChannels(unsigned int nbChannels);
+  // the channels in the float storage precision
+  inline ScalarChannels2D<T> &getScalars() const{
+    return *_scalars;
+  }
+  // the channels in a 16-bit one
+  inline CompactMatrix2D *getCompactScalar(unsigned int c) const{
+    return _compactScalars[c];
+  }
+  inline bool compactScalars() const{
+    return !_compactScalars.empty();
+  }
+  // source of the channel c >= 1, the density one being _dens_src
+  inline Matrix *getScalarSource(unsigned int c) const{
+    return _densityFields->getField((compactScalars() ? 0 : 2 * getNbScalarChannels()) + c - 1);
+  }
+  inline unsigned int getNbScalarChannels() const{
+    return _nbScalarChannels;
+  }
+  inline unsigned int getSubsteps() const{
+    return _substeps;
+  }
+  inline unsigned int getDensityScale() const{
+    return _densityScale;
+  }
+  Obstacles &getDensityObstacles();
+  inline const SolverStats &getPressureStats() const{
+    return _pressureStats;
+  }
+  inline const SolverStats &getDiffusionStats() const{
+    return _diffusionStats;
+  }
+
+  /**
+   * Order of the fields in the arena of the velocity grid: the state of the
+   * fluid first, then the velocity sources, in the order of the
+   * previous-step fields they are copied onto before each step. The scalar
+   * channels have an arena of their own, on the density grid: the n
+   * channels, the n previous-step ones, then the sources of the channels
+   * 1..n - 1. The source of the density (channel 0) is kept apart, in the
+   * storage precision, and so are the channels when it is a 16-bit one:
+   * the arena then only holds the sources.
+   */
+  enum Field {
+    FIELD_U, FIELD_V, FIELD_PRESSURE, FIELD_PRESSURE_DIFF,
+    FIELD_U_PREV, FIELD_V_PREV,
+    FIELD_U_VEL_SRC, FIELD_V_VEL_SRC,
+    NB_FIELDS,
+    NB_STATE_FIELDS = FIELD_U_VEL_SRC,
+    NB_SOURCE_FIELDS = NB_FIELDS - FIELD_U_VEL_SRC
+  };
 
   //private:
-  inline void addSource ( FloatMatrix2D &x, FloatMatrix2D &s, float dt );
-  void diffuse ( int b, FloatMatrix2D &x, FloatMatrix2D &x0, float diff, float dt);
-  void advect ( int b, FloatMatrix2D &d, FloatMatrix2D &d0, FloatMatrix2D &u, FloatMatrix2D &v, float dt);
-  void project ( FloatMatrix2D &u, FloatMatrix2D &v, FloatMatrix2D &p, FloatMatrix2D &div);
-  void setBnd ( int b, FloatMatrix2D &x );
+  void allocateFields(unsigned int i, unsigned int j, StoragePrecision precision,
+                      unsigned int densityScale);
+  void allocateScalars(unsigned int width, unsigned int height, unsigned int nbChannels,
+                       StoragePrecision precision);
+  void reallocateScalars(unsigned int nbChannels, StoragePrecision precision, unsigned int kept);
+  Obstacles &obstaclesFor(const Matrix &x);
+  inline unsigned int scaleOf(const Matrix &x) const{
+    return (x.getSize(1) - 2) / (_u->getSize(1) - 2);
+  }
+  void addSource ( Matrix &x, Matrix &s, T dt );
+  void addSource ( CompactMatrix2D &x, const CompactMatrix2D &s, T dt );
+  SolverStats diffuse ( int b, Matrix &x, Matrix &x0, T diff, T dt);
+  SolverStats diffuseVelocity ( Matrix &u, Matrix &v, Matrix &u0, Matrix &v0, T visc, T dt);
+  Matrix &scratchFor ( Matrix *&scratch, const Matrix &x );
+  Matrix &scratchFor ( Matrix *&scratch, unsigned int width, unsigned int height );
+  void velocityRow ( Matrix &u, Matrix &v, unsigned int j,
+                     std::vector<T> &uRow, std::vector<T> &vRow, unsigned int &rowHeld,
+                     const T *&uj, const T *&vj );
+  void advect ( int b, Matrix &d, Matrix &d0, Matrix &u, Matrix &v, T dt);
+  void advect ( int b, Matrix **d, Matrix **d0, unsigned int nbFields,
+                Matrix &u, Matrix &v, T dt);
+  void advect ( int b, CompactMatrix2D **d, CompactMatrix2D **d0, unsigned int nbFields,
+                Matrix &u, Matrix &v, T dt);
+  template <typename S>
+  void advectCompact ( int b, CompactMatrix2D **d, const S *const *d0, unsigned int nbFields,
+                       Matrix &u, Matrix &v, T dt);
+  void advectVelocity ( Matrix &u, Matrix &v, Matrix &u0, Matrix &v0, T dt);
+  SolverStats project ( Matrix &u, Matrix &v, Matrix &p, Matrix &div);
+  void removeMean ( Matrix &x );
+  T courantNumber ( Matrix &u, Matrix &v, T dt );
+  void updateActiveTiles ( Matrix &u, Matrix &v, T dt );
+  void setBnd ( int b, Matrix &x );
+  void setBnd ( int b, CompactMatrix2D &x );
+  SolverStats linSolve ( int b, Matrix &x, Matrix &x0, T a, T c, LinearSolver solver,
+                         bool local);
+  SolverStats relaxGaussSeidel ( int b, Matrix &x, Matrix &x0, T a, T c, bool local);
+  SolverStats relaxRedBlack ( int b, Matrix &x, Matrix &x0, T a, T c, bool local);
+  void relaxRedBlackSweeps ( Matrix **x, Matrix **x0, const int *b, unsigned int nbFields,
+                             T a, T c, unsigned int sweeps, bool local);
+  SolverStats relaxGaussSeidelVelocity ( Matrix &u, Matrix &v, Matrix &u0, Matrix &v0, T a, T c);
+  SolverStats relaxRedBlackVelocity ( Matrix &u, Matrix &v, Matrix &u0, Matrix &v0, T a, T c);
+  float relativeResidual ( int b, Matrix &x, Matrix &x0, T a, T c, bool mirrored = false,
+                           bool local = false);
+  inline bool residualCheckDue ( unsigned int sweeps ) const{
+    return sweeps >= _minIterations && _minIterations < _maxIterations;
+  }
+  inline unsigned int nextResidualCheck ( unsigned int sweeps ) const{
+    if (_minIterations >= _maxIterations)
+      return _maxIterations;
+    return sweeps + 1 > _minIterations ? sweeps + 1 : _minIterations;
+  }
+  SolverStats solveConjugateGradient ( int b, Matrix &x, Matrix &x0, T a, T c,
+                                       typename ConjugateGradient<T>::Preconditioner preconditioner);
 
-  FloatMatrix2D *_u, *_v, *_u_prev, *_v_prev;
-  FloatMatrix2D *_dens, *_dens_prev;
-  FloatMatrix2D *_dens_src;
-  FloatMatrix2D *_u_vel_src, *_v_vel_src;
+  FieldArena<T> *_fields; // owns the matrices of the velocity grid
+  FieldArena<T> *_densityFields; // owns the scalar channels and their sources
+  unsigned int _nbScalarChannels;
+  ScalarChannels2D<T> *_scalars, *_scalars_prev;
+  // the channels and the previous-step ones in a 16-bit storage precision,
+  // empty otherwise
+  std::vector<CompactMatrix2D *> _compactScalars, _compactScalarsPrev;
+  Matrix *_u, *_v, *_u_prev, *_v_prev;
+  Matrix *_dens, *_dens_prev; // channel 0 of the scalars
+  CompactMatrix2D *_compactDens, *_compactDensPrev; // same in 16 bits
+  CompactMatrix2D *_dens_src; // little precision needed: see setStoragePrecision
+  Matrix *_u_vel_src, *_v_vel_src;
+  // pressures of the projections after the advection and after the
+  // diffusion, kept from one step to the next
+  Matrix *_pressure, *_pressure_diff;
 
   Obstacles *_obstacles;
+  unsigned int _densityScale; // density cells per velocity cell, along each axis
+  Obstacles *_densityObstacles; // refined from _obstacles, NULL at the scale 1
+  unsigned long _densityObstaclesVersion; // of the _obstacles they were refined from
+  // velocity cell on the left of each column of the density grid, and the
+  // weight of the one on its right (see stencilUpsampleRow)
+  std::vector<unsigned int> _upsampleColumns;
+  std::vector<T> _upsampleWeights;
+
+  ThreadPool *_pool;
+  LinearSolver _pressureSolver, _diffusionSolver;
+  float _tolerance;
+  unsigned int _minIterations, _maxIterations; // sweeps of the relaxations
+  bool _warmStart; // projections start from the previous pressure
+  float _cfl; // cells the fluid may cross per substep, 0 for whole steps
+  AdvectionScheme _advection;
+  float _activityThreshold; // 0 to sweep the whole grid
+  ActiveTiles *_activeTiles; // of the velocity grid, see setActivityThreshold
+  unsigned int _advectionReach; // rings of tiles the advections sweep, see updateActiveTiles
+  unsigned int _substeps; // of the last step
+  SolverStats _pressureStats, _diffusionStats; // of the last solves
+  Multigrid<T> *_multigrid; // allocated on first use
+  ConjugateGradient<T> *_conjugateGradient; // allocated on first use
+  ConjugateGradient<T> *_densityConjugateGradient; // same, on the density grid
+  // semi-Lagrangian passes of the MacCormack advections, allocated on first use
+  std::vector<Matrix *> _dens_forward; // one per scalar channel
+  Matrix *_u_forward, *_v_forward;
+  // the diffusion of a channel stored in 16 bits, in T: the solution and
+  // the right hand side (the channel and its sources), allocated on first use
+  Matrix *_dens_diffused, *_dens_sum;
 };
 
-std::ostream &operator<< (std::ostream &stream, const FluidSolver &toPrint);
+typedef FluidSolver2D<float> FluidSolver;
+typedef FluidSolver2D<double> DoubleFluidSolver;
+
+template <typename T>
+std::ostream &operator<< (std::ostream &stream, const FluidSolver2D<T> &toPrint);
 
 
 #endif
@@ -0,0 +1,535 @@
+#include "FluidSolver3D.hpp"
+#include "Stencil.hpp"
+#include "Tiling.hpp"
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+
+#define SWAP(x0,x) {Matrix *tmp = x0; x0 = x; x = tmp;} // Uses pointers
+
+/** Constructor
+ */
+template <typename T>
+FluidSolver3D<T>::FluidSolver3D(unsigned int i, unsigned int j, unsigned int k, Config &config){
+  init(i, j, k);
+  _pool      = new ThreadPool(config.getThreads());
+  _tolerance = config.getTolerance();
+  _minIterations = config.getMinIterations();
+  _maxIterations = config.getMaxIterations();
+  _warmStart = config.getWarmStart();
+}
+
+template <typename T>
+FluidSolver3D<T>::FluidSolver3D(unsigned int i, unsigned int j, unsigned int k){
+  init(i, j, k);
+  _pool      = new ThreadPool(1);
+  _tolerance = DEF_TOLERANCE;
+  _minIterations = DEF_MIN_ITERATIONS;
+  _maxIterations = DEF_MAX_ITERATIONS;
+  _warmStart = DEF_WARM_START;
+}
+
+/**
+ * Allocates the fields of a grid of i x j x k cells, border included, and
+ * the fluid mask of the 2D row kernels.
+ */
+template <typename T>
+void FluidSolver3D<T>::init(unsigned int i, unsigned int j, unsigned int k){
+  const unsigned int size[3] = {k, j, i};
+  _N_i = i - 2;
+  _N_j = j - 2;
+  _N_k = k - 2;
+  _u         = new Matrix(size);
+  _v         = new Matrix(size);
+  _w         = new Matrix(size);
+  _u_prev    = new Matrix(size);
+  _v_prev    = new Matrix(size);
+  _w_prev    = new Matrix(size);
+  _dens      = new Matrix(size);
+  _dens_prev = new Matrix(size);
+  _u_vel_src = new Matrix(size);
+  _v_vel_src = new Matrix(size);
+  _w_vel_src = new Matrix(size);
+  _dens_src  = new Matrix(size);
+  _pressure  = new Matrix(size);
+  _pressure_diff = new Matrix(size);
+
+  _fluidRow  = alignedNew<unsigned int>(i);
+  for (unsigned int c = 1; c <= _N_i; c++)
+    _fluidRow[c] = ~0u;
+
+  _pressureStats.iterations = _diffusionStats.iterations = 0;
+  _pressureStats.residual = _diffusionStats.residual = -1;
+}
+
+template <typename T>
+FluidSolver3D<T>::~FluidSolver3D(){
+  delete _u;
+  delete _v;
+  delete _w;
+  delete _u_prev;
+  delete _v_prev;
+  delete _w_prev;
+  delete _dens;
+  delete _dens_prev;
+  delete _u_vel_src;
+  delete _v_vel_src;
+  delete _w_vel_src;
+  delete _dens_src;
+  delete _pressure;
+  delete _pressure_diff;
+  alignedDelete(_fluidRow);
+  delete _pool;
+}
+
+/**
+ * Calls row(j, k, first, n) on the segments of the interior rows which
+ * cover the columns first..first+n-1: the planes are split between the
+ * threads, and each thread walks the rows of its planes tile after tile,
+ * the tiles being narrow enough for three planes of nbFields fields to
+ * stay in the cache.
+ */
+template <typename T>
+template <class RowFunction>
+void FluidSolver3D<T>::forEachRow ( unsigned int nbFields, RowFunction row ){
+  const unsigned int rows = _N_j + 2; // per plane
+  const Tiling tiles(_N_i, nbFields, 3 * rows);
+
+  _pool->parallelFor(1, _N_k + 1, [&](unsigned int kBegin, unsigned int kEnd){
+      tiles.forEachRow(kBegin * rows, kEnd * rows, [&](unsigned int r, unsigned int first, unsigned int n){
+          const unsigned int j = r % rows;
+          if (j != 0 && j <= _N_j)
+            row(j, r / rows, first, n);
+        });
+    });
+}
+
+/**
+ * Diffusion of the density of particules.
+ * @param b Enumeration describing the boundary conditions (see setBnd)
+ * @param x density matrix at t
+ * @param x0 density matrix at t-dt
+ * @param diff Diffusion coefficient
+ * @param dt time interval
+ */
+template <typename T>
+SolverStats FluidSolver3D<T>::diffuse ( int b, Matrix &x, Matrix &x0, T diff, T dt){
+  T a = dt * diff * _N_i * _N_j;
+
+  if (a == 0){ // no diffusion: a single copy is enough
+    x = x0;
+    setBnd (b, x);
+    SolverStats stats = {1, 0};
+    return _diffusionStats = stats;
+  }
+
+  Matrix *fields[1] = {&x}, *rhs[1] = {&x0};
+  const int bnd[1] = {b};
+  return _diffusionStats = relaxRedBlack (fields, rhs, bnd, 1, a, 1 + 6 * a);
+}
+
+/**
+ * Diffusion of the three components of the velocity, in the same sweeps.
+ */
+template <typename T>
+SolverStats FluidSolver3D<T>::diffuseVelocity ( Matrix &u, Matrix &v, Matrix &w,
+                                                Matrix &u0, Matrix &v0, Matrix &w0, T visc, T dt){
+  T a = dt * visc * _N_i * _N_j;
+
+  if (a == 0){
+    diffuse (1, u, u0, visc, dt);
+    diffuse (2, v, v0, visc, dt);
+    return diffuse (3, w, w0, visc, dt);
+  }
+
+  Matrix *fields[3] = {&u, &v, &w}, *rhs[3] = {&u0, &v0, &w0};
+  const int bnd[3] = {1, 2, 3};
+  return _diffusionStats = relaxRedBlack (fields, rhs, bnd, 3, a, 1 + 6 * a);
+}
+
+/**
+ * Solves c.x - a.(sum of the 6 neighbours of x) = x0 for several fields
+ * with red-black relaxations, the boundary conditions b being applied
+ * after each sweep, between the minimum and maximum numbers of iterations
+ * (see residualCheckDue).
+ */
+template <typename T>
+SolverStats FluidSolver3D<T>::relaxRedBlack ( Matrix **x, Matrix **x0, const int *b,
+                                              unsigned int nbFields, T a, T c){
+  SolverStats stats = {0, -1};
+  unsigned int k;
+
+  for (k = 0; k < _maxIterations; ) {
+    relaxRedBlackSweep (x, x0, nbFields, a, c);
+    for (unsigned int f = 0; f < nbFields; f++)
+      setBnd (b[f], *x[f]);
+    if (residualCheckDue (++k)) {
+      stats.residual = 0;
+      for (unsigned int f = 0; f < nbFields; f++)
+        stats.residual = std::max (stats.residual, relativeResidual (b[f], *x[f], *x0[f], a, c));
+      if (stats.residual <= _tolerance)
+        break;
+    }
+  }
+  stats.iterations = k;
+  return stats;
+}
+
+/**
+ * One red-black sweep: the cells where i+j+k is even, then the other ones.
+ */
+template <typename T>
+void FluidSolver3D<T>::relaxRedBlackSweep ( Matrix **x, Matrix **x0, unsigned int nbFields, T a, T c){
+  const unsigned int W = _N_i + 2, P = W * (_N_j + 2);
+
+  for (unsigned int h = 0; h < 2; h++)
+    forEachRow(2 * nbFields, [&](unsigned int j, unsigned int k, unsigned int first, unsigned int n){
+        const unsigned int o = k * P + j * W + first - 1;
+        for (unsigned int f = 0; f < nbFields; f++)
+          stencilRelax3DRow(x[f]->getArray() + o, x0[f]->getArray() + o,
+                            n, W, P, j + k + h + first - 1, a, c);
+      });
+}
+
+/**
+ * Residual norm of c.x - a.(sum of the 6 neighbours of x) = x0 over the
+ * interior cells, relative to the norm of x0. For the pressure equation
+ * (Neumann boundaries, c = 6a) the mean of the residual is left out, as no
+ * iteration can reduce it.
+ */
+template <typename T>
+float FluidSolver3D<T>::relativeResidual ( int b, Matrix &x, Matrix &x0, T a, T c){
+  const unsigned int W = _N_i + 2, P = W * (_N_j + 2);
+  const T *values = x.getArray(), *values0 = x0.getArray();
+  std::vector<StencilSums> planes(_N_k + 2); // summed in order afterwards
+
+  _pool->parallelFor(1, _N_k + 1, [&](unsigned int kBegin, unsigned int kEnd){
+      for (unsigned int k = kBegin; k < kEnd; k++){
+        StencilSums sums = {0, 0, 0, 0};
+        for (unsigned int j = 1; j <= _N_j; j++){
+          const T *row = values + k * P + j * W, *row0 = values0 + k * P + j * W;
+          const T *up = row - W, *down = row + W, *back = row - P, *front = row + P;
+          for (unsigned int i = 1; i <= _N_i; i++){
+            const T neighbours = row[i - 1] + row[i + 1] + up[i] + down[i] + back[i] + front[i];
+            const double r = row0[i] - (c * row[i] - a * neighbours);
+            sums.residual += r;
+            sums.residualSquares += r * r;
+            sums.rhsSquares += (double) row0[i] * row0[i];
+          }
+        }
+        sums.count = _N_i * _N_j;
+        planes[k] = sums;
+      }
+    });
+
+  double residual = 0, residualSquares = 0, rhsSquares = 0;
+  unsigned int count = 0;
+  for (unsigned int k = 1; k <= _N_k; k++){
+    residual += planes[k].residual;
+    residualSquares += planes[k].residualSquares;
+    rhsSquares += planes[k].rhsSquares;
+    count += planes[k].count;
+  }
+  if (b == 0 && c <= 6 * a && count > 0)
+    residualSquares -= residual * residual / count;
+  if (residualSquares < 0)
+    residualSquares = 0;
+  return rhsSquares > 0 ? sqrt(residualSquares / rhsSquares) : sqrt(residualSquares);
+}
+
+/**
+ * Advection, ie. movement of the density of particules along the velocity field.
+ * @param b Enumeration describing the boundary conditions (see setBnd)
+ * @param d density matrix at t
+ * @param d0 density matrix at t-dt
+ * @param u field vector first coordinate at t-dt
+ * @param v field vector second coordinate at t-dt
+ * @param w field vector third coordinate at t-dt
+ * @param dt time interval
+ */
+template <typename T>
+void FluidSolver3D<T>::advect ( int b, Matrix &d, Matrix &d0, Matrix &u, Matrix &v, Matrix &w, T dt){
+  T *const dst[1] = {d.getArray()};
+  const T *const src[1] = {d0.getArray()};
+
+  _pool->parallelFor(1, _N_k + 1, [&](unsigned int kBegin, unsigned int kEnd){
+      for (unsigned int k = kBegin; k < kEnd; k++)
+        for (unsigned int j = 1; j <= _N_j; j++)
+          stencilAdvect3DRow(dst, src, 1, u.getArray(), v.getArray(), w.getArray(), j, k,
+                             _N_i, _N_j, _N_k, dt * _N_i, dt * _N_j, dt * _N_k);
+    });
+  setBnd (b, d);
+}
+
+/**
+ * Advection of the velocity along itself: the three components share the
+ * back-traced positions, computed once per cell.
+ */
+template <typename T>
+void FluidSolver3D<T>::advectVelocity ( Matrix &u, Matrix &v, Matrix &w,
+                                        Matrix &u0, Matrix &v0, Matrix &w0, T dt){
+  T *const dst[3] = {u.getArray(), v.getArray(), w.getArray()};
+  const T *const src[3] = {u0.getArray(), v0.getArray(), w0.getArray()};
+
+  _pool->parallelFor(1, _N_k + 1, [&](unsigned int kBegin, unsigned int kEnd){
+      for (unsigned int k = kBegin; k < kEnd; k++)
+        for (unsigned int j = 1; j <= _N_j; j++)
+          stencilAdvect3DRow(dst, src, 3, src[0], src[1], src[2], j, k,
+                             _N_i, _N_j, _N_k, dt * _N_i, dt * _N_j, dt * _N_k);
+    });
+  setBnd (1, u); setBnd (2, v); setBnd (3, w);
+}
+
+/**
+ * Updates the density during a step of dt.
+ */
+template <typename T>
+void FluidSolver3D<T>::densStep ( Matrix *x, Matrix *x0, Matrix *u, Matrix *v, Matrix *w,
+                                  T diff, T dt){
+  addSource (*x, *x0, dt);
+  SWAP (x0, x); diffuse (0, *x, *x0, diff, dt);
+  SWAP (x0, x); advect  (0, *x, *x0, *u, *v, *w, dt);
+}
+
+/**
+ * Projection, ie. computation of the velocity field.
+ *
+ * Unless warm start is disabled, the pressure p is not reset: its current
+ * content, the pressure of the previous projection, is the initial guess
+ * of the solver.
+ */
+template <typename T>
+SolverStats FluidSolver3D<T>::project ( Matrix &u, Matrix &v, Matrix &w, Matrix &p, Matrix &div){
+  const unsigned int W = _N_i + 2, P = W * (_N_j + 2);
+  const T h = 1.0 / _N_i;
+  const T c_w = (T) -0.5 * h, g_w = (T) 0.5 / h;
+
+  forEachRow(5, [&](unsigned int j, unsigned int k, unsigned int first, unsigned int n){
+      const unsigned int o = k * P + j * W + first - 1;
+      T *divRow = div.getArray() + o;
+      const T *wBack = w.getArray() + o - P, *wFront = w.getArray() + o + P;
+      stencilDivergenceRow(divRow, _warmStart ? NULL : p.getArray() + o,
+                           u.getArray() + o, v.getArray() + o,
+                           _fluidRow + first - 1, n, W, h, h);
+      for (unsigned int i = 1; i <= n; i++)
+        divRow[i] += c_w * (wFront[i] - wBack[i]);
+    });
+  setBnd (0, div); setBnd (0, p);
+
+  Matrix *fields[1] = {&p}, *rhs[1] = {&div};
+  const int bnd[1] = {0};
+  SolverStats stats = relaxRedBlack (fields, rhs, bnd, 1, 1, 6);
+  if (_warmStart)
+    removeMean (p);
+
+  forEachRow(4, [&](unsigned int j, unsigned int k, unsigned int first, unsigned int n){
+      const unsigned int o = k * P + j * W + first - 1;
+      T *wRow = w.getArray() + o;
+      const T *pRow = p.getArray() + o, *pBack = pRow - P, *pFront = pRow + P;
+      stencilGradientRow(u.getArray() + o, v.getArray() + o, pRow,
+                         _fluidRow + first - 1, n, W, h, h);
+      for (unsigned int i = 1; i <= n; i++)
+        wRow[i] -= g_w * (pFront[i] - pBack[i]);
+    });
+  setBnd (1, u); setBnd (2, v); setBnd (3, w);
+  return _pressureStats = stats;
+}
+
+/**
+ * Subtracts from x its mean over the interior cells, which the relaxations
+ * let drift from one solve to the next when they start from the previous
+ * pressure.
+ */
+template <typename T>
+void FluidSolver3D<T>::removeMean ( Matrix &x ){
+  const unsigned int W = _N_i + 2, P = W * (_N_j + 2);
+  T *values = x.getArray();
+  std::vector<double> planeSums(_N_k + 2, 0);
+
+  // summed plane by plane so that the result does not depend on the threads
+  _pool->parallelFor(1, _N_k + 1, [&](unsigned int kBegin, unsigned int kEnd){
+      for (unsigned int k = kBegin; k < kEnd; k++)
+        for (unsigned int j = 1; j <= _N_j; j++){
+          const T *row = values + k * P + j * W;
+          for (unsigned int i = 1; i <= _N_i; i++)
+            planeSums[k] += row[i];
+        }
+    });
+  double sum = 0;
+  for (unsigned int k = 1; k <= _N_k; k++)
+    sum += planeSums[k];
+
+  const T mean = sum / ((double) _N_i * _N_j * _N_k);
+  _pool->parallelFor(1, _N_k + 1, [&](unsigned int kBegin, unsigned int kEnd){
+      for (unsigned int k = kBegin; k < kEnd; k++)
+        for (unsigned int j = 1; j <= _N_j; j++){
+          T *row = values + k * P + j * W;
+          for (unsigned int i = 1; i <= _N_i; i++)
+            row[i] -= mean;
+        }
+    });
+  setBnd (0, x);
+}
+
+/**
+ * Updates the velocity field during a step of dt.
+ */
+template <typename T>
+void FluidSolver3D<T>::velStep ( Matrix *u, Matrix *v, Matrix *w, Matrix *u0, Matrix *v0, Matrix *w0,
+                                 T visc, T dt){
+  addSource (*u, *u0, dt);
+  addSource (*v, *v0, dt);
+  addSource (*w, *w0, dt);
+  SWAP (u0, u); SWAP (v0, v); SWAP (w0, w);
+  diffuseVelocity (*u, *v, *w, *u0, *v0, *w0, visc, dt);
+
+  project (*u, *v, *w, *_pressure_diff, *u0);
+  SWAP (u0, u); SWAP (v0, v); SWAP (w0, w);
+  advectVelocity (*u, *v, *w, *u0, *v0, *w0, dt);
+  project (*u, *v, *w, *_pressure, *u0);
+}
+
+/**
+ * Runs a whole simulation step on the fields owned by the solver, then
+ * injects the sources for the next step.
+ *
+ * @param visc Viscosity of the fluid
+ * @param diff Diffusion coefficient
+ * @param dt time interval
+ */
+template <typename T>
+void FluidSolver3D<T>::step (T visc, T diff, T dt){
+  velStep (_u, _v, _w, _u_prev, _v_prev, _w_prev, visc, dt);
+  densStep(_dens, _dens_prev, _u, _v, _w, diff, dt);
+  injectSources();
+}
+
+/**
+ * Resets the previous-step matrices to the sources, which will be added
+ * to the fluid during the next step.
+ */
+template <typename T>
+void FluidSolver3D<T>::injectSources(){
+  *_u_prev = *_u_vel_src;
+  *_v_prev = *_v_vel_src;
+  *_w_prev = *_w_vel_src;
+  *_dens_prev = *_dens_src;
+}
+
+/**
+ * Applies the boundary conditions: the walls of the box take the values
+ * of the cells next to them, negated for the component of the velocity
+ * normal to the wall (b = 1, 2, 3 for u, v, w; 0 for the scalars), and
+ * the edges and corners the mean of their neighbours on the walls.
+ */
+template <typename T>
+void FluidSolver3D<T>::setBnd ( int b, Matrix &x ){
+  const unsigned int W = _N_i + 2, P = W * (_N_j + 2);
+  const unsigned int I = _N_i + 1, J = _N_j + 1, K = _N_k + 1;
+  T *d = x.getArray();
+  auto at = [&](unsigned int i, unsigned int j, unsigned int k) -> T &{
+    return d[k * P + j * W + i];
+  };
+
+  // walls i = 0, I and j = 0, J, plane by plane
+  _pool->parallelFor(1, K, [&](unsigned int kBegin, unsigned int kEnd){
+      for (unsigned int k = kBegin; k < kEnd; k++){
+        for (unsigned int j = 1; j < J; j++){
+          at(0, j, k) = b == 1 ? -at(1, j, k)     : at(1, j, k);
+          at(I, j, k) = b == 1 ? -at(I - 1, j, k) : at(I - 1, j, k);
+        }
+        for (unsigned int i = 1; i < I; i++){
+          at(i, 0, k) = b == 2 ? -at(i, 1, k)     : at(i, 1, k);
+          at(i, J, k) = b == 2 ? -at(i, J - 1, k) : at(i, J - 1, k);
+        }
+      }
+    });
+  // walls k = 0, K
+  for (unsigned int j = 1; j < J; j++)
+    for (unsigned int i = 1; i < I; i++){
+      at(i, j, 0) = b == 3 ? -at(i, j, 1)     : at(i, j, 1);
+      at(i, j, K) = b == 3 ? -at(i, j, K - 1) : at(i, j, K - 1);
+    }
+
+  // edges, then corners: n(c, C) is the neighbour of the wall c = 0 or C
+  auto n = [](unsigned int c, unsigned int C){
+    return c == 0 ? 1 : C - 1;
+  };
+  for (unsigned int e = 0; e < 4; e++){
+    const unsigned int i = (e & 1) ? I : 0, j = (e & 1) ? J : 0;
+    const unsigned int k = (e & 2) ? K : 0, jk = (e & 2) ? J : 0;
+    for (unsigned int c = 1; c < I; c++) // along i
+      at(c, j, k) = 0.5 * (at(c, n(j, J), k) + at(c, j, n(k, K)));
+    for (unsigned int c = 1; c < J; c++) // along j
+      at(i, c, k) = 0.5 * (at(n(i, I), c, k) + at(i, c, n(k, K)));
+    for (unsigned int c = 1; c < K; c++) // along k
+      at(i, jk, c) = 0.5 * (at(n(i, I), jk, c) + at(i, n(jk, J), c));
+  }
+  for (unsigned int e = 0; e < 8; e++){
+    const unsigned int i = (e & 1) ? I : 0, j = (e & 2) ? J : 0, k = (e & 4) ? K : 0;
+    at(i, j, k) = (at(n(i, I), j, k) + at(i, n(j, J), k) + at(i, j, n(k, K))) / 3;
+  }
+}
+
+template <typename T>
+void FluidSolver3D<T>::resetFluid(){
+  _u->fill(0); _v->fill(0); _w->fill(0);
+  _u_prev->fill(0); _v_prev->fill(0); _w_prev->fill(0);
+  _dens->fill(0); _dens_prev->fill(0);
+  _pressure->fill(0); _pressure_diff->fill(0);
+}
+
+template <typename T>
+void FluidSolver3D<T>::resetSources(){
+  _u_vel_src->fill(0); _v_vel_src->fill(0); _w_vel_src->fill(0);
+  _dens_src->fill(0);
+}
+
+template <typename T>
+void FluidSolver3D<T>::reset(){
+  resetFluid();
+  resetSources();
+}
+
+/**
+ * Sets the number of threads sharing the solver computations.
+ *
+ * @param nbThreads Number of threads, 0 to use one thread per core
+ */
+template <typename T>
+void FluidSolver3D<T>::setThreads(unsigned int nbThreads){
+  delete _pool;
+  _pool = new ThreadPool(nbThreads);
+}
+
+/**
+ * Sets the residual, relative to the right hand side, at which the
+ * relaxations stop.
+ */
+template <typename T>
+void FluidSolver3D<T>::setTolerance(float tolerance){
+  _tolerance = tolerance;
+}
+
+/**
+ * Sets the bounds of the number of sweeps of the relaxations, see
+ * FluidSolver2D::setIterations.
+ */
+template <typename T>
+void FluidSolver3D<T>::setIterations(unsigned int min, unsigned int max){
+  _minIterations = min;
+  _maxIterations = max;
+}
+
+/**
+ * Sets whether the projections start from the pressure of the previous one
+ * or from zero.
+ */
+template <typename T>
+void FluidSolver3D<T>::setWarmStart(bool warmStart){
+  _warmStart = warmStart;
+}
+
+template class FluidSolver3D<float>;
+template class FluidSolver3D<double>;
@@ -0,0 +1,101 @@
+#ifndef FLUIDSOLVER3D_HPP_
+#define FLUIDSOLVER3D_HPP_
+
+#include "Matrix3D.hpp"
+#include "ThreadPool.hpp"
+#include "LinearSolver.hpp"
+#include "../config.hpp"
+
+/**
+ * This class implements the same stable fluids steps as FluidSolver2D
+ * (addSource, diffuse, advect, project, setBnd) over 3D grids, without
+ * obstacles: the fluid fills a box of i x j x k cells, border included.
+ *
+ * The cell (i, j, k) of a field is the cell (k, j, i) of its Matrix3D, at
+ * (k.(N_j + 2) + j).(N_i + 2) + i: a field is a stack of N_k + 2 planes of
+ * N_j + 2 rows of N_i + 2 cells. The kernels walk it as a 2D grid of rows,
+ * whose neighbours in the planes before and after are P = (N_i + 2).(N_j + 2)
+ * cells away: the relaxations have their own 7-point row kernel (see
+ * Stencil), the divergence and the gradient add the third component to
+ * the row kernels of the 2D solver. The planes are split between the threads,
+ * and the rows of each slab of planes are walked tile after tile (see
+ * Tiling), so that the three planes a 7-point stencil keeps in use fit in
+ * the cache.
+ *
+ * The linear systems are solved with red-black relaxations, the only
+ * method of the 2D solver which runs on all the threads without obstacles
+ * to handle; the boundary conditions are applied after each sweep.
+ */
+
+template <typename T>
+class FluidSolver3D{
+public:
+  typedef Matrix3D<T> Matrix;
+
+  FluidSolver3D(unsigned int i, unsigned int j, unsigned int k); // Designed for testing
+  FluidSolver3D(unsigned int i, unsigned int j, unsigned int k, Config &config);
+  ~FluidSolver3D();
+
+  void velStep (Matrix *u, Matrix *v, Matrix *w, Matrix *u0, Matrix *v0, Matrix *w0,
+                T visc, T dt);
+  void densStep (Matrix *x, Matrix *x0, Matrix *u, Matrix *v, Matrix *w, T diff, T dt);
+  void step (T visc, T diff, T dt);
+  void injectSources();
+
+  void reset();
+  void resetFluid();
+  void resetSources();
+
+  void setThreads(unsigned int nbThreads);
+  void setTolerance(float tolerance);
+  void setIterations(unsigned int min, unsigned int max);
+  void setWarmStart(bool warmStart);
+  inline const SolverStats &getPressureStats() const{
+    return _pressureStats;
+  }
+  inline const SolverStats &getDiffusionStats() const{
+    return _diffusionStats;
+  }
+
+  //private:
+  void init(unsigned int i, unsigned int j, unsigned int k);
+  inline void addSource ( Matrix &x, Matrix &s, T dt ){
+    x = x + dt * s;
+  }
+  SolverStats diffuse ( int b, Matrix &x, Matrix &x0, T diff, T dt);
+  SolverStats diffuseVelocity ( Matrix &u, Matrix &v, Matrix &w,
+                                Matrix &u0, Matrix &v0, Matrix &w0, T visc, T dt);
+  void advect ( int b, Matrix &d, Matrix &d0, Matrix &u, Matrix &v, Matrix &w, T dt);
+  void advectVelocity ( Matrix &u, Matrix &v, Matrix &w,
+                        Matrix &u0, Matrix &v0, Matrix &w0, T dt);
+  SolverStats project ( Matrix &u, Matrix &v, Matrix &w, Matrix &p, Matrix &div);
+  void removeMean ( Matrix &x );
+  void setBnd ( int b, Matrix &x );
+  SolverStats relaxRedBlack ( Matrix **x, Matrix **x0, const int *b, unsigned int nbFields,
+                              T a, T c);
+  void relaxRedBlackSweep ( Matrix **x, Matrix **x0, unsigned int nbFields, T a, T c);
+  float relativeResidual ( int b, Matrix &x, Matrix &x0, T a, T c);
+  template <class RowFunction>
+  void forEachRow ( unsigned int nbFields, RowFunction row );
+  inline bool residualCheckDue ( unsigned int sweeps ) const{
+    return sweeps >= _minIterations && _minIterations < _maxIterations;
+  }
+
+  unsigned int _N_i, _N_j, _N_k; // interior cells along each axis
+  Matrix *_u, *_v, *_w, *_u_prev, *_v_prev, *_w_prev;
+  Matrix *_dens, *_dens_prev;
+  Matrix *_u_vel_src, *_v_vel_src, *_w_vel_src, *_dens_src;
+  // pressures of the projections after the advection and after the
+  // diffusion, kept from one step to the next
+  Matrix *_pressure, *_pressure_diff;
+  // fluid mask of a row for the 2D row kernels: ~0 on the interior cells
+  unsigned int *_fluidRow;
+
+  ThreadPool *_pool;
+  float _tolerance;
+  unsigned int _minIterations, _maxIterations; // sweeps of the relaxations
+  bool _warmStart; // projections start from the previous pressure
+  SolverStats _pressureStats, _diffusionStats; // of the last solves
+};
+
+#endif
@@ -0,0 +1,32 @@
+#include "LinearSolver.hpp"
+#include <stdexcept>
+
+static const char *names[] = {
+  "gaussseidel",
+  "redblack",
+  "multigrid",
+  "pcg",
+  "iccg"
+};
+static const unsigned int nbNames = sizeof(names) / sizeof(names[0]);
+
+/**
+ * Returns the linear solver matching a name, as written in the
+ * configuration file or on the command line.
+ *
+ * @param name Name of the solver
+ */
+LinearSolver linearSolverFromName(const std::string &name){
+  for (unsigned int k = 0; k < nbNames; k++)
+    if (name == names[k])
+      return (LinearSolver) k;
+  throw(std::invalid_argument(std::string("Unknown linear solver '")
+                              + name + "'"));
+}
+
+/**
+ * Returns the name of a linear solver.
+ */
+const char *linearSolverName(LinearSolver solver){
+  return names[solver];
+}
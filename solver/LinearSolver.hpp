@@ -0,0 +1,31 @@
+#ifndef LINEARSOLVER_HPP_
+#define LINEARSOLVER_HPP_
+
+#include <string>
+
+/**
+ * Methods available to solve the linear systems of the diffusion and
+ * projection steps.
+ */
+enum LinearSolver {
+  SOLVER_GAUSS_SEIDEL, // in place, lexicographic order (reference)
+  SOLVER_RED_BLACK,    // in place, red-black order, multithreaded
+  SOLVER_MULTIGRID,    // V-cycles, pressure only (red-black for diffusion)
+  SOLVER_PCG,          // conjugate gradient, Jacobi preconditioner
+  SOLVER_ICCG          // conjugate gradient, incomplete Cholesky preconditioner
+};
+
+/**
+ * Outcome of a linear solve: number of iterations (or cycles) run, and
+ * residual norm relative to the norm of the right hand side (negative
+ * when the solver does not measure it).
+ */
+struct SolverStats {
+  unsigned int iterations;
+  float residual;
+};
+
+LinearSolver linearSolverFromName(const std::string &name);
+const char *linearSolverName(LinearSolver solver);
+
+#endif
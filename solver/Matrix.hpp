@@ -4,194 +4,240 @@
 #include <iostream>
 #include <fstream>
 #include <iomanip> // setprecision
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "Aligned.hpp"
+#include "Expression.hpp"
 
-// Necessary declarations for friendly fonctions
-template <typename T, unsigned int N>
-class Matrix;
-
-// Some operators
-template<typename T, unsigned int N>
-Matrix<T, N> &operator+ (const Matrix<T, N> &a, const Matrix<T, N> &b);
-template<typename T, unsigned int N>
-Matrix<T, N> &operator- (const Matrix<T, N> &a, const Matrix<T, N> &b);
-template<typename T, unsigned int N>
-std::ostream &operator<<  (std::ostream &stream, const Matrix<T, N> &toPrint);
-
-// Class definition
+/**
+ * N-dimensional matrix of values of type T, stored densely with the last
+ * coordinate running fastest, in a block aligned on MEMORY_ALIGN.
+ *
+ * The element-wise arithmetic goes through expression templates (see
+ * Expression): the operators between matrices and scalars build an
+ * expression, evaluated cell by cell in a single loop when it is assigned
+ * to a matrix, so that
+ *
+ *   a = a + dt * b;
+ *
+ * reads a and b once and allocates nothing. The matrices of an expression
+ * must have the same sizes: the assignment throws std::invalid_argument
+ * when their numbers of cells differ.
+ */
 template <typename T, unsigned int N>
-class Matrix {
+class Matrix : public Expression<T, Matrix<T, N> > {
 protected:
   T *m_values;
   unsigned int m_size[N];
   unsigned int m_length;
-  
+
   unsigned int toIndex(const unsigned int coordinates[N]) const;
-  virtual unsigned int *toCoordinates(const unsigned int &index) const; 
+  void toCoordinates(unsigned int index, unsigned int coordinates[N]) const;
   bool checkCoordinates(const unsigned int coordinates[N]) const;
   bool checkSizes(const Matrix<T, N> &m) const;
-  
+
+  template <class E>
+  void checkLength(const Expression<T, E> &e) const;
+
 public:
   Matrix(const unsigned int size[N]);
   Matrix(const Matrix<T, N> &toCopy);
-  virtual ~Matrix();
-  
-  unsigned int *getSize() const;
-  unsigned int getSize(unsigned int dimension) const;
+  ~Matrix();
 
-  void fill(const T &value);
+  inline const unsigned int *getSize() const{
+    return m_size;
+  }
+
+  inline unsigned int getSize(const unsigned int dimension) const{
+    return m_size[dimension];
+  }
 
-  void load(char *file);
-  void save(char *file) const;
+  inline unsigned int getLength() const{
+    return m_length;
+  }
+
+  /**
+   * Returns the first cell: the cell of the coordinates c is at
+   * (...(c[0] * size[1] + c[1]) * size[2] + ...) + c[N - 1].
+   */
+  inline T *getArray(){
+    return m_values;
+  }
+
+  inline const T *getArray() const{
+    return m_values;
+  }
+
+  void fill(const T value);
+
+  void load(const char *file);
+  void save(const char *file) const;
 
   Matrix<T, N> &operator= (const Matrix<T, N> &toCopy);
-  T& operator() (const unsigned int coordinates[N]);        // setter
-  T operator() (const unsigned int coordinates[N]) const;   // getter
-
-  // Operators .= with another matrix :
-  Matrix<T, N> &operator+= (const Matrix<T, N> &toAdd);
-  Matrix<T, N> &operator-= (const Matrix<T, N> &toSub);
-  
-  // Operators .= with a scalar :
-  Matrix<T, N> &operator+= (const T &toAdd);
-  Matrix<T, N> &operator-= (const T &toSub);
-  Matrix<T, N> &operator*= (const T &toMul);
-  Matrix<T, N> &operator/= (const T &toDiv);
-
-  // Basic operations with a scalar :
-  Matrix<T, N> &operator+ (const T &toAdd);
-  Matrix<T, N> &operator- (const T &toSub);
-  Matrix<T, N> &operator* (const T &toMul);
-  Matrix<T, N> &operator/ (const T &toDiv);
-
-  // Addition and substraction between martices :
-  friend Matrix<T, N> &(::operator+ <>) (const Matrix<T, N> &a, const Matrix<T, N> &b);
-  friend Matrix<T, N> &(::operator- <>) (const Matrix<T, N> &a, const Matrix<T, N> &b);
-
-  
-  friend std::ostream &(::operator<< <>) (std::ostream &stream, const Matrix<T, N> &toPrint);
+
+  inline T &operator() (const unsigned int coordinates[N]){        // setter
+    return m_values[toIndex(coordinates)];
+  }
+
+  inline T operator() (const unsigned int coordinates[N]) const{   // getter
+    return m_values[toIndex(coordinates)];
+  }
+
+  // Cell k of the storage, the leaf of the expressions
+  inline T &operator[] (const unsigned int k){
+    return m_values[k];
+  }
+
+  inline T operator[] (const unsigned int k) const{
+    return m_values[k];
+  }
+
+  inline unsigned int length() const{
+    return m_length;
+  }
+
+  // Assignments of an expression, in one loop
+  template <class E>
+  Matrix<T, N> &operator= (const Expression<T, E> &e);
+  template <class E>
+  Matrix<T, N> &operator+= (const Expression<T, E> &e);
+  template <class E>
+  Matrix<T, N> &operator-= (const Expression<T, E> &e);
+  template <class E>
+  Matrix<T, N> &operator*= (const Expression<T, E> &e);
+  template <class E>
+  Matrix<T, N> &operator/= (const Expression<T, E> &e);
+
+  // Operators .= with a scalar
+  Matrix<T, N> &operator+= (const T toAdd);
+  Matrix<T, N> &operator-= (const T toSub);
+  Matrix<T, N> &operator*= (const T toMul);
+  Matrix<T, N> &operator/= (const T toDiv);
 };
 
+template <typename T, unsigned int N>
+std::ostream &operator<< (std::ostream &stream, const Matrix<T, N> &toPrint);
+
 
 /********************************************************************/
-/*                 Implementation of private methods                   */
+/*               Implementation of protected methods                */
 /********************************************************************/
-template<typename T, unsigned int N>
+template <typename T, unsigned int N>
+inline
 unsigned int Matrix<T, N>::toIndex(const unsigned int coordinates[N]) const{
-  unsigned int index(0);
-  
-  for(unsigned int i(0); i < N - 1; i++)
-    index = (index + coordinates[i])*m_size[i + 1];
-  
-  return index + coordinates[N - 1];
+  unsigned int index = coordinates[0];
+
+  for (unsigned int d = 1; d < N; d++)
+    index = index * m_size[d] + coordinates[d];
+
+  return index;
 }
 
-template<typename T, unsigned int N>
-unsigned int *Matrix<T, N>::toCoordinates(const unsigned int &index) const{
-  unsigned int *coordinates = new unsigned int[N];
-  unsigned int tmp_index = index, tmp_prod = 1;
-  
-  for(unsigned int i(1); i < N; i++)
-    tmp_prod *= m_size[i];
-  
-  for(unsigned int i(1); i < N; i++){
-    coordinates[i - 1] = tmp_index/tmp_prod;
-    tmp_index %= tmp_prod;
-    tmp_prod /= m_size[i];
+/**
+ * Coordinates of the cell index, written into coordinates.
+ */
+template <typename T, unsigned int N>
+void Matrix<T, N>::toCoordinates(unsigned int index, unsigned int coordinates[N]) const{
+  for (unsigned int d = N; d-- > 0; ){
+    coordinates[d] = index % m_size[d];
+    index /= m_size[d];
   }
-  
-  return coordinates;
 }
 
-template<typename T, unsigned int N>
+template <typename T, unsigned int N>
 bool Matrix<T, N>::checkCoordinates(const unsigned int coordinates[N]) const{
-  for(int i(0); i < N; i++)
-    if(coordinates[i] < 0 || m_size[i] <= coordinates[i])
+  for (unsigned int d = 0; d < N; d++)
+    if (m_size[d] <= coordinates[d])
       return false;
-  
+
   return true;
 }
 
-template<typename T, unsigned int N>
+template <typename T, unsigned int N>
 bool Matrix<T, N>::checkSizes(const Matrix<T, N> &m) const{
-  for(unsigned int i(0); i < m_length; i++)
-    if(m.m_size[i] != m_size[i])
+  for (unsigned int d = 0; d < N; d++)
+    if (m.m_size[d] != m_size[d])
       return false;
-  
+
   return true;
 }
 
+/**
+ * Throws std::invalid_argument unless e has as many cells as the matrix
+ * (or is a scalar).
+ */
+template <typename T, unsigned int N>
+template <class E>
+inline
+void Matrix<T, N>::checkLength(const Expression<T, E> &e) const{
+  const unsigned int length = e.length();
+  if (length != 0 && length != m_length)
+    throw(std::invalid_argument("Matrix: the matrices of the expression do not have the same size"));
+}
 
 
 /********************************************************************/
 /*               Implementation of public methods                   */
 /********************************************************************/
-template<typename T, unsigned int N>
-Matrix<T, N>::Matrix(const unsigned int size[N]): m_length(1){
-  for(unsigned int i(0); i < N; i++){
-    m_size[i] = size[i];
-    m_length *= size[i];
-  }
 
-  m_values = new T[m_length];
-  for(unsigned int i(0); i < m_length; i++){
-    m_values[i] = 0;
+/**
+ * Constructor: allocates a zeroed matrix of the given sizes.
+ */
+template <typename T, unsigned int N>
+Matrix<T, N>::Matrix(const unsigned int size[N]) : m_length(1){
+  for (unsigned int d = 0; d < N; d++){
+    m_size[d] = size[d];
+    m_length *= size[d];
   }
+
+  m_values = alignedNew<T>(m_length);
 }
 
-template<typename T, unsigned int N>
-Matrix<T, N>::Matrix(const Matrix<T, N> &toCopy) {
-  unsigned int i;
-  for(i=0; i < N; i++){
-    m_size[i] = toCopy.m_size[i];
-  }
-  m_length = toCopy.m_length;
-  m_values = new T[m_length];
+template <typename T, unsigned int N>
+Matrix<T, N>::Matrix(const Matrix<T, N> &toCopy) :
+  Expression<T, Matrix<T, N> >(), m_length(toCopy.m_length)
+{
+  for (unsigned int d = 0; d < N; d++)
+    m_size[d] = toCopy.m_size[d];
+
+  m_values = alignedNew<T>(m_length);
+  std::copy(toCopy.m_values, toCopy.m_values + m_length, m_values);
 }
 
-// Destructor
-template<typename T, unsigned int N>
+template <typename T, unsigned int N>
 Matrix<T, N>::~Matrix(){
-  delete[](m_values);
+  alignedDelete(m_values);
 }
 
-template<typename T, unsigned int N>
+/**
+ * Copies the values of toCopy, which must have the same sizes.
+ */
+template <typename T, unsigned int N>
 Matrix<T, N> &Matrix<T, N>::operator= (const Matrix<T, N> &toCopy){
-  if(this == &toCopy)
+  if (this == &toCopy)
     return *this;
-  
-  // TODO throw exception if toCopy.m_size != this.m_size
-
-  // 1) allocate new memory and copy elements
-  T *new_values = new T[toCopy.m_length];
-  new_values = toCopy.m_values;
-  
-  // 2) delete old memory
-  delete [] m_values;
-  
-  // 3) assign the new memory to the object
-  m_values = new_values;
-  
-  return *this;
-}
 
-// Setter
-template<typename T, unsigned int N>
-inline
-T& Matrix<T, N>::operator() (const unsigned int coordinates[N]){
-  return m_values[toIndex(coordinates)];
+  if (!checkSizes(toCopy))
+    throw(std::invalid_argument("Matrix: cannot assign a matrix of another size"));
+
+  std::copy(toCopy.m_values, toCopy.m_values + m_length, m_values);
+  return *this;
 }
 
-// Getter
-template<typename T, unsigned int N>
-inline
-T Matrix<T, N>::operator() (const unsigned int coordinates[N]) const{
-  return m_values[toIndex(coordinates)];
+template <typename T, unsigned int N>
+void Matrix<T, N>::fill(const T value){
+  std::fill(m_values, m_values + m_length, value);
 }
 
+/*
+ * The files hold the number of dimensions, the number of cells and then
+ * the cells, in the order of the storage. load throws std::invalid_argument
+ * when they do not match the matrix.
+ */
 
-// File IO
-template<typename T, unsigned int N>
-void Matrix<T, N>::load(char *file){
+template <typename T, unsigned int N>
+void Matrix<T, N>::load(const char *file){
   std::ifstream input;
   input.open(file, std::ios::in | std::ios::binary);
 
@@ -200,17 +246,17 @@ void Matrix<T, N>::load(char *file){
   input.read((char *) &n, sizeof(unsigned int));
   input.read((char *) &l, sizeof(unsigned int));
   if (n != N || l != m_length){
-    // TODO: exception
     input.close();
-    return;
+    throw(std::invalid_argument(std::string("Matrix: the file '") + file
+                                + "' does not hold a matrix of this size"));
   }
 
   input.read((char *) m_values, sizeof(T) * m_length);
   input.close();
 }
 
-template<typename T, unsigned int N>
-void Matrix<T, N>::save(char *file) const{
+template <typename T, unsigned int N>
+void Matrix<T, N>::save(const char *file) const{
   std::ofstream output;
   output.open(file, std::ios::out | std::ios::binary);
 
@@ -225,149 +271,114 @@ void Matrix<T, N>::save(char *file) const{
 }
 
 
-/**
- * Returns the size of the matrix as an array
- */
-template<typename T, unsigned int N>
-inline
-unsigned int *Matrix<T, N>::getSize() const{
-  return m_size;
-}
+/********************************************************************/
+/*            Implementation of assignments of expressions          */
+/********************************************************************/
 
-/**
- * Returns the size of the matrix for a given dimension
+/*
+ * Each cell of the matrix only depends on the same cell of the operands,
+ * so the matrix may appear in the expression assigned to it.
  */
-template<typename T, unsigned int N>
-inline
-unsigned int Matrix<T, N>::getSize(unsigned int dimension) const{
-  return m_size[dimension];
-}
 
-/**
- * Fills the matrix with a given value.
- */
-template<typename T, unsigned int N>
-inline
-void Matrix<T, N>::fill(const T &value){
-  memset(m_values, value, m_length*sizeof(T));
-}
-  
-/********************************************************************/
-/*       Implementation of .= operators with another matrix         */
-/********************************************************************/
-template<typename T, unsigned int N>
-Matrix<T, N> &Matrix<T, N>::operator+= (const Matrix<T, N> &toAdd){
-  // TODO throw exception if toAdd.m_size != this.m_size
-  
-  for(unsigned int i(0); i < m_length; i++)
-    m_values[i] += toAdd.m_values[i];
-  
-  return *this;
-}
+template <typename T, unsigned int N>
+template <class E>
+Matrix<T, N> &Matrix<T, N>::operator= (const Expression<T, E> &e){
+  checkLength(e);
+  const E &expression = e.self();
+  for (unsigned int k = 0; k < m_length; k++)
+    m_values[k] = expression[k];
 
-template<typename T, unsigned int N>
-Matrix<T, N> &Matrix<T, N>::operator-= (const Matrix<T, N> &toSub){
-  // TODO throw exception if toAdd.m_size != this.m_size
-  
-  for(unsigned int i(0); i < m_length; i++)
-    m_values[i] -= toSub.m_values[i];
-  
   return *this;
 }
 
-/********************************************************************/
-/*          Implementation of .= operators with a scalar            */
-/********************************************************************/
-template<typename T, unsigned int N>
-Matrix<T, N> &Matrix<T, N>::operator+= (const T &toAdd){
-  for(unsigned int i(0); i < m_length; i++)
-    m_values[i] += toAdd;
-  
+template <typename T, unsigned int N>
+template <class E>
+Matrix<T, N> &Matrix<T, N>::operator+= (const Expression<T, E> &e){
+  checkLength(e);
+  const E &expression = e.self();
+  for (unsigned int k = 0; k < m_length; k++)
+    m_values[k] += expression[k];
+
   return *this;
 }
 
-template<typename T, unsigned int N>
-Matrix<T, N> &Matrix<T, N>::operator-= (const T &toSub){
-  for(unsigned int i(0); i < m_length; i++)
-    m_values[i] -= toSub;
-  
+template <typename T, unsigned int N>
+template <class E>
+Matrix<T, N> &Matrix<T, N>::operator-= (const Expression<T, E> &e){
+  checkLength(e);
+  const E &expression = e.self();
+  for (unsigned int k = 0; k < m_length; k++)
+    m_values[k] -= expression[k];
+
   return *this;
 }
 
-template<typename T, unsigned int N>
-Matrix<T, N> &Matrix<T, N>::operator*= (const T &toMul){
-  for(unsigned int i(0); i < m_length; i++)
-    m_values[i] *= toMul;
-  
+template <typename T, unsigned int N>
+template <class E>
+Matrix<T, N> &Matrix<T, N>::operator*= (const Expression<T, E> &e){
+  checkLength(e);
+  const E &expression = e.self();
+  for (unsigned int k = 0; k < m_length; k++)
+    m_values[k] *= expression[k];
+
   return *this;
 }
 
-template<typename T, unsigned int N>
-Matrix<T, N> &Matrix<T, N>::operator/= (const T &toDiv){
-  for(unsigned int i(0); i < m_length; i++)
-    m_values[i] /= toDiv;
-  
+template <typename T, unsigned int N>
+template <class E>
+Matrix<T, N> &Matrix<T, N>::operator/= (const Expression<T, E> &e){
+  checkLength(e);
+  const E &expression = e.self();
+  for (unsigned int k = 0; k < m_length; k++)
+    m_values[k] /= expression[k];
+
   return *this;
 }
 
+
 /********************************************************************/
-/*        Implementation of basic operators with a scalar           */
+/*          Implementation of .= operators with a scalar            */
 /********************************************************************/
-template<typename T, unsigned int N>
+template <typename T, unsigned int N>
 inline
-Matrix<T, N> &Matrix<T, N>::operator+ (const T &toAdd){
-  return *this += toAdd;
+Matrix<T, N> &Matrix<T, N>::operator+= (const T toAdd){
+  return *this += ScalarExpression<T>(toAdd);
 }
 
-template<typename T, unsigned int N>
+template <typename T, unsigned int N>
 inline
-Matrix<T, N> &Matrix<T, N>::operator- (const T &toSub){
-  return *this -= toSub;
+Matrix<T, N> &Matrix<T, N>::operator-= (const T toSub){
+  return *this -= ScalarExpression<T>(toSub);
 }
 
-template<typename T, unsigned int N>
+template <typename T, unsigned int N>
 inline
-Matrix<T, N> &Matrix<T, N>::operator* (const T &toMul){
-  return *this *= toMul;
+Matrix<T, N> &Matrix<T, N>::operator*= (const T toMul){
+  return *this *= ScalarExpression<T>(toMul);
 }
 
-template<typename T, unsigned int N>
+template <typename T, unsigned int N>
 inline
-Matrix<T, N> &Matrix<T, N>::operator/ (const T &toDiv){
-  return *this /= toDiv;
-}
-
-
-/********************************************************************/
-/*           Addition and Substraction between matrices             */
-/********************************************************************/
-template<typename T, unsigned int N>
-Matrix<T, N> &operator+ (const Matrix<T, N> &a, const Matrix<T, N> &b){
-  Matrix<T, N> copy(a);
-  return copy += b;
-}
-
-template<typename T, unsigned int N>
-Matrix<T, N> &operator- (const Matrix<T, N> &a, const Matrix<T, N> &b){
-  Matrix<T, N> copy(a);
-  return copy -= b;
+Matrix<T, N> &Matrix<T, N>::operator/= (const T toDiv){
+  return *this /= ScalarExpression<T>(toDiv);
 }
 
 
 // Stream operator (only for 2 dimensions matrices)
-template<typename T, unsigned int N>
+template <typename T, unsigned int N>
 std::ostream &operator<< (std::ostream &stream, const Matrix<T, N> &toPrint){
-  if(N != 2){
-    stream << "Cette matrice est de dimension " << N << "." << std::endl;
+  if (N != 2){
+    stream << "This matrix has " << N << " dimensions." << std::endl;
     return stream;
   }
-  
-  for(  unsigned int coordinates[2] = {0}; coordinates[0] < toPrint.m_size[0]; coordinates[0]++){
-    for(coordinates[1] = 0; coordinates[1] < toPrint.m_size[1]; coordinates[1]++)
-      stream << std::fixed << std::setprecision(3) << toPrint.m_values[toPrint.toIndex(coordinates)] << " ";
+
+  const T *values = toPrint.getArray();
+  for (unsigned int i = 0; i < toPrint.getSize(0); i++){
+    for (unsigned int j = 0; j < toPrint.getSize(1); j++)
+      stream << std::fixed << std::setprecision(3) << values[i * toPrint.getSize(1) + j] << " ";
     stream << std::endl;
   }
-  
+
   return stream;
 }
 
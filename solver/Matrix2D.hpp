@@ -5,27 +5,36 @@
 #include <iomanip> // setprecision
 #include "Matrix.hpp"
 
-// Ne pas modifier !!!
-#define DIMENSION 2
-
-// Class definition
+/**
+ * Matrix of 2 dimensions, with the cell (i, j) at i * getSize(1) + j.
+ */
 template <typename T>
-class Matrix2D : public Matrix<T, DIMENSION> {
+class Matrix2D : public Matrix<T, 2> {
 public:
-  Matrix2D(const unsigned int size[DIMENSION]);
+  Matrix2D(const unsigned int size[2]);
   Matrix2D(const Matrix2D<T> &toCopy);
 
+  Matrix2D<T> &operator= (const Matrix2D<T> &toCopy);
+  using Matrix<T, 2>::operator=;
+  using Matrix<T, 2>::operator();
+
   inline unsigned int toIndex(const unsigned int i, const unsigned int j) const;
   inline T& operator() (const unsigned int i, const unsigned int j);        // setter
   inline T operator() (const unsigned int i, const unsigned int j) const;   // getter
 };
 
 template<typename T>
-Matrix2D<T>::Matrix2D(const unsigned int size[DIMENSION]): Matrix<T, DIMENSION>(size){
+Matrix2D<T>::Matrix2D(const unsigned int size[2]): Matrix<T, 2>(size){
+}
+
+template<typename T>
+Matrix2D<T>::Matrix2D(const Matrix2D<T> &toCopy): Matrix<T, 2>(toCopy){
 }
 
 template<typename T>
-Matrix2D<T>::Matrix2D(const Matrix2D<T> &toCopy): Matrix<T, DIMENSION>(toCopy.m_size){
+Matrix2D<T> &Matrix2D<T>::operator= (const Matrix2D<T> &toCopy){
+  Matrix<T, 2>::operator=(toCopy);
+  return *this;
 }
 
 template<typename T>
@@ -5,41 +5,52 @@
 #include <iomanip> // setprecision
 #include "Matrix.hpp"
 
-// Ne pas modifier !!!
-#define DIMENSION 3
-
-// Class definition
+/**
+ * Matrix of 3 dimensions, with the cell (i, j, k) at
+ * (i * getSize(1) + j) * getSize(2) + k.
+ */
 template <typename T>
-class Matrix3D : Matrix<T, DIMENSION> {
+class Matrix3D : public Matrix<T, 3> {
 public:
-  Matrix3D(const unsigned int size[N]);
+  Matrix3D(const unsigned int size[3]);
   Matrix3D(const Matrix3D<T> &toCopy);
 
+  Matrix3D<T> &operator= (const Matrix3D<T> &toCopy);
+  using Matrix<T, 3>::operator=;
+  using Matrix<T, 3>::operator();
+
   inline unsigned int toIndex(const unsigned int i, const unsigned int j, const unsigned int k) const;
   inline T& operator() (const unsigned int i, const unsigned int j, const unsigned int k);        // setter
   inline T operator() (const unsigned int i, const unsigned int j, const unsigned int k) const;   // getter
 };
 
 template<typename T>
-Matrix3D<T>::Matrix3D(const unsigned int size[DIMENSION]): Matrix<T, DIMENSION>(size){
+Matrix3D<T>::Matrix3D(const unsigned int size[3]): Matrix<T, 3>(size){
+}
+
+template<typename T>
+Matrix3D<T>::Matrix3D(const Matrix3D<T> &toCopy): Matrix<T, 3>(toCopy){
 }
 
 template<typename T>
-Matrix3D<T>::Matrix3D(const Matrix3D<T> &toCopy): Matrix<T, DIMENSION>(size){
+Matrix3D<T> &Matrix3D<T>::operator= (const Matrix3D<T> &toCopy){
+  Matrix<T, 3>::operator=(toCopy);
+  return *this;
 }
 
 template<typename T>
 unsigned int Matrix3D<T>::toIndex(const unsigned int i, const unsigned int j, const unsigned int k) const{
-  return i*m_size[1] + j*m_size[1]*m_size[2] + k;
+  return (i * this->m_size[1] + j) * this->m_size[2] + k;
 }
 
 template<typename T>
-T &Matrix3D<T>::operator() (const unsigned int i, const unsigned int j, const unsigned int k) const{
-  return m_values[toIndex(i, j)];
+T &Matrix3D<T>::operator() (const unsigned int i, const unsigned int j, const unsigned int k){
+  return this->m_values[toIndex(i, j, k)];
 }
 
 template<typename T>
 T Matrix3D<T>::operator() (const unsigned int i, const unsigned int j, const unsigned int k) const{
-  return m_values[toIndex(i, j)];
+  return this->m_values[toIndex(i, j, k)];
 }
 
+#endif
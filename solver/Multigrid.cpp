@@ -0,0 +1,303 @@
+#include "Multigrid.hpp"
+#include <cmath>
+
+#define MULTIGRID_COARSEST_SIZE 4  // no level smaller than this
+#define MULTIGRID_PRE_SWEEPS    2  // smoothing before the coarse correction
+#define MULTIGRID_POST_SWEEPS   2  // smoothing after the coarse correction
+#define MULTIGRID_COARSE_SWEEPS 30 // smoothing on the coarsest level
+
+/**
+ * Constructor: allocates the hierarchy of levels.
+ *
+ * @param width Width of the finest matrices, border included
+ * @param height Height of the finest matrices, border included
+ * @param pool Threads used by the smoother
+ */
+template <typename T>
+Multigrid<T>::Multigrid(unsigned int width, unsigned int height, ThreadPool &pool)
+  : _pool(pool), _obstaclesVersion(0)
+{
+  unsigned int N_i = width - 2, N_j = height - 2;
+  for (;;){
+    Level l;
+    l.N_i = N_i;
+    l.N_j = N_j;
+    const bool finest = _levels.empty();
+    l.x   = finest ? NULL : new ScalarMatrix2D<T>(N_i + 2, N_j + 2);
+    l.rhs = finest ? NULL : new ScalarMatrix2D<T>(N_i + 2, N_j + 2);
+    l.res = new ScalarMatrix2D<T>(N_i + 2, N_j + 2);
+    l.W = l.res->getStride();
+    l.fluid.assign(l.W * (N_j + 2), 0);
+    l.mean = 0;
+    _levels.push_back(l);
+
+    if (N_i <= MULTIGRID_COARSEST_SIZE || N_j <= MULTIGRID_COARSEST_SIZE)
+      break;
+    N_i = (N_i + 1) / 2;
+    N_j = (N_j + 1) / 2;
+  }
+}
+
+template <typename T>
+Multigrid<T>::~Multigrid(){
+  for (unsigned int k = 0; k < _levels.size(); k++){
+    if (k > 0){
+      delete _levels[k].x;
+      delete _levels[k].rhs;
+    }
+    delete _levels[k].res;
+  }
+}
+
+/**
+ * Solves the pressure equation with V-cycles, starting from the current
+ * content of x, until the residual norm is below tolerance times the norm
+ * of rhs. Only the fluid cells of x are written: the caller still has to
+ * apply the boundary conditions.
+ *
+ * @param x unknown, also used as the initial guess
+ * @param rhs right hand side
+ * @param obstacles obstacles of the fluid
+ * @param tolerance relative residual wanted
+ * @param maxCycles maximum number of V-cycles
+ */
+template <typename T>
+SolverStats Multigrid<T>::solve(ScalarMatrix2D<T> &x, ScalarMatrix2D<T> &rhs,
+                                const Obstacles &obstacles,
+                                float tolerance, unsigned int maxCycles){
+  _levels[0].x = &x;
+  _levels[0].rhs = &rhs;
+  if (obstacles.getVersion() != _obstaclesVersion)
+    buildMasks(obstacles);
+
+  SolverStats stats;
+  stats.iterations = 0;
+
+  _levels[0].mean = mean(_levels[0], rhs);
+  const double rhsNorm = norm(_levels[0], rhs);
+  double resNorm = residual(_levels[0]);
+  while (stats.iterations < maxCycles && resNorm > tolerance * rhsNorm){
+    vCycle(0);
+    resNorm = residual(_levels[0]);
+    stats.iterations++;
+  }
+  stats.residual = rhsNorm > 0 ? resNorm / rhsNorm : 0;
+  return stats;
+}
+
+/**
+ * Computes the fluid cells of every level from the obstacles.
+ */
+template <typename T>
+void Multigrid<T>::buildMasks(const Obstacles &obstacles){
+  Level &finest = _levels[0];
+  const unsigned int W = finest.W;
+  const unsigned char *cells = obstacles.getCells();
+  for (unsigned int j = 1; j <= finest.N_j; j++)
+    for (unsigned int i = 1; i <= finest.N_i; i++)
+      finest.fluid[j * W + i] = (cells[j * W + i] == Obstacles::CELL_FLUID);
+
+  for (unsigned int k = 1; k < _levels.size(); k++){
+    const Level &fine = _levels[k - 1];
+    Level &coarse = _levels[k];
+    const unsigned int Wf = fine.W, Wc = coarse.W;
+    for (unsigned int J = 1; J <= coarse.N_j; J++){
+      for (unsigned int I = 1; I <= coarse.N_i; I++){
+        unsigned char fluid = 0;
+        for (unsigned int j = 2 * J - 1; j <= 2 * J && j <= fine.N_j; j++)
+          for (unsigned int i = 2 * I - 1; i <= 2 * I && i <= fine.N_i; i++)
+            fluid |= fine.fluid[j * Wf + i];
+        coarse.fluid[J * Wc + I] = fluid;
+      }
+    }
+  }
+  _obstaclesVersion = obstacles.getVersion();
+}
+
+/**
+ * Red-black Gauss-Seidel sweeps on a level, rows split between threads.
+ */
+template <typename T>
+void Multigrid<T>::smooth(Level &l, unsigned int sweeps){
+  const unsigned int W = l.W;
+  T *x = l.x->getArray();
+  const T *rhs = l.rhs->getArray();
+  const unsigned char *fluid = &l.fluid[0];
+
+  for (unsigned int s = 0; s < sweeps; s++){
+    for (unsigned int color = 0; color < 2; color++){
+      _pool.parallelFor(1, l.N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+          for (unsigned int j = jBegin; j < jEnd; j++){
+            for (unsigned int i = 1 + ((1 + j + color) & 1); i <= l.N_i; i += 2){
+              const unsigned int k = j * W + i;
+              if (!fluid[k])
+                continue;
+              const unsigned int n = fluid[k-1] + fluid[k+1] + fluid[k-W] + fluid[k+W];
+              if (n == 0)
+                continue;
+              const T sum = fluid[k-1] * x[k-1] + fluid[k+1] * x[k+1]
+                + fluid[k-W] * x[k-W] + fluid[k+W] * x[k+W];
+              x[k] = (rhs[k] - l.mean + sum) / n;
+            }
+          }
+        });
+    }
+  }
+}
+
+/**
+ * Computes the residual of a level and returns its norm.
+ */
+template <typename T>
+double Multigrid<T>::residual(Level &l){
+  const unsigned int W = l.W;
+  const T *x = l.x->getArray();
+  const T *rhs = l.rhs->getArray();
+  T *res = l.res->getArray();
+  const unsigned char *fluid = &l.fluid[0];
+  std::vector<double> rowNorms(l.N_j + 2, 0); // summed in order afterwards
+
+  _pool.parallelFor(1, l.N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+      for (unsigned int j = jBegin; j < jEnd; j++){
+        double partial = 0;
+        for (unsigned int i = 1; i <= l.N_i; i++){
+          const unsigned int k = j * W + i;
+          if (!fluid[k]){
+            res[k] = 0;
+            continue;
+          }
+          const unsigned int n = fluid[k-1] + fluid[k+1] + fluid[k-W] + fluid[k+W];
+          const T sum = fluid[k-1] * x[k-1] + fluid[k+1] * x[k+1]
+            + fluid[k-W] * x[k-W] + fluid[k+W] * x[k+W];
+          res[k] = rhs[k] - l.mean - (n * x[k] - sum);
+          partial += (double) res[k] * res[k];
+        }
+        rowNorms[j] = partial;
+      }
+    });
+
+  double total = 0;
+  for (unsigned int j = 1; j <= l.N_j; j++)
+    total += rowNorms[j];
+  return std::sqrt(total);
+}
+
+/**
+ * Returns the norm of a matrix over the fluid cells of a level, once its
+ * mean is removed.
+ */
+template <typename T>
+double Multigrid<T>::norm(Level &l, ScalarMatrix2D<T> &m){
+  const unsigned int W = l.W;
+  const T *values = m.getArray();
+  double total = 0;
+  for (unsigned int j = 1; j <= l.N_j; j++)
+    for (unsigned int i = 1; i <= l.N_i; i++)
+      if (l.fluid[j * W + i]){
+        const double v = values[j * W + i] - l.mean;
+        total += v * v;
+      }
+  return std::sqrt(total);
+}
+
+/**
+ * Returns the mean of a matrix over the fluid cells of a level.
+ */
+template <typename T>
+T Multigrid<T>::mean(Level &l, ScalarMatrix2D<T> &m){
+  const unsigned int W = l.W;
+  const T *values = m.getArray();
+  double total = 0;
+  unsigned int count = 0;
+  for (unsigned int j = 1; j <= l.N_j; j++)
+    for (unsigned int i = 1; i <= l.N_i; i++)
+      if (l.fluid[j * W + i]){
+        total += values[j * W + i];
+        count++;
+      }
+  return count > 0 ? total / count : 0;
+}
+
+/**
+ * Restriction: the right hand side of a coarse cell is the sum of the
+ * residuals of its children (the stencil is not scaled by the grid step,
+ * hence the factor 4 over the average). The coarse guess is reset.
+ * Rounding errors aside, the residual already has a zero mean.
+ */
+template <typename T>
+void Multigrid<T>::restrictResidual(Level &fine, Level &coarse){
+  const unsigned int Wf = fine.W, Wc = coarse.W;
+  const T *res = fine.res->getArray();
+  T *rhs = coarse.rhs->getArray();
+
+  coarse.x->fill(0);
+  _pool.parallelFor(1, coarse.N_j + 1, [&](unsigned int JBegin, unsigned int JEnd){
+      for (unsigned int J = JBegin; J < JEnd; J++){
+        for (unsigned int I = 1; I <= coarse.N_i; I++){
+          T sum = 0;
+          for (unsigned int j = 2 * J - 1; j <= 2 * J && j <= fine.N_j; j++)
+            for (unsigned int i = 2 * I - 1; i <= 2 * I && i <= fine.N_i; i++)
+              sum += res[j * Wf + i];
+          rhs[J * Wc + I] = sum;
+        }
+      }
+    });
+  coarse.mean = mean(coarse, *coarse.rhs);
+}
+
+/**
+ * Prolongation: bilinear interpolation of the coarse correction, using
+ * only the coarse cells which are fluid, added to the fine unknown.
+ */
+template <typename T>
+void Multigrid<T>::prolongate(Level &coarse, Level &fine){
+  const unsigned int Wf = fine.W, Wc = coarse.W;
+  const T *e = coarse.x->getArray();
+  T *x = fine.x->getArray();
+  const unsigned char *cFluid = &coarse.fluid[0];
+  const unsigned char *fFluid = &fine.fluid[0];
+
+  _pool.parallelFor(1, fine.N_j + 1, [&](unsigned int jBegin, unsigned int jEnd){
+      for (unsigned int j = jBegin; j < jEnd; j++){
+        const unsigned int J = (j + 1) / 2;
+        const unsigned int J2 = (j & 1) ? J - 1 : J + 1; // nearest other row
+        for (unsigned int i = 1; i <= fine.N_i; i++){
+          if (!fFluid[j * Wf + i])
+            continue;
+          const unsigned int I = (i + 1) / 2;
+          const unsigned int I2 = (i & 1) ? I - 1 : I + 1;
+          const unsigned int k = J * Wc + I, kI = J * Wc + I2;
+          const unsigned int kJ = J2 * Wc + I, kIJ = J2 * Wc + I2;
+          const T weight = 9 * cFluid[k] + 3 * cFluid[kI]
+            + 3 * cFluid[kJ] + cFluid[kIJ];
+          if (weight == 0)
+            continue;
+          x[j * Wf + i] += (9 * cFluid[k] * e[k] + 3 * cFluid[kI] * e[kI]
+                            + 3 * cFluid[kJ] * e[kJ] + cFluid[kIJ] * e[kIJ])
+            / weight;
+        }
+      }
+    });
+}
+
+/**
+ * One V-cycle from a given level.
+ */
+template <typename T>
+void Multigrid<T>::vCycle(unsigned int level){
+  Level &l = _levels[level];
+  if (level + 1 == _levels.size()){
+    smooth(l, MULTIGRID_COARSE_SWEEPS);
+    return;
+  }
+
+  smooth(l, MULTIGRID_PRE_SWEEPS);
+  residual(l);
+  restrictResidual(l, _levels[level + 1]);
+  vCycle(level + 1);
+  prolongate(_levels[level + 1], l);
+  smooth(l, MULTIGRID_POST_SWEEPS);
+}
+
+template class Multigrid<float>;
+template class Multigrid<double>;
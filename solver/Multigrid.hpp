@@ -0,0 +1,64 @@
+#ifndef MULTIGRID_HPP_
+#define MULTIGRID_HPP_
+
+#include <vector>
+#include "FloatMatrix2D.hpp"
+#include "Obstacles.hpp"
+#include "ThreadPool.hpp"
+#include "LinearSolver.hpp"
+
+/**
+ * This class implements a geometric multigrid solver for the pressure
+ * equation of the projection step:
+ *   n.p(i,j) - (sum of the fluid neighbours of p) = div(i,j)
+ * where n is the number of fluid neighbours of the cell, ie. the walls and
+ * the obstacles are Neumann boundaries, as done by setBnd.
+ *
+ * Each level halves the grid of the previous one. A coarse cell is fluid
+ * as soon as one of its four children is fluid.
+ *
+ * With Neumann boundaries everywhere the system is singular: p is defined
+ * up to a constant and only the part of the right hand side with a zero
+ * mean can be solved for, so the mean is removed on every level.
+ * T is the scalar type of the matrices of every level.
+ */
+
+template <typename T>
+class Multigrid {
+public:
+  Multigrid(unsigned int width, unsigned int height, ThreadPool &pool);
+  ~Multigrid();
+
+  SolverStats solve(ScalarMatrix2D<T> &x, ScalarMatrix2D<T> &rhs,
+                    const Obstacles &obstacles,
+                    float tolerance, unsigned int maxCycles);
+
+private:
+  Multigrid(const Multigrid &);
+  Multigrid &operator= (const Multigrid &);
+
+  struct Level {
+    unsigned int N_i, N_j;      // interior size, the matrices have a border
+    unsigned int W;             // row stride of the matrices and of fluid
+    ScalarMatrix2D<T> *x;       // unknown (the caller's one on level 0)
+    ScalarMatrix2D<T> *rhs;     // right hand side (the caller's one on level 0)
+    ScalarMatrix2D<T> *res;     // residual
+    T mean;                     // mean of rhs over the fluid cells
+    std::vector<unsigned char> fluid; // 1 for fluid cells, 0 elsewhere
+  };
+
+  void buildMasks(const Obstacles &obstacles);
+  void smooth(Level &l, unsigned int sweeps);
+  double residual(Level &l);
+  double norm(Level &l, ScalarMatrix2D<T> &m);
+  T mean(Level &l, ScalarMatrix2D<T> &m);
+  void restrictResidual(Level &fine, Level &coarse);
+  void prolongate(Level &coarse, Level &fine);
+  void vCycle(unsigned int level);
+
+  std::vector<Level> _levels;
+  ThreadPool &_pool;
+  unsigned long _obstaclesVersion;
+};
+
+#endif
@@ -1,7 +1,13 @@
 #include "Obstacles.hpp"
+#include "CompactMatrix2D.hpp"
 #include <list>
+#include <cstring>
+
+unsigned long Obstacles::_lastVersion = 0;
 
 Obstacles::Obstacles(unsigned int N_x, unsigned int N_y, Config &config) : _N_x(N_x), _N_y(N_y){
+  allocate();
+
   // Reads Segments from XML file
   int ** res = config.getSegmentValues();
   unsigned int nbSegments = config.getSegmentNb();
@@ -9,15 +15,135 @@ Obstacles::Obstacles(unsigned int N_x, unsigned int N_y, Config &config) : _N_x(
   // Instantiates Segments
   for(unsigned int i = 0; i < nbSegments; i++)
     segList.push_front(new Segment(N_x, N_y, res[i][0], res[i][1], res[i][2], res[i][3], res[i][4]));
+  updateCells();
+}
+
+Obstacles::Obstacles(unsigned int N_x, unsigned int N_y) : _N_x(N_x), _N_y(N_y){
+  allocate();
+  updateCells();
 }
 
-Obstacles::Obstacles(){}
+/**
+ * Builds the obstacles of a grid with scale x scale cells per cell of the
+ * grid of coarse (see FluidSolver2D::getDensityScale): the solid cells of
+ * each segment are the ones which cover its solid cells in coarse, and its
+ * ring is one fine cell wide.
+ *
+ * @param coarse Obstacles to refine
+ * @param scale Cells per cell of coarse, along each axis
+ */
+Obstacles::Obstacles(Obstacles &coarse, unsigned int scale)
+  : _N_x((coarse._N_x - 2) * scale + 2), _N_y((coarse._N_y - 2) * scale + 2){
+  allocate();
+
+  // the coarse cell c covers the fine cells (c - 1).scale + 1 to c.scale
+  std::list<Segment*>::reverse_iterator iter;
+  for(iter = coarse.segList.rbegin(); iter != coarse.segList.rend(); iter++){
+    Segment &s = **iter;
+    const unsigned int A0 = (s.getA0() - 1) * scale + 1, A1 = (s.getA1() - 1) * scale + 1;
+    const unsigned int length = (s.getLength() + 1) * scale - 1;
+    if(s.getA1() == s.getB1()) // along x
+      segList.push_front(new Segment(_N_x, _N_y, A0, A1, s.getB0() * scale, A1, length));
+    else
+      segList.push_front(new Segment(_N_x, _N_y, A0, A1, A0, s.getB1() * scale, length));
+  }
+  updateCells();
+}
 
 Obstacles::~Obstacles(){
   reset(); // clear the list
+  alignedDelete(_cells - _padding);
+  alignedDelete(_fluidMask - _padding);
+  for(int b = 0; b < 3; b++)
+    alignedDelete(_mirror[b] - _padding);
+}
+
+/**
+ * Allocates the per-cell arrays with the stride and the alignment of the
+ * matrices, so that the kernels load the cells and the matrices alike.
+ */
+void Obstacles::allocate(){
+  _stride = FloatMatrix2D::strideFor(_N_x);
+  _padding = FloatMatrix2D::paddingFor();
+  const unsigned int length = _stride * _N_y;
+  _cells = alignedNew<unsigned char>(length) + _padding;
+  _fluidMask = alignedNew<unsigned int>(length) + _padding;
+  for(int b = 0; b < 3; b++)
+    _mirror[b] = alignedNew<float>(length) + _padding;
 }
 
-void Obstacles::setObstacles(int b, FloatMatrix2D &x){
+/**
+ * Rebuilds the cell flags from the list of segments. Solid cells take
+ * precedence over the boundary ring of an overlapping segment.
+ */
+void Obstacles::updateCells(){
+  memset(_cells - _padding, CELL_FLUID, _stride * _N_y);
+  _version = ++_lastVersion;
+
+  std::list<Segment*>::iterator iter;
+  for(iter = segList.begin(); iter != segList.end(); iter++){
+    unsigned int iMin, iMax, jMin, jMax;
+    (*iter)->getBoundingBox(iMin, iMax, jMin, jMax);
+    if(iMax >= (unsigned int) _N_x) iMax = _N_x - 1;
+    if(jMax >= (unsigned int) _N_y) jMax = _N_y - 1;
+
+    for(unsigned int j = jMin; j <= jMax; j++){
+      for(unsigned int i = iMin; i <= iMax; i++){
+        unsigned char &cell = _cells[j * _stride + i];
+        if(i > iMin && i < iMax && j > jMin && j < jMax)
+          cell = CELL_SOLID;
+        else if(cell == CELL_FLUID)
+          cell = CELL_BOUNDARY;
+      }
+    }
+  }
+  updateFluidMask();
+}
+
+/**
+ * Rebuilds the fluid mask, the mirror coefficients and the wall cells from
+ * the cell flags. The border of the grid counts as a wall.
+ */
+void Obstacles::updateFluidMask(){
+  for(int j = 0; j < _N_y; j++)
+    for(int i = 0; i < _N_x; i++)
+      _fluidMask[j * _stride + i] = (_cells[j * _stride + i] == CELL_FLUID) ? ~0u : 0;
+
+  std::vector<bool> isWall(_stride * _N_y, false);
+  for(int b = 0; b < 3; b++)
+    memset(_mirror[b] - _padding, 0, _stride * _N_y * sizeof(float));
+  for(int j = 1; j < _N_y - 1; j++){
+    for(int i = 1; i < _N_x - 1; i++){
+      const int k = j * _stride + i;
+      if(!_fluidMask[k])
+        continue;
+      const int sides[2] = {k - 1, k + 1}, verticals[2] = {k - _stride, k + _stride};
+      const bool sideWall[2] = {i == 1, i == _N_x - 2};
+      const bool verticalWall[2] = {j == 1, j == _N_y - 2};
+      int nbSides = 0, nbVerticals = 0;
+      for(int n = 0; n < 2; n++){
+        if(sideWall[n] || !_fluidMask[sides[n]]){
+          nbSides++;
+          isWall[sides[n]] = true;
+        }
+        if(verticalWall[n] || !_fluidMask[verticals[n]]){
+          nbVerticals++;
+          isWall[verticals[n]] = true;
+        }
+      }
+      _mirror[0][k] = nbSides + nbVerticals;
+      _mirror[1][k] = nbVerticals - nbSides;
+      _mirror[2][k] = nbSides - nbVerticals;
+    }
+  }
+  _wallCells.clear();
+  for(int k = 0; k < _stride * _N_y; k++)
+    if(isWall[k])
+      _wallCells.push_back(k);
+}
+
+template <class Matrix>
+void Obstacles::setObstacles(int b, Matrix &x){
   std::list<Segment*>::iterator iter;
   for(iter = segList.begin(); iter != segList.end(); iter++)
     (*iter)->setBnd(b, x);
@@ -26,6 +152,7 @@ void Obstacles::setObstacles(int b, FloatMatrix2D &x){
 void Obstacles::addSegment(unsigned int A0, unsigned int A1, \
   unsigned int B0, unsigned int B1, unsigned int L0){
   segList.push_front(new Segment(_N_x, _N_y, A0, A1, B0, B1, L0));
+  updateCells();
 }
 
 void Obstacles::reset(){
@@ -34,4 +161,11 @@ void Obstacles::reset(){
     delete (*iter);
   }
   segList.clear();
+  memset(_cells - _padding, CELL_FLUID, _stride * _N_y);
+  updateFluidMask();
+  _version = ++_lastVersion;
 }
+
+template void Obstacles::setObstacles(int, FloatMatrix2D &);
+template void Obstacles::setObstacles(int, DoubleMatrix2D &);
+template void Obstacles::setObstacles(int, CompactMatrix2D &);
@@ -1,33 +1,81 @@
 #ifndef OBSTACLES_HPP_
 #define OBSTACLES_HPP_
 
+#include <vector>
 #include "Segment.hpp"
 #include "../config.hpp"
 /**
  * This class implements a set of segments in the middle of the fluid.
+ *
+ * The segments are also rasterized into a per-cell flag array, rebuilt
+ * each time the set of segments changes, so that the solver kernels can
+ * check a cell without walking the list of segments. The per-cell arrays
+ * have the layout of the matrices without ghost layers (see FloatMatrix2D):
+ * the cell (i, j) is at j * FloatMatrix2D::strideFor(N_x) + i.
  */
 
 class Obstacles{
   int _N_x;
   int _N_y;
+  int _stride;  // row stride of the matrices of ghost width 0
+  int _padding; // cells of storage before the cell (0, 0)
   std::list<Segment*> segList;
+  unsigned char *_cells; // one CellType per cell, same layout as the matrices
+  unsigned int *_fluidMask; // ~0 for fluid cells, 0 elsewhere (vector kernels)
+  float *_mirror[3]; // see getMirror, one matrix per boundary condition
+  std::vector<unsigned int> _wallCells; // see getWallCells
+  unsigned long _version; // changes each time the cells are rebuilt
+  static unsigned long _lastVersion;
+
+  void allocate();
+  void updateCells();
+  void updateFluidMask();
 public:
+  enum CellType {
+    CELL_FLUID    = 0,
+    CELL_SOLID    = 1, // inside a segment
+    CELL_BOUNDARY = 2  // one cell ring around a segment, set by setBnd
+  };
+
   Obstacles(unsigned int, unsigned int, Config &);
-  Obstacles(); // Designed for testing
+  Obstacles(unsigned int, unsigned int); // Designed for testing
+  Obstacles(Obstacles &coarse, unsigned int scale);
   ~Obstacles();
 
-  void setObstacles(int, FloatMatrix2D &);
+  template <class Matrix>
+  void setObstacles(int, Matrix &);
   void addSegment(unsigned int A0, unsigned int A1, \
     unsigned int B0, unsigned int B1, unsigned int L0);
   void reset();
   
-  inline bool isInObstacles(unsigned int i, unsigned int j){
-    bool res = false;
-    std::list<Segment*>::iterator iter;
-    for(iter = segList.begin(); iter != segList.end(); iter++){
-      res |= (*iter)->isInSegment(i,j);
-    }
-    return res;
+  inline bool isInObstacles(unsigned int i, unsigned int j) const{
+    return _cells[j * _stride + i] != CELL_FLUID;
+  }
+  inline const unsigned char *getCells() const{
+    return _cells;
+  }
+  inline const unsigned int *getFluidMask() const{
+    return _fluidMask;
+  }
+  /**
+   * Coefficient of a fluid cell in the sum of its neighbours when the ones
+   * which are not fluid (walls and obstacles) mirror it, as setBnd does
+   * with the boundary condition b (0, 1 or 2): +1 per such neighbour, or -1
+   * for the left and right ones with b = 1 and the up and down ones with
+   * b = 2. 0 on the other cells.
+   */
+  inline const float *getMirror(int b) const{
+    return _mirror[b];
+  }
+  /**
+   * Indices of the cells which are not fluid but are a neighbour of a
+   * fluid cell: the border of the grid and the ring around the segments.
+   */
+  inline const std::vector<unsigned int> &getWallCells() const{
+    return _wallCells;
+  }
+  inline unsigned long getVersion() const{
+    return _version;
   }
   std::list<Segment*> getSegList(){return segList;};
 };
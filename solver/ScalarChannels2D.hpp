@@ -0,0 +1,52 @@
+#ifndef SCALARCHANNELS2D_HPP_
+#define SCALARCHANNELS2D_HPP_
+
+#include <vector>
+#include "FloatMatrix2D.hpp"
+#include "FieldArena.hpp"
+
+/**
+ * This class groups the channels of a multi-channel scalar field (the
+ * density, dyes, a temperature, passive tracers): matrices of the same
+ * grid carried by the same velocity. The channels are consecutive fields
+ * of an arena (see FieldArena), which owns them; the batched steps of
+ * FluidSolver2D take them all at once, so that the advection traces each
+ * cell back once for all of them.
+ *
+ * T is the scalar type of the channels.
+ */
+
+template <typename T>
+class ScalarChannels2D {
+public:
+  ScalarChannels2D(const FieldArena<T> &arena, unsigned int first, unsigned int nbChannels)
+    : _channels(nbChannels)
+  {
+    for (unsigned int c = 0; c < nbChannels; c++)
+      _channels[c] = arena.getField(first + c);
+  }
+
+  inline unsigned int getNbChannels() const{
+    return _channels.size();
+  }
+
+  inline ScalarMatrix2D<T> *getChannel(unsigned int c) const{
+    return _channels[c];
+  }
+
+  /**
+   * Returns the channels in order, for the passes over all of them.
+   */
+  inline ScalarMatrix2D<T> **getChannels(){
+    return &_channels[0];
+  }
+
+  inline unsigned int getSize(const unsigned int dim) const{
+    return _channels[0]->getSize(dim);
+  }
+
+private:
+  std::vector<ScalarMatrix2D<T> *> _channels;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "Segment.hpp"
+#include "CompactMatrix2D.hpp"
 
 Segment::Segment(unsigned int N_x, unsigned int N_y, unsigned int A0, unsigned int A1, unsigned int B0, unsigned int B1, unsigned int L0){
   length = L0;
@@ -48,7 +49,8 @@ Segment::Segment(unsigned int N_x, unsigned int N_y, unsigned int A0, unsigned i
  * @param b Defines the border behaviour
  * @param x Matrix to modify
  */
-void Segment::setBnd(int b, FloatMatrix2D &x){
+template <class Matrix>
+void Segment::setBnd(int b, Matrix &x){
   unsigned int i = 0;
   if(XDirection){
     for (i = A[0]; i <= B[0]; i++){
@@ -95,3 +97,7 @@ void Segment::setBnd(int b, FloatMatrix2D &x){
     0.5f*(x.get(B[0],B[1]+1) + x.get(B[0]-1,B[1])));
   }
 }
+
+template void Segment::setBnd(int, FloatMatrix2D &);
+template void Segment::setBnd(int, DoubleMatrix2D &);
+template void Segment::setBnd(int, CompactMatrix2D &);
@@ -20,7 +20,8 @@ class Segment{
 
 public:
   Segment(unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int);
-  void setBnd(int, FloatMatrix2D &);
+  template <class Matrix> // FloatMatrix2D, DoubleMatrix2D or CompactMatrix2D
+  void setBnd(int, Matrix &);
 
   inline bool isInSegment(unsigned int i, unsigned int j){
     if(XDirection)
@@ -28,6 +29,23 @@ public:
     else
       return (A[0]-1 <= i) && (i <= B[0]+length+1) && (A[1]-1 <= j) && (j <= B[1]+1);
   }
+  /**
+   * Gives the cells covered by the segment, including the one cell ring
+   * around it (the same cells as isInSegment).
+   */
+  inline void getBoundingBox(unsigned int &iMin, unsigned int &iMax,
+                             unsigned int &jMin, unsigned int &jMax) const{
+    iMin = A[0]-1;
+    jMin = A[1]-1;
+    if(XDirection){
+      iMax = B[0]+1;
+      jMax = B[1]+length+1;
+    }
+    else{
+      iMax = B[0]+length+1;
+      jMax = B[1]+1;
+    }
+  }
   int getA0(){return A[0];}
   int getA1(){return A[1];}
   int getB0(){return B[0];}
@@ -0,0 +1,1130 @@
+#include "Stencil.hpp"
+#include <cstddef>
+#include <algorithm>
+#include <cstring>
+#if defined(__F16C__) && !defined(STENCIL_SCALAR)
+#include <immintrin.h> // half float conversions
+#endif
+
+/*
+ * Vector layer: Vec<T> gives the vector type of the scalar type T, float or
+ * double, its number of lanes and the operations whose arguments do not
+ * tell the type apart; the other ones are overloaded on the vector types.
+ * A vector of doubles has half the lanes of one of floats, and its integer
+ * vector (cell indices) has the same number of 32-bit lanes, in the lower
+ * half of a register if needed. The masks (Obstacles) and the mirror
+ * coefficients are 32-bit whatever T, and widened by loadMask and loadFloat.
+ * The cells of the fields stored in 16 bits are read into the upper halves
+ * of 32-bit lanes by load16 and gather16, widened to floats by vwiden, then
+ * to T by fromFloat (see Source).
+ */
+#if defined(STENCIL_SCALAR) // reference version, for testing
+#define STENCIL_ISA "scalar"
+#define VEC_WIDTH 0
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define STENCIL_ISA "avx2"
+#define VEC_WIDTH 8 // floats
+template <typename T> struct Vec;
+template <> struct Vec<float> {
+  typedef __m256 vec;
+  typedef __m256i ivec;
+  static const unsigned int width = 8;
+  static inline vec set1(float x){ return _mm256_set1_ps(x); }
+  static inline vec loadMask(const unsigned int *p){ return _mm256_loadu_ps((const float *) p); }
+  static inline vec loadFloat(const float *p){ return _mm256_loadu_ps(p); }
+  static inline vec toScalar(ivec x){ return _mm256_cvtepi32_ps(x); }
+  // base[j * W + i] for each lane
+  static inline vec gatherMask(const unsigned int *base, ivec i, ivec j, unsigned int W){
+    return _mm256_castsi256_ps(_mm256_i32gather_epi32(
+        (const int *) base, _mm256_add_epi32(_mm256_mullo_epi32(j, _mm256_set1_epi32(W)), i), 4));
+  }
+  static inline ivec load16(const unsigned short *p){
+    return _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) p)), 16);
+  }
+  // the 32 bits ending with base[j * W + i], the cell before being padding at worst
+  static inline ivec gather16(const unsigned short *base, ivec i, ivec j, unsigned int W){
+    return _mm256_i32gather_epi32((const int *) (base - 1),
+                                  _mm256_add_epi32(_mm256_mullo_epi32(j, _mm256_set1_epi32(W)), i), 2);
+  }
+  static inline vec fromFloat(__m256 x){ return x; }
+};
+template <> struct Vec<double> {
+  typedef __m256d vec;
+  typedef __m128i ivec;
+  static const unsigned int width = 4;
+  static inline vec set1(double x){ return _mm256_set1_pd(x); }
+  static inline vec loadMask(const unsigned int *p){
+    return _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *) p)));
+  }
+  static inline vec loadFloat(const float *p){ return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+  static inline vec toScalar(ivec x){ return _mm256_cvtepi32_pd(x); }
+  static inline vec gatherMask(const unsigned int *base, ivec i, ivec j, unsigned int W){
+    const __m128i m = _mm_i32gather_epi32((const int *) base,
+                                          _mm_add_epi32(_mm_mullo_epi32(j, _mm_set1_epi32(W)), i), 4);
+    return _mm256_castsi256_pd(_mm256_cvtepi32_epi64(m));
+  }
+  static inline ivec load16(const unsigned short *p){
+    return _mm_unpacklo_epi16(_mm_setzero_si128(), _mm_loadl_epi64((const __m128i *) p));
+  }
+  static inline ivec gather16(const unsigned short *base, ivec i, ivec j, unsigned int W){
+    return _mm_i32gather_epi32((const int *) (base - 1),
+                               _mm_add_epi32(_mm_mullo_epi32(j, _mm_set1_epi32(W)), i), 2);
+  }
+  static inline vec fromFloat(__m128 x){ return _mm256_cvtps_pd(x); }
+};
+static inline __m256 vload(const float *p){ return _mm256_loadu_ps(p); }
+static inline __m256d vload(const double *p){ return _mm256_loadu_pd(p); }
+static inline void vstore(float *p, __m256 x){ _mm256_storeu_ps(p, x); }
+static inline void vstore(double *p, __m256d x){ _mm256_storeu_pd(p, x); }
+static inline __m256 vadd(__m256 x, __m256 y){ return _mm256_add_ps(x, y); }
+static inline __m256d vadd(__m256d x, __m256d y){ return _mm256_add_pd(x, y); }
+static inline __m256 vsub(__m256 x, __m256 y){ return _mm256_sub_ps(x, y); }
+static inline __m256d vsub(__m256d x, __m256d y){ return _mm256_sub_pd(x, y); }
+static inline __m256 vmul(__m256 x, __m256 y){ return _mm256_mul_ps(x, y); }
+static inline __m256d vmul(__m256d x, __m256d y){ return _mm256_mul_pd(x, y); }
+static inline __m256 vdiv(__m256 x, __m256 y){ return _mm256_div_ps(x, y); }
+static inline __m256d vdiv(__m256d x, __m256d y){ return _mm256_div_pd(x, y); }
+static inline __m256 vand(__m256 x, __m256 y){ return _mm256_and_ps(x, y); }
+static inline __m256d vand(__m256d x, __m256d y){ return _mm256_and_pd(x, y); }
+static inline __m256 vmin(__m256 x, __m256 y){ return _mm256_min_ps(x, y); }
+static inline __m256d vmin(__m256d x, __m256d y){ return _mm256_min_pd(x, y); }
+static inline __m256 vmax(__m256 x, __m256 y){ return _mm256_max_ps(x, y); }
+static inline __m256d vmax(__m256d x, __m256d y){ return _mm256_max_pd(x, y); }
+// n where m is set, o elsewhere
+static inline __m256 vblend(__m256 o, __m256 n, __m256 m){ return _mm256_blendv_ps(o, n, m); }
+static inline __m256d vblend(__m256d o, __m256d n, __m256d m){ return _mm256_blendv_pd(o, n, m); }
+static inline __m256i vtrunc(__m256 x){ return _mm256_cvttps_epi32(x); }
+static inline __m128i vtrunc(__m256d x){ return _mm256_cvttpd_epi32(x); }
+// base[j * W + i] for each lane
+static inline __m256 vgather(const float *base, __m256i i, __m256i j, unsigned int W){
+  return _mm256_i32gather_ps(base, _mm256_add_epi32(_mm256_mullo_epi32(j, _mm256_set1_epi32(W)), i), 4);
+}
+static inline __m256d vgather(const double *base, __m128i i, __m128i j, unsigned int W){
+  // masked form: gcc warns about the undefined source of the plain one
+  const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi32(-1));
+  return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base,
+                                  _mm_add_epi32(_mm_mullo_epi32(j, _mm_set1_epi32(W)), i), all, 8);
+}
+// {p7, c0, ..., c6} and {c1, ..., c7, n0}
+static inline __m256 vshiftIn(__m256 p, __m256 c){
+  return _mm256_castsi256_ps(_mm256_alignr_epi8(_mm256_castps_si256(c),
+      _mm256_castps_si256(_mm256_permute2f128_ps(p, c, 0x21)), 12));
+}
+static inline __m256 vshiftOut(__m256 c, __m256 n){
+  return _mm256_castsi256_ps(_mm256_alignr_epi8(
+      _mm256_castps_si256(_mm256_permute2f128_ps(c, n, 0x21)), _mm256_castps_si256(c), 4));
+}
+// {p3, c0, c1, c2} and {c1, c2, c3, n0}
+static inline __m256d vshiftIn(__m256d p, __m256d c){
+  return _mm256_shuffle_pd(_mm256_permute2f128_pd(p, c, 0x21), c, 5);
+}
+static inline __m256d vshiftOut(__m256d c, __m256d n){
+  return _mm256_shuffle_pd(c, _mm256_permute2f128_pd(c, n, 0x21), 5);
+}
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define STENCIL_ISA "sse2"
+#define VEC_WIDTH 4 // floats
+// no gather instruction: base[j * W + i] is read lane by lane
+template <typename T> struct Vec;
+template <> struct Vec<float> {
+  typedef __m128 vec;
+  typedef __m128i ivec;
+  static const unsigned int width = 4;
+  static inline vec set1(float x){ return _mm_set1_ps(x); }
+  static inline vec loadMask(const unsigned int *p){ return _mm_loadu_ps((const float *) p); }
+  static inline vec loadFloat(const float *p){ return _mm_loadu_ps(p); }
+  static inline vec toScalar(ivec x){ return _mm_cvtepi32_ps(x); }
+  static inline vec gatherMask(const unsigned int *base, ivec i, ivec j, unsigned int W){
+    int I[4], J[4];
+    _mm_storeu_si128((__m128i *) I, i);
+    _mm_storeu_si128((__m128i *) J, j);
+    return _mm_castsi128_ps(_mm_setr_epi32(base[J[0] * W + I[0]], base[J[1] * W + I[1]],
+                                           base[J[2] * W + I[2]], base[J[3] * W + I[3]]));
+  }
+  static inline ivec load16(const unsigned short *p){
+    return _mm_unpacklo_epi16(_mm_setzero_si128(), _mm_loadl_epi64((const __m128i *) p));
+  }
+  static inline ivec gather16(const unsigned short *base, ivec i, ivec j, unsigned int W){
+    int I[4], J[4];
+    _mm_storeu_si128((__m128i *) I, i);
+    _mm_storeu_si128((__m128i *) J, j);
+    return _mm_setr_epi32((unsigned int) base[J[0] * W + I[0]] << 16,
+                          (unsigned int) base[J[1] * W + I[1]] << 16,
+                          (unsigned int) base[J[2] * W + I[2]] << 16,
+                          (unsigned int) base[J[3] * W + I[3]] << 16);
+  }
+  static inline vec fromFloat(__m128 x){ return x; }
+};
+template <> struct Vec<double> {
+  typedef __m128d vec;
+  typedef __m128i ivec; // lanes 0 and 1
+  static const unsigned int width = 2;
+  static inline vec set1(double x){ return _mm_set1_pd(x); }
+  static inline vec loadMask(const unsigned int *p){
+    const __m128i m = _mm_loadl_epi64((const __m128i *) p);
+    return _mm_castsi128_pd(_mm_unpacklo_epi32(m, m));
+  }
+  static inline vec loadFloat(const float *p){
+    return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *) p)));
+  }
+  static inline vec toScalar(ivec x){ return _mm_cvtepi32_pd(x); }
+  static inline vec gatherMask(const unsigned int *base, ivec i, ivec j, unsigned int W){
+    int I[4], J[4];
+    _mm_storeu_si128((__m128i *) I, i);
+    _mm_storeu_si128((__m128i *) J, j);
+    const unsigned int m0 = base[J[0] * W + I[0]], m1 = base[J[1] * W + I[1]];
+    return _mm_castsi128_pd(_mm_setr_epi32(m0, m0, m1, m1));
+  }
+  static inline ivec load16(const unsigned short *p){
+    unsigned int cells;
+    memcpy(&cells, p, sizeof(cells));
+    return _mm_unpacklo_epi16(_mm_setzero_si128(), _mm_cvtsi32_si128(cells));
+  }
+  static inline ivec gather16(const unsigned short *base, ivec i, ivec j, unsigned int W){
+    int I[4], J[4];
+    _mm_storeu_si128((__m128i *) I, i);
+    _mm_storeu_si128((__m128i *) J, j);
+    return _mm_setr_epi32((unsigned int) base[J[0] * W + I[0]] << 16,
+                          (unsigned int) base[J[1] * W + I[1]] << 16, 0, 0);
+  }
+  static inline vec fromFloat(__m128 x){ return _mm_cvtps_pd(x); } // lanes 0 and 1
+};
+static inline __m128 vload(const float *p){ return _mm_loadu_ps(p); }
+static inline __m128d vload(const double *p){ return _mm_loadu_pd(p); }
+static inline void vstore(float *p, __m128 x){ _mm_storeu_ps(p, x); }
+static inline void vstore(double *p, __m128d x){ _mm_storeu_pd(p, x); }
+static inline __m128 vadd(__m128 x, __m128 y){ return _mm_add_ps(x, y); }
+static inline __m128d vadd(__m128d x, __m128d y){ return _mm_add_pd(x, y); }
+static inline __m128 vsub(__m128 x, __m128 y){ return _mm_sub_ps(x, y); }
+static inline __m128d vsub(__m128d x, __m128d y){ return _mm_sub_pd(x, y); }
+static inline __m128 vmul(__m128 x, __m128 y){ return _mm_mul_ps(x, y); }
+static inline __m128d vmul(__m128d x, __m128d y){ return _mm_mul_pd(x, y); }
+static inline __m128 vdiv(__m128 x, __m128 y){ return _mm_div_ps(x, y); }
+static inline __m128d vdiv(__m128d x, __m128d y){ return _mm_div_pd(x, y); }
+static inline __m128 vand(__m128 x, __m128 y){ return _mm_and_ps(x, y); }
+static inline __m128d vand(__m128d x, __m128d y){ return _mm_and_pd(x, y); }
+static inline __m128 vmin(__m128 x, __m128 y){ return _mm_min_ps(x, y); }
+static inline __m128d vmin(__m128d x, __m128d y){ return _mm_min_pd(x, y); }
+static inline __m128 vmax(__m128 x, __m128 y){ return _mm_max_ps(x, y); }
+static inline __m128d vmax(__m128d x, __m128d y){ return _mm_max_pd(x, y); }
+// n where m is set, o elsewhere
+static inline __m128 vblend(__m128 o, __m128 n, __m128 m){
+  return _mm_or_ps(_mm_and_ps(m, n), _mm_andnot_ps(m, o));
+}
+static inline __m128d vblend(__m128d o, __m128d n, __m128d m){
+  return _mm_or_pd(_mm_and_pd(m, n), _mm_andnot_pd(m, o));
+}
+static inline __m128i vtrunc(__m128 x){ return _mm_cvttps_epi32(x); }
+static inline __m128i vtrunc(__m128d x){ return _mm_cvttpd_epi32(x); }
+static inline __m128 vgather(const float *base, __m128i i, __m128i j, unsigned int W){
+  int I[4], J[4];
+  _mm_storeu_si128((__m128i *) I, i);
+  _mm_storeu_si128((__m128i *) J, j);
+  return _mm_setr_ps(base[J[0] * W + I[0]], base[J[1] * W + I[1]],
+                     base[J[2] * W + I[2]], base[J[3] * W + I[3]]);
+}
+static inline __m128d vgather(const double *base, __m128i i, __m128i j, unsigned int W){
+  int I[4], J[4];
+  _mm_storeu_si128((__m128i *) I, i);
+  _mm_storeu_si128((__m128i *) J, j);
+  return _mm_setr_pd(base[J[0] * W + I[0]], base[J[1] * W + I[1]]);
+}
+// {p3, c0, c1, c2} and {c1, c2, c3, n0}
+static inline __m128 vshiftIn(__m128 p, __m128 c){
+  return _mm_shuffle_ps(_mm_shuffle_ps(p, c, _MM_SHUFFLE(0, 0, 3, 3)), c, _MM_SHUFFLE(2, 1, 2, 0));
+}
+static inline __m128 vshiftOut(__m128 c, __m128 n){
+  return _mm_shuffle_ps(c, _mm_shuffle_ps(c, n, _MM_SHUFFLE(0, 0, 3, 3)), _MM_SHUFFLE(2, 0, 2, 1));
+}
+// {p1, c0} and {c1, n0}
+static inline __m128d vshiftIn(__m128d p, __m128d c){ return _mm_shuffle_pd(p, c, 1); }
+static inline __m128d vshiftOut(__m128d c, __m128d n){ return _mm_shuffle_pd(c, n, 1); }
+#else
+#define STENCIL_ISA "scalar"
+#define VEC_WIDTH 0
+#endif
+
+/*
+ * Conversions of the 16-bit storage formats, rounding to the nearest even.
+ * They do not depend on the vector width of the other kernels: bfloat16 is
+ * the upper half of a float, converted with SSE2 integer instructions, and
+ * IEEE half floats use the F16C instructions when the compiler targets them
+ * (every AVX2 processor has them), the same bit manipulations as the scalar
+ * versions in SSE2 otherwise. The advections of the fields stored in 16
+ * bits widen their samples with them too.
+ */
+
+static inline unsigned int floatBits(float f){
+  unsigned int x;
+  memcpy(&x, &f, sizeof(x));
+  return x;
+}
+
+static inline float bitsFloat(unsigned int x){
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+static inline unsigned short floatToBfloat(float f){
+  const unsigned int x = floatBits(f);
+  if ((x & 0x7fffffff) > 0x7f800000) // NaN, kept quiet rather than rounded
+    return (x | 0x400000) >> 16;
+  return (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+}
+
+static inline unsigned short floatToHalf(float f){
+  unsigned int x = floatBits(f);
+  const unsigned int sign = (x >> 16) & 0x8000;
+  x &= 0x7fffffff;
+  if (x >= 0x7f800000) // infinity, or NaN made quiet with the top of its payload
+    return sign | 0x7c00 | (x > 0x7f800000 ? 0x200 | ((x >> 13) & 0x3ff) : 0);
+  if (x >= 0x477ff000) // rounds beyond the largest half (65504)
+    return sign | 0x7c00;
+  if (x < 0x38800000){ // below the smallest normal half: subnormal
+    if (x < 0x33000000)
+      return sign;
+    const unsigned int shift = 126 - (x >> 23);
+    const unsigned int m = (x & 0x7fffff) | 0x800000;
+    const unsigned int rest = m & ((1u << shift) - 1), tie = 1u << (shift - 1);
+    unsigned int h = m >> shift;
+    if (rest > tie || (rest == tie && (h & 1)))
+      h++;
+    return sign | h;
+  }
+  x += 0xc8000000; // exponent bias 127 -> 15
+  x += 0xfff + ((x >> 13) & 1);
+  return sign | (x >> 13);
+}
+
+static inline float halfToFloat(unsigned short h){
+  const unsigned int sign = (h & 0x8000u) << 16;
+  unsigned int e = (h >> 10) & 0x1f, m = h & 0x3ff;
+  if (e == 0x1f) // infinity, or NaN made quiet
+    return bitsFloat(sign | 0x7f800000 | (m << 13) | (m ? 0x400000 : 0));
+  if (e != 0)
+    return bitsFloat(sign | ((e + 112) << 23) | (m << 13));
+  if (m == 0)
+    return bitsFloat(sign);
+  for (e = 113; !(m & 0x400); e--) // subnormal: normalized
+    m <<= 1;
+  return bitsFloat(sign | (e << 23) | ((m & 0x3ff) << 13));
+}
+
+#if defined(__SSE2__) && !defined(__F16C__) && !defined(STENCIL_SCALAR)
+/*
+ * floatToHalf on 4 floats, each result sign-extended in its 32-bit lane for
+ * _mm_packs_epi32. The subnormal halves are rounded by a float addition
+ * which leaves their bits at the bottom of the mantissa.
+ */
+static inline __m128i floatToHalfSSE2(__m128 f){
+  const __m128i denormMagic = _mm_set1_epi32(126 << 23); // 0.5, of ulp 2^-24
+  __m128i x = _mm_castps_si128(f);
+  const __m128i sign = _mm_and_si128(x, _mm_set1_epi32(0x80000000));
+  x = _mm_xor_si128(x, sign);
+  const __m128i big = _mm_cmpgt_epi32(x, _mm_set1_epi32(0x477fefff));
+  const __m128i nan = _mm_cmpgt_epi32(x, _mm_set1_epi32(0x7f800000));
+  const __m128i sub = _mm_cmplt_epi32(x, _mm_set1_epi32(0x38800000));
+  const __m128i subnormal =
+    _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(x), _mm_castsi128_ps(denormMagic))),
+                  denormMagic);
+  const __m128i odd = _mm_and_si128(_mm_srli_epi32(x, 13), _mm_set1_epi32(1));
+  const __m128i normal =
+    _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(x, _mm_set1_epi32(0xc8000fff)), odd), 13);
+  __m128i h = _mm_or_si128(_mm_and_si128(sub, subnormal), _mm_andnot_si128(sub, normal));
+  const __m128i payload = _mm_or_si128(_mm_set1_epi32(0x200),
+                                       _mm_and_si128(_mm_srli_epi32(x, 13), _mm_set1_epi32(0x3ff)));
+  const __m128i special = _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(nan, payload));
+  h = _mm_or_si128(_mm_and_si128(big, special), _mm_andnot_si128(big, h));
+  h = _mm_or_si128(h, _mm_srli_epi32(sign, 16));
+  return _mm_srai_epi32(_mm_slli_epi32(h, 16), 16);
+}
+
+/*
+ * halfToFloat on 4 halves zero-extended to 32 bits: the exponent and
+ * mantissa moved into place are scaled by 2^112, which rebiases the
+ * exponent and normalizes the subnormals, and the infinities and NaNs get
+ * the largest exponent back (the NaNs quiet, as with F16C).
+ */
+static inline __m128 halfToFloatSSE2(__m128i h){
+  const __m128i em = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+  const __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+  __m128i x = _mm_castps_si128(_mm_mul_ps(_mm_castsi128_ps(em),
+                                          _mm_castsi128_ps(_mm_set1_epi32(239 << 23))));
+  const __m128i special = _mm_cmpgt_epi32(em, _mm_set1_epi32(0x0f7fffff));
+  const __m128i nan = _mm_cmpgt_epi32(em, _mm_set1_epi32(0x0f800000));
+  x = _mm_or_si128(x, _mm_and_si128(special, _mm_set1_epi32(0x7f800000)));
+  x = _mm_or_si128(x, _mm_and_si128(nan, _mm_set1_epi32(0x400000)));
+  return _mm_castsi128_ps(_mm_or_si128(x, sign));
+}
+#endif
+
+#if VEC_WIDTH
+// lanes alternately set and clear, starting with a set or a clear one
+// (sized for the widest vectors)
+static const unsigned int alternate[2][8] = {
+  {~0u, 0, ~0u, 0, ~0u, 0, ~0u, 0},
+  {0, ~0u, 0, ~0u, 0, ~0u, 0, ~0u}
+};
+// index of each lane
+static const float lanesFloat[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+static const double lanesDouble[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+static inline const float *lanes(float){ return lanesFloat; }
+static inline const double *lanes(double){ return lanesDouble; }
+
+// 16-bit cells in the upper halves of 32-bit lanes, widened to floats
+static inline __m128 vwiden(__m128i x, StencilBfloat){
+  return _mm_castsi128_ps(_mm_and_si128(x, _mm_set1_epi32(~0xffff)));
+}
+static inline __m128 vwiden(__m128i x, StencilHalf){
+#if defined(__F16C__)
+  const __m128i h = _mm_srli_epi32(x, 16);
+  return _mm_cvtph_ps(_mm_packus_epi32(h, h));
+#else
+  return halfToFloatSSE2(_mm_srli_epi32(x, 16));
+#endif
+}
+#if defined(__AVX2__)
+static inline __m256 vwiden(__m256i x, StencilBfloat){
+  return _mm256_castsi256_ps(_mm256_and_si256(x, _mm256_set1_epi32(~0xffff)));
+}
+static inline __m256 vwiden(__m256i x, StencilHalf){
+  const __m256i h = _mm256_srli_epi32(x, 16);
+#if defined(__F16C__)
+  // the lower halves of the lanes, in order
+  const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(h, h), 0x08);
+  return _mm256_cvtph_ps(_mm256_castsi256_si128(packed));
+#else
+  return _mm256_insertf128_ps(_mm256_castps128_ps256(halfToFloatSSE2(_mm256_castsi256_si128(h))),
+                              halfToFloatSSE2(_mm256_extracti128_si256(h, 1)), 1);
+#endif
+}
+#endif
+
+/**
+ * Reads of the fields sampled by the advections, as vectors of T: fields
+ * of T, or stored in 16 bits (S is then StencilHalf or StencilBfloat),
+ * widened.
+ */
+template <typename T, typename S>
+struct Source {
+  typedef Vec<T> V;
+  static inline typename V::vec load(const S *p){
+    return V::fromFloat(vwiden(V::load16(&p->bits), S()));
+  }
+  static inline typename V::vec gather(const S *base, typename V::ivec i, typename V::ivec j,
+                                       unsigned int W){
+    return V::fromFloat(vwiden(V::gather16(&base->bits, i, j, W), S()));
+  }
+};
+template <typename T>
+struct Source<T, T> {
+  typedef Vec<T> V;
+  static inline typename V::vec load(const T *p){
+    return vload(p);
+  }
+  static inline typename V::vec gather(const T *base, typename V::ivec i, typename V::ivec j,
+                                       unsigned int W){
+    return vgather(base, i, j, W);
+  }
+};
+#endif
+
+// a cell of a field sampled by the advections, widened like by Source
+static inline float widen(float x){ return x; }
+static inline double widen(double x){ return x; }
+static inline float widen(StencilHalf h){ return halfToFloat(h.bits); }
+static inline float widen(StencilBfloat h){ return bitsFloat((unsigned int) h.bits << 16); }
+
+const char *stencilInstructionSet(){
+  return STENCIL_ISA;
+}
+
+template <typename T>
+void stencilRelaxRow(T *x, const T *x0, const unsigned int *mask,
+                     const float *mirror, unsigned int n, unsigned int W,
+                     unsigned int parity, T a, T c){
+  const T *up = x - W, *down = x + W;
+  unsigned int i = 1;
+#if VEC_WIDTH
+  // the width is even, so every vector starts with the same color; the
+  // cells of the other color are written back unchanged. The left and right
+  // neighbours are shifted in from the vectors around instead of loaded
+  // again, as those loads would overlap the previous store.
+  typedef Vec<T> V;
+  typedef typename V::vec vec;
+  const unsigned int width = V::width;
+  const vec colorMask = V::loadMask(alternate[(1 + parity) & 1]);
+  const vec va = V::set1(a), vc = V::set1(c);
+  vec previous = vload(x + i - width), current = vload(x + i);
+  for (; i + width <= n + 1; i += width){
+    const vec next = vload(x + i + width);
+    const vec sum = vadd(vadd(vadd(vadd(vshiftIn(previous, current), vshiftOut(current, next)),
+                                   vload(up + i)), vload(down + i)),
+                         vmul(V::loadFloat(mirror + i), current));
+    const vec updated = vdiv(vadd(vload(x0 + i), vmul(va, sum)), vc);
+    vstore(x + i, vblend(current, updated, vand(colorMask, V::loadMask(mask + i))));
+    previous = current;
+    current = next;
+  }
+#endif
+  for (; i <= n; i++)
+    if (((i + parity) & 1) == 0 && mask[i])
+      x[i] = (x0[i] + a * (x[i-1] + x[i+1] + up[i] + down[i] + mirror[i] * x[i])) / c;
+}
+
+template <typename T>
+void stencilRelax3DRow(T *x, const T *x0, unsigned int n, unsigned int W, unsigned int P,
+                       unsigned int parity, T a, T c){
+  const T *up = x - W, *down = x + W, *back = x - P, *front = x + P;
+  unsigned int i = 1;
+#if VEC_WIDTH
+  // same as stencilRelaxRow, with the two neighbours across the planes
+  typedef Vec<T> V;
+  typedef typename V::vec vec;
+  const unsigned int width = V::width;
+  const vec colorMask = V::loadMask(alternate[(1 + parity) & 1]);
+  const vec va = V::set1(a), vc = V::set1(c);
+  vec previous = vload(x + i - width), current = vload(x + i);
+  for (; i + width <= n + 1; i += width){
+    const vec next = vload(x + i + width);
+    const vec sum = vadd(vadd(vadd(vshiftIn(previous, current), vshiftOut(current, next)),
+                              vadd(vload(up + i), vload(down + i))),
+                         vadd(vload(back + i), vload(front + i)));
+    const vec updated = vdiv(vadd(vload(x0 + i), vmul(va, sum)), vc);
+    vstore(x + i, vblend(current, updated, colorMask));
+    previous = current;
+    current = next;
+  }
+#endif
+  for (; i <= n; i++)
+    if (((i + parity) & 1) == 0)
+      x[i] = (x0[i] + a * (x[i-1] + x[i+1] + up[i] + down[i] + back[i] + front[i])) / c;
+}
+
+template <typename T>
+void stencilGaussSeidelRow(T *x, const T *x0, const unsigned int *mask,
+                           unsigned int n, unsigned int W, T a, T c){
+  const T *up = x - W, *down = x + W;
+  for (unsigned int i = 1; i <= n; i++)
+    if (mask[i])
+      x[i] = (x0[i] + a * (x[i-1] + x[i+1] + up[i] + down[i])) / c;
+}
+
+template <typename T>
+void stencilResidualRow(const T *x, const T *x0, const unsigned int *mask,
+                        const float *mirror, unsigned int n, unsigned int W,
+                        T a, T c, StencilSums &sums){
+  const T *up = x - W, *down = x + W;
+  double residual = 0, residualSquares = 0, rhsSquares = 0;
+  unsigned int count = 0;
+  unsigned int i = 1;
+#if VEC_WIDTH
+  // partial sums in T per lane, added to the double totals at the end
+  typedef Vec<T> V;
+  typedef typename V::vec vec;
+  const unsigned int width = V::width;
+  const vec va = V::set1(a), vc = V::set1(c), one = V::set1(1);
+  vec vResidual = V::set1(0), vResidualSquares = V::set1(0), vRhsSquares = V::set1(0), vCount = V::set1(0);
+  for (; i + width <= n + 1; i += width){
+    const vec m = V::loadMask(mask + i);
+    const vec sum = vadd(vadd(vadd(vload(x + i - 1), vload(x + i + 1)),
+                              vload(up + i)), vload(down + i));
+    const vec rhs = vand(vload(x0 + i), m);
+    const vec diag = mirror == NULL ? vc : vsub(vc, vmul(va, V::loadFloat(mirror + i)));
+    const vec r = vand(vsub(vload(x0 + i), vsub(vmul(diag, vload(x + i)), vmul(va, sum))), m);
+    vResidual = vadd(vResidual, r);
+    vResidualSquares = vadd(vResidualSquares, vmul(r, r));
+    vRhsSquares = vadd(vRhsSquares, vmul(rhs, rhs));
+    vCount = vadd(vCount, vand(one, m));
+  }
+  T lanesResidual[V::width], lanesResidualSquares[V::width];
+  T lanesRhsSquares[V::width], lanesCount[V::width];
+  vstore(lanesResidual, vResidual);
+  vstore(lanesResidualSquares, vResidualSquares);
+  vstore(lanesRhsSquares, vRhsSquares);
+  vstore(lanesCount, vCount);
+  for (unsigned int l = 0; l < width; l++){
+    residual += lanesResidual[l];
+    residualSquares += lanesResidualSquares[l];
+    rhsSquares += lanesRhsSquares[l];
+    count += lanesCount[l];
+  }
+#endif
+  for (; i <= n; i++){
+    if (mask[i]){
+      const T diag = mirror == NULL ? c : c - a * mirror[i];
+      const T r = x0[i] - (diag * x[i] - a * (x[i-1] + x[i+1] + up[i] + down[i]));
+      residual += r;
+      residualSquares += r * r;
+      rhsSquares += x0[i] * x0[i];
+      count++;
+    }
+  }
+  sums.residual = residual;
+  sums.residualSquares = residualSquares;
+  sums.rhsSquares = rhsSquares;
+  sums.count = count;
+}
+
+template <typename T>
+void stencilDivergenceRow(T *div, T *p, const T *u, const T *v,
+                          const unsigned int *mask, unsigned int n, unsigned int W,
+                          T h_u, T h_v){
+  const T c_u = (T) -0.5 * h_u, c_v = (T) 0.5 * h_v;
+  const T *vUp = v - W, *vDown = v + W;
+  unsigned int i = 1;
+#if VEC_WIDTH
+  typedef Vec<T> V;
+  typedef typename V::vec vec;
+  const unsigned int width = V::width;
+  const vec vc_u = V::set1(c_u), vc_v = V::set1(c_v), zero = V::set1(0);
+  for (; i + width <= n + 1; i += width){
+    const vec m = V::loadMask(mask + i);
+    const vec d = vsub(vmul(vc_u, vsub(vload(u + i + 1), vload(u + i - 1))),
+                       vmul(vc_v, vsub(vload(vDown + i), vload(vUp + i))));
+    vstore(div + i, vblend(vload(div + i), d, m));
+    if (p != NULL)
+      vstore(p + i, vblend(vload(p + i), zero, m));
+  }
+#endif
+  for (; i <= n; i++){
+    if (mask[i]){
+      div[i] = c_u * (u[i+1] - u[i-1]) - c_v * (vDown[i] - vUp[i]);
+      if (p != NULL)
+        p[i] = 0;
+    }
+  }
+}
+
+template <typename T>
+void stencilGradientRow(T *u, T *v, const T *p,
+                        const unsigned int *mask, unsigned int n, unsigned int W,
+                        T h_u, T h_v){
+  const T c_u = (T) 0.5 / h_u, c_v = (T) 0.5 / h_v;
+  const T *pUp = p - W, *pDown = p + W;
+  unsigned int i = 1;
+#if VEC_WIDTH
+  typedef Vec<T> V;
+  typedef typename V::vec vec;
+  const unsigned int width = V::width;
+  const vec vc_u = V::set1(c_u), vc_v = V::set1(c_v);
+  for (; i + width <= n + 1; i += width){
+    const vec m = V::loadMask(mask + i);
+    const vec oldU = vload(u + i), oldV = vload(v + i);
+    const vec newU = vsub(oldU, vmul(vc_u, vsub(vload(p + i + 1), vload(p + i - 1))));
+    const vec newV = vsub(oldV, vmul(vc_v, vsub(vload(pDown + i), vload(pUp + i))));
+    vstore(u + i, vblend(oldU, newU, m));
+    vstore(v + i, vblend(oldV, newV, m));
+  }
+#endif
+  for (; i <= n; i++){
+    if (mask[i]){
+      u[i] -= c_u * (p[i+1] - p[i-1]);
+      v[i] -= c_v * (pDown[i] - pUp[i]);
+    }
+  }
+}
+
+/**
+ * Advection of nbFields fields along the same back-traced positions: the
+ * positions, weights and corner flags are computed once for all of them,
+ * then each field only costs its four gathers.
+ *
+ * The fields d0 are of T or stored in 16 bits (S, see Source). The row of
+ * the fields d is written starting at d[f] + dRow: j W, or 0 for rows of
+ * their own. Only the row j of the velocity is read: u and v point to its
+ * cell 0.
+ */
+template <typename T, typename S>
+static void advectRow(T *const *d, unsigned int dRow, const S *const *d0, unsigned int nbFields,
+                      const T *u, const T *v,
+                      const unsigned int *mask, unsigned int j,
+                      unsigned int first, unsigned int n,
+                      unsigned int N_i, unsigned int N_j, unsigned int W,
+                      T dt0_x, T dt0_y){
+  const unsigned int row = j * W;
+  const T xMax = N_i + (T) 0.5, yMax = N_j + (T) 0.5;
+  const unsigned int end = first + n;
+  unsigned int i = first;
+#if VEC_WIDTH
+  typedef Vec<T> V;
+  typedef typename V::vec vec;
+  typedef typename V::ivec ivec;
+  const unsigned int width = V::width;
+  const vec vdt0_x = V::set1(dt0_x), vdt0_y = V::set1(dt0_y);
+  const vec half = V::set1(0.5), one = V::set1(1), vxMax = V::set1(xMax), vyMax = V::set1(yMax);
+  const vec vj = V::set1(j), lane = vload(lanes(T()));
+  for (; i + width <= end; i += width){
+    const vec x = vmin(vmax(vsub(vadd(V::set1(i), lane),
+                                 vmul(vdt0_x, vload(u + i))), half), vxMax);
+    const vec y = vmin(vmax(vsub(vj, vmul(vdt0_y, vload(v + i))), half), vyMax);
+    const ivec i0 = vtrunc(x), j0 = vtrunc(y);
+    const vec s1 = vsub(x, V::toScalar(i0)), s0 = vsub(one, s1);
+    const vec t1 = vsub(y, V::toScalar(j0)), t0 = vsub(one, t1);
+    const vec cornersFluid =
+      vand(vand(V::gatherMask(mask, i0, j0, W), V::gatherMask(mask + W + 1, i0, j0, W)),
+           vand(V::gatherMask(mask + W, i0, j0, W), V::gatherMask(mask + 1, i0, j0, W)));
+    const vec fluid = V::loadMask(mask + row + i);
+
+    for (unsigned int f = 0; f < nbFields; f++){
+      typedef Source<T, S> Src;
+      const S *src = d0[f];
+      const vec sample =
+        vadd(vmul(s0, vadd(vmul(t0, Src::gather(src, i0, j0, W)),
+                           vmul(t1, Src::gather(src + W, i0, j0, W)))),
+             vmul(s1, vadd(vmul(t0, Src::gather(src + 1, i0, j0, W)),
+                           vmul(t1, Src::gather(src + W + 1, i0, j0, W)))));
+      const vec value = vblend(Src::load(src + row + i), sample, cornersFluid);
+      vstore(d[f] + dRow + i, vblend(vload(d[f] + dRow + i), value, fluid));
+    }
+  }
+#endif
+  for (; i < end; i++){
+    const unsigned int k = row + i;
+    if (!mask[k])
+      continue;
+    T x = i - dt0_x * u[i];
+    T y = j - dt0_y * v[i];
+    if (x < (T) 0.5) x = 0.5;
+    if (x > xMax) x = xMax;
+    if (y < (T) 0.5) y = 0.5;
+    if (y > yMax) y = yMax;
+    const unsigned int i0 = (int) x, j0 = (int) y;
+    const T s1 = x - i0, s0 = 1 - s1;
+    const T t1 = y - j0, t0 = 1 - t1;
+    const unsigned int k00 = j0 * W + i0;
+    const bool cornersFluid = mask[k00] && mask[k00 + W + 1] && mask[k00 + W] && mask[k00 + 1];
+
+    for (unsigned int f = 0; f < nbFields; f++){
+      const S *src = d0[f];
+      if (cornersFluid)
+        d[f][dRow + i] = s0 * (t0 * widen(src[k00]) + t1 * widen(src[k00 + W]))
+          + s1 * (t0 * widen(src[k00 + 1]) + t1 * widen(src[k00 + W + 1]));
+      else
+        d[f][dRow + i] = widen(src[k]);
+    }
+  }
+}
+
+template <typename T>
+void stencilAdvectRow(T *d, const T *d0, const T *u, const T *v,
+                      const unsigned int *mask, unsigned int j,
+                      unsigned int N_i, unsigned int N_j, unsigned int W,
+                      T dt0_x, T dt0_y){
+  advectRow(&d, j * W, &d0, 1, u + j * W, v + j * W, mask, j, 1, N_i, N_i, N_j, W,
+               dt0_x, dt0_y);
+}
+
+template <typename T>
+void stencilAdvectChannelsRow(T *const *d, const T *const *d0, unsigned int nbChannels,
+                              const T *uRow, const T *vRow,
+                              const unsigned int *mask, unsigned int j,
+                              unsigned int first, unsigned int n,
+                              unsigned int N_i, unsigned int N_j, unsigned int W,
+                              T dt0_x, T dt0_y){
+  advectRow(d, j * W, d0, nbChannels, uRow, vRow, mask, j, first, n, N_i, N_j, W,
+               dt0_x, dt0_y);
+}
+
+template <typename T, typename S>
+void stencilAdvectChannelsToRow(T *const *dRow, const S *const *d0, unsigned int nbChannels,
+                                const T *uRow, const T *vRow,
+                                const unsigned int *mask, unsigned int j,
+                                unsigned int first, unsigned int n,
+                                unsigned int N_i, unsigned int N_j, unsigned int W,
+                                T dt0_x, T dt0_y){
+  advectRow(dRow, 0, d0, nbChannels, uRow, vRow, mask, j, first, n, N_i, N_j, W,
+               dt0_x, dt0_y);
+}
+
+template <typename T>
+void stencilAdvectVelocityRow(T *u, T *v, const T *u0, const T *v0,
+                              const unsigned int *mask, unsigned int j,
+                              unsigned int first, unsigned int n,
+                              unsigned int N_i, unsigned int N_j, unsigned int W,
+                              T dt0_x, T dt0_y){
+  T *const d[2] = {u, v};
+  const T *const d0[2] = {u0, v0};
+  advectRow(d, j * W, d0, 2, u0 + j * W, v0 + j * W, mask, j, first, n, N_i, N_j, W,
+               dt0_x, dt0_y);
+}
+
+/**
+ * MacCormack correction of nbFields fields advected along the same
+ * velocity, read like in advectRow: d0 of T or S, d written from
+ * d[f] + dRow. Each cell
+ * traces two points, where it comes from (the corners of d0 around it
+ * bound the result) and where it goes (d1 is sampled there), computed once
+ * for all the fields.
+ */
+template <typename T, typename S>
+static void macCormackRow(T *const *d, unsigned int dRow, const S *const *d0, const T *const *d1,
+                          unsigned int nbFields, const T *u, const T *v,
+                          const unsigned int *mask, unsigned int j,
+                          unsigned int first, unsigned int n,
+                          unsigned int N_i, unsigned int N_j, unsigned int W,
+                          T dt0_x, T dt0_y){
+  const unsigned int row = j * W;
+  const T xMax = N_i + (T) 0.5, yMax = N_j + (T) 0.5;
+  const unsigned int end = first + n;
+  unsigned int i = first;
+#if VEC_WIDTH
+  typedef Vec<T> V;
+  typedef typename V::vec vec;
+  typedef typename V::ivec ivec;
+  const unsigned int width = V::width;
+  const vec vdt0_x = V::set1(dt0_x), vdt0_y = V::set1(dt0_y);
+  const vec half = V::set1(0.5), one = V::set1(1), vxMax = V::set1(xMax), vyMax = V::set1(yMax);
+  const vec vj = V::set1(j), lane = vload(lanes(T()));
+  for (; i + width <= end; i += width){
+    const vec vi = vadd(V::set1(i), lane);
+    const vec du = vmul(vdt0_x, vload(u + i));
+    const vec dv = vmul(vdt0_y, vload(v + i));
+    // where the cell comes from
+    const vec xf = vmin(vmax(vsub(vi, du), half), vxMax);
+    const vec yf = vmin(vmax(vsub(vj, dv), half), vyMax);
+    const ivec i0 = vtrunc(xf), j0 = vtrunc(yf);
+    // where it goes
+    const vec xb = vmin(vmax(vadd(vi, du), half), vxMax);
+    const vec yb = vmin(vmax(vadd(vj, dv), half), vyMax);
+    const ivec i1 = vtrunc(xb), j1 = vtrunc(yb);
+    const vec s1 = vsub(xb, V::toScalar(i1)), s0 = vsub(one, s1);
+    const vec t1 = vsub(yb, V::toScalar(j1)), t0 = vsub(one, t1);
+    const vec cornersFluid =
+      vand(vand(vand(V::gatherMask(mask, i0, j0, W), V::gatherMask(mask + W + 1, i0, j0, W)),
+                vand(V::gatherMask(mask + W, i0, j0, W), V::gatherMask(mask + 1, i0, j0, W))),
+           vand(vand(V::gatherMask(mask, i1, j1, W), V::gatherMask(mask + W + 1, i1, j1, W)),
+                vand(V::gatherMask(mask + W, i1, j1, W), V::gatherMask(mask + 1, i1, j1, W))));
+    const vec fluid = V::loadMask(mask + row + i);
+
+    for (unsigned int f = 0; f < nbFields; f++){
+      typedef Source<T, S> Src;
+      const S *src = d0[f];
+      const T *fwd = d1[f];
+      const vec c00 = Src::gather(src, i0, j0, W), c01 = Src::gather(src + W, i0, j0, W);
+      const vec c10 = Src::gather(src + 1, i0, j0, W);
+      const vec c11 = Src::gather(src + W + 1, i0, j0, W);
+      const vec lo = vmin(vmin(c00, c01), vmin(c10, c11));
+      const vec hi = vmax(vmax(c00, c01), vmax(c10, c11));
+      const vec back =
+        vadd(vmul(s0, vadd(vmul(t0, vgather(fwd, i1, j1, W)), vmul(t1, vgather(fwd + W, i1, j1, W)))),
+             vmul(s1, vadd(vmul(t0, vgather(fwd + 1, i1, j1, W)),
+                           vmul(t1, vgather(fwd + W + 1, i1, j1, W)))));
+      const vec forward = vload(fwd + row + i);
+      const vec corrected =
+        vmin(vmax(vadd(forward, vmul(half, vsub(Src::load(src + row + i), back))), lo), hi);
+      const vec value = vblend(forward, corrected, cornersFluid);
+      vstore(d[f] + dRow + i, vblend(vload(d[f] + dRow + i), value, fluid));
+    }
+  }
+#endif
+  for (; i < end; i++){
+    const unsigned int k = row + i;
+    if (!mask[k])
+      continue;
+    const T du = dt0_x * u[i], dv = dt0_y * v[i];
+    T x = i - du, y = j - dv;
+    if (x < (T) 0.5) x = 0.5;
+    if (x > xMax) x = xMax;
+    if (y < (T) 0.5) y = 0.5;
+    if (y > yMax) y = yMax;
+    T xb = i + du, yb = j + dv;
+    if (xb < (T) 0.5) xb = 0.5;
+    if (xb > xMax) xb = xMax;
+    if (yb < (T) 0.5) yb = 0.5;
+    if (yb > yMax) yb = yMax;
+    const unsigned int k00 = ((unsigned int) y) * W + (unsigned int) x;
+    const unsigned int i1 = (int) xb, j1 = (int) yb, k11 = j1 * W + i1;
+    const T s1 = xb - i1, s0 = 1 - s1;
+    const T t1 = yb - j1, t0 = 1 - t1;
+    const bool cornersFluid =
+      mask[k00] && mask[k00 + W + 1] && mask[k00 + W] && mask[k00 + 1]
+      && mask[k11] && mask[k11 + W + 1] && mask[k11 + W] && mask[k11 + 1];
+
+    for (unsigned int f = 0; f < nbFields; f++){
+      const S *src = d0[f];
+      const T *fwd = d1[f];
+      if (!cornersFluid){
+        d[f][dRow + i] = fwd[k];
+        continue;
+      }
+      const T c00 = widen(src[k00]), c01 = widen(src[k00 + W]), c10 = widen(src[k00 + 1]);
+      const T c11 = widen(src[k00 + W + 1]);
+      const T lo = std::min(std::min(c00, c01), std::min(c10, c11));
+      const T hi = std::max(std::max(c00, c01), std::max(c10, c11));
+      const T back = s0 * (t0 * fwd[k11] + t1 * fwd[k11 + W])
+        + s1 * (t0 * fwd[k11 + 1] + t1 * fwd[k11 + W + 1]);
+      d[f][dRow + i] = std::min(std::max(fwd[k] + (T) 0.5 * (widen(src[k]) - back), lo), hi);
+    }
+  }
+}
+
+template <typename T>
+void stencilMacCormackChannelsRow(T *const *d, const T *const *d0, const T *const *d1,
+                                  unsigned int nbChannels, const T *uRow, const T *vRow,
+                                  const unsigned int *mask, unsigned int j,
+                                  unsigned int first, unsigned int n,
+                                  unsigned int N_i, unsigned int N_j, unsigned int W,
+                                  T dt0_x, T dt0_y){
+  macCormackRow(d, j * W, d0, d1, nbChannels, uRow, vRow, mask, j, first, n, N_i, N_j, W,
+                   dt0_x, dt0_y);
+}
+
+template <typename T, typename S>
+void stencilMacCormackChannelsToRow(T *const *dRow, const S *const *d0, const T *const *d1,
+                                    unsigned int nbChannels, const T *uRow, const T *vRow,
+                                    const unsigned int *mask, unsigned int j,
+                                    unsigned int first, unsigned int n,
+                                    unsigned int N_i, unsigned int N_j, unsigned int W,
+                                    T dt0_x, T dt0_y){
+  macCormackRow(dRow, 0, d0, d1, nbChannels, uRow, vRow, mask, j, first, n, N_i, N_j, W,
+                   dt0_x, dt0_y);
+}
+
+template <typename T>
+void stencilMacCormackVelocityRow(T *u, T *v, const T *u0, const T *v0,
+                                  const T *u1, const T *v1,
+                                  const unsigned int *mask, unsigned int j,
+                                  unsigned int first, unsigned int n,
+                                  unsigned int N_i, unsigned int N_j, unsigned int W,
+                                  T dt0_x, T dt0_y){
+  T *const d[2] = {u, v};
+  const T *const d0[2] = {u0, v0};
+  const T *const d1[2] = {u1, v1};
+  macCormackRow(d, j * W, d0, d1, 2, u0 + j * W, v0 + j * W, mask, j, first, n, N_i, N_j, W,
+                   dt0_x, dt0_y);
+}
+
+
+template <typename T>
+void stencilAdvect3DRow(T *const *d, const T *const *d0, unsigned int nbFields,
+                        const T *u, const T *v, const T *w, unsigned int j, unsigned int k,
+                        unsigned int N_i, unsigned int N_j, unsigned int N_k,
+                        T dt0_x, T dt0_y, T dt0_z){
+  const unsigned int W = N_i + 2, P = W * (N_j + 2);
+  const unsigned int row = k * P + j * W;
+  const T xMax = N_i + (T) 0.5, yMax = N_j + (T) 0.5, zMax = N_k + (T) 0.5;
+  unsigned int i = 1;
+#if VEC_WIDTH
+  typedef Vec<T> V;
+  typedef typename V::vec vec;
+  typedef typename V::ivec ivec;
+  const unsigned int width = V::width;
+  const vec vdt0_x = V::set1(dt0_x), vdt0_y = V::set1(dt0_y), vdt0_z = V::set1(dt0_z);
+  const vec half = V::set1(0.5), one = V::set1(1);
+  const vec vxMax = V::set1(xMax), vyMax = V::set1(yMax), vzMax = V::set1(zMax);
+  const vec vj = V::set1(j), vk = V::set1(k), rows = V::set1(N_j + 2), lane = vload(lanes(T()));
+  for (; i + width <= N_i + 1; i += width){
+    const unsigned int c = row + i;
+    const vec x = vmin(vmax(vsub(vadd(V::set1(i), lane), vmul(vdt0_x, vload(u + c))), half), vxMax);
+    const vec y = vmin(vmax(vsub(vj, vmul(vdt0_y, vload(v + c))), half), vyMax);
+    const vec z = vmin(vmax(vsub(vk, vmul(vdt0_z, vload(w + c))), half), vzMax);
+    const ivec i0 = vtrunc(x), j0 = vtrunc(y), k0 = vtrunc(z);
+    const vec s1 = vsub(x, V::toScalar(i0)), s0 = vsub(one, s1);
+    const vec t1 = vsub(y, V::toScalar(j0)), t0 = vsub(one, t1);
+    const vec r1 = vsub(z, V::toScalar(k0)), r0 = vsub(one, r1);
+    // the row k0.(N_j + 2) + j0 of the cells, exact in floating point
+    const ivec r00 = vtrunc(vadd(vmul(V::toScalar(k0), rows), V::toScalar(j0)));
+
+    for (unsigned int f = 0; f < nbFields; f++){
+      const T *near = d0[f], *far = near + P;
+      const vec nearSample =
+        vadd(vmul(s0, vadd(vmul(t0, vgather(near, i0, r00, W)), vmul(t1, vgather(near + W, i0, r00, W)))),
+             vmul(s1, vadd(vmul(t0, vgather(near + 1, i0, r00, W)),
+                           vmul(t1, vgather(near + W + 1, i0, r00, W)))));
+      const vec farSample =
+        vadd(vmul(s0, vadd(vmul(t0, vgather(far, i0, r00, W)), vmul(t1, vgather(far + W, i0, r00, W)))),
+             vmul(s1, vadd(vmul(t0, vgather(far + 1, i0, r00, W)),
+                           vmul(t1, vgather(far + W + 1, i0, r00, W)))));
+      vstore(d[f] + c, vadd(vmul(r0, nearSample), vmul(r1, farSample)));
+    }
+  }
+#endif
+  for (; i <= N_i; i++){
+    const unsigned int c = row + i;
+    T x = i - dt0_x * u[c];
+    T y = j - dt0_y * v[c];
+    T z = k - dt0_z * w[c];
+    if (x < (T) 0.5) x = 0.5;
+    if (x > xMax) x = xMax;
+    if (y < (T) 0.5) y = 0.5;
+    if (y > yMax) y = yMax;
+    if (z < (T) 0.5) z = 0.5;
+    if (z > zMax) z = zMax;
+    const unsigned int i0 = (int) x, j0 = (int) y, k0 = (int) z;
+    const T s1 = x - i0, s0 = 1 - s1;
+    const T t1 = y - j0, t0 = 1 - t1;
+    const T r1 = z - k0, r0 = 1 - r1;
+    const unsigned int c000 = k0 * P + j0 * W + i0;
+
+    for (unsigned int f = 0; f < nbFields; f++){
+      const T *src = d0[f];
+      const T *near = src + c000, *far = near + P;
+      d[f][c] = r0 * (s0 * (t0 * near[0] + t1 * near[W]) + s1 * (t0 * near[1] + t1 * near[W + 1]))
+              + r1 * (s0 * (t0 * far[0]  + t1 * far[W])  + s1 * (t0 * far[1]  + t1 * far[W + 1]));
+    }
+  }
+}
+
+template <typename T>
+void stencilUpsampleRow(T *dst, const T *src0, const T *src1, T t1,
+                        const unsigned int *columns, const T *weights, unsigned int n){
+  const T t0 = 1 - t1;
+  for (unsigned int i = 0; i < n; i++){
+    const unsigned int c = columns[i];
+    const T s1 = weights[i], s0 = 1 - s1;
+    dst[i] = t0 * (s0 * src0[c] + s1 * src0[c + 1]) + t1 * (s0 * src1[c] + s1 * src1[c + 1]);
+  }
+}
+
+// the kernels of the two scalar types of the solver
+#define STENCIL_INSTANTIATE(T)                                                    \
+  template void stencilRelaxRow(T *, const T *, const unsigned int *,            \
+                                const float *, unsigned int, unsigned int,       \
+                                unsigned int, T, T);                             \
+  template void stencilRelax3DRow(T *, const T *, unsigned int, unsigned int,    \
+                                  unsigned int, unsigned int, T, T);             \
+  template void stencilGaussSeidelRow(T *, const T *, const unsigned int *,      \
+                                      unsigned int, unsigned int, T, T);         \
+  template void stencilResidualRow(const T *, const T *, const unsigned int *,   \
+                                   const float *, unsigned int, unsigned int,    \
+                                   T, T, StencilSums &);                         \
+  template void stencilDivergenceRow(T *, T *, const T *, const T *,             \
+                                     const unsigned int *, unsigned int,         \
+                                     unsigned int, T, T);                        \
+  template void stencilGradientRow(T *, T *, const T *, const unsigned int *,    \
+                                   unsigned int, unsigned int, T, T);            \
+  template void stencilAdvectRow(T *, const T *, const T *, const T *,           \
+                                 const unsigned int *, unsigned int,             \
+                                 unsigned int, unsigned int, unsigned int, T, T);\
+  template void stencilAdvectChannelsRow(T *const *, const T *const *,           \
+                                         unsigned int, const T *, const T *,     \
+                                         const unsigned int *, unsigned int,     \
+                                         unsigned int, unsigned int,             \
+                                         unsigned int, unsigned int,             \
+                                         unsigned int, T, T);                    \
+  template void stencilAdvectVelocityRow(T *, T *, const T *, const T *,         \
+                                         const unsigned int *, unsigned int,     \
+                                         unsigned int, unsigned int,             \
+                                         unsigned int, unsigned int,             \
+                                         unsigned int, T, T);                    \
+  template void stencilMacCormackChannelsRow(T *const *, const T *const *,       \
+                                             const T *const *, unsigned int,     \
+                                             const T *, const T *,               \
+                                             const unsigned int *, unsigned int, \
+                                             unsigned int, unsigned int,         \
+                                             unsigned int, unsigned int,         \
+                                             unsigned int, T, T);                \
+  template void stencilMacCormackVelocityRow(T *, T *, const T *, const T *,     \
+                                             const T *, const T *,               \
+                                             const unsigned int *, unsigned int, \
+                                             unsigned int, unsigned int,         \
+                                             unsigned int, unsigned int,         \
+                                             unsigned int, T, T);                \
+  template void stencilAdvect3DRow(T *const *, const T *const *, unsigned int,   \
+                                   const T *, const T *, const T *,              \
+                                   unsigned int, unsigned int, unsigned int,     \
+                                   unsigned int, unsigned int, T, T, T);         \
+  template void stencilUpsampleRow(T *, const T *, const T *, T,                 \
+                                   const unsigned int *, const T *,              \
+                                   unsigned int);
+STENCIL_INSTANTIATE(float)
+STENCIL_INSTANTIATE(double)
+#undef STENCIL_INSTANTIATE
+
+// the advections into rows, from the fields of T or in 16 bits
+#define STENCIL_INSTANTIATE_TO_ROW(T, S)                                          \
+  template void stencilAdvectChannelsToRow(T *const *, const S *const *,         \
+                                           unsigned int, const T *, const T *,   \
+                                           const unsigned int *, unsigned int,   \
+                                           unsigned int, unsigned int,           \
+                                           unsigned int, unsigned int,           \
+                                           unsigned int, T, T);                  \
+  template void stencilMacCormackChannelsToRow(T *const *, const S *const *,     \
+                                               const T *const *, unsigned int,   \
+                                               const T *, const T *,             \
+                                               const unsigned int *,             \
+                                               unsigned int, unsigned int,       \
+                                               unsigned int, unsigned int,       \
+                                               unsigned int, unsigned int, T, T);
+STENCIL_INSTANTIATE_TO_ROW(float, float)
+STENCIL_INSTANTIATE_TO_ROW(float, StencilHalf)
+STENCIL_INSTANTIATE_TO_ROW(float, StencilBfloat)
+STENCIL_INSTANTIATE_TO_ROW(double, double)
+STENCIL_INSTANTIATE_TO_ROW(double, StencilHalf)
+STENCIL_INSTANTIATE_TO_ROW(double, StencilBfloat)
+#undef STENCIL_INSTANTIATE_TO_ROW
+
+void stencilFloatToBfloatRow(unsigned short *dst, const float *src, unsigned int n){
+  unsigned int i = 0;
+#if defined(__SSE2__) && !defined(STENCIL_SCALAR)
+  const __m128i bias = _mm_set1_epi32(0x7fff), one = _mm_set1_epi32(1);
+  const __m128i quiet = _mm_set1_epi32(0x400000);
+  for (; i + 8 <= n; i += 8){
+    const __m128 fa = _mm_loadu_ps(src + i), fb = _mm_loadu_ps(src + i + 4);
+    const __m128i nanA = _mm_castps_si128(_mm_cmpunord_ps(fa, fa));
+    const __m128i nanB = _mm_castps_si128(_mm_cmpunord_ps(fb, fb));
+    __m128i a = _mm_castps_si128(fa), b = _mm_castps_si128(fb);
+    a = _mm_or_si128(_mm_and_si128(nanA, _mm_or_si128(a, quiet)),
+                     _mm_andnot_si128(nanA, _mm_add_epi32(a, _mm_add_epi32(bias, _mm_and_si128(_mm_srli_epi32(a, 16), one)))));
+    b = _mm_or_si128(_mm_and_si128(nanB, _mm_or_si128(b, quiet)),
+                     _mm_andnot_si128(nanB, _mm_add_epi32(b, _mm_add_epi32(bias, _mm_and_si128(_mm_srli_epi32(b, 16), one)))));
+    // the arithmetic shifts keep the upper halves within the signed range
+    _mm_storeu_si128((__m128i *) (dst + i),
+                     _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+  }
+#endif
+  for (; i < n; i++)
+    dst[i] = floatToBfloat(src[i]);
+}
+
+void stencilBfloatToFloatRow(float *dst, const unsigned short *src, unsigned int n){
+  unsigned int i = 0;
+#if defined(__SSE2__) && !defined(STENCIL_SCALAR)
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= n; i += 8){
+    const __m128i h = _mm_loadu_si128((const __m128i *) (src + i));
+    _mm_storeu_ps(dst + i, _mm_castsi128_ps(_mm_unpacklo_epi16(zero, h)));
+    _mm_storeu_ps(dst + i + 4, _mm_castsi128_ps(_mm_unpackhi_epi16(zero, h)));
+  }
+#endif
+  for (; i < n; i++)
+    dst[i] = bitsFloat((unsigned int) src[i] << 16);
+}
+
+void stencilFloatToHalfRow(unsigned short *dst, const float *src, unsigned int n){
+  unsigned int i = 0;
+#if defined(__F16C__) && !defined(STENCIL_SCALAR)
+  for (; i + 8 <= n; i += 8)
+    _mm_storeu_si128((__m128i *) (dst + i),
+                     _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#elif defined(__SSE2__) && !defined(STENCIL_SCALAR)
+  for (; i + 8 <= n; i += 8){
+    const __m128i a = floatToHalfSSE2(_mm_loadu_ps(src + i));
+    const __m128i b = floatToHalfSSE2(_mm_loadu_ps(src + i + 4));
+    _mm_storeu_si128((__m128i *) (dst + i), _mm_packs_epi32(a, b));
+  }
+#endif
+  for (; i < n; i++)
+    dst[i] = floatToHalf(src[i]);
+}
+
+void stencilHalfToFloatRow(float *dst, const unsigned short *src, unsigned int n){
+  unsigned int i = 0;
+#if defined(__F16C__) && !defined(STENCIL_SCALAR)
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (src + i))));
+#elif defined(__SSE2__) && !defined(STENCIL_SCALAR)
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= n; i += 8){
+    const __m128i h = _mm_loadu_si128((const __m128i *) (src + i));
+    _mm_storeu_ps(dst + i, halfToFloatSSE2(_mm_unpacklo_epi16(h, zero)));
+    _mm_storeu_ps(dst + i + 4, halfToFloatSSE2(_mm_unpackhi_epi16(h, zero)));
+  }
+#endif
+  for (; i < n; i++)
+    dst[i] = halfToFloat(src[i]);
+}
@@ -0,0 +1,250 @@
+#ifndef STENCIL_HPP_
+#define STENCIL_HPP_
+
+/**
+ * Row kernels of the 5-point stencils of the diffusion and projection
+ * steps and of the advection, vectorized with AVX2 when the compiler
+ * targets it, SSE2 otherwise (always there on x86-64), plain C++ on other
+ * processors. They are templates on the scalar type of the matrices, with
+ * instantiations for float and double (half as many cells per vector).
+ *
+ * Each kernel processes the interior cells 1..n of one row of matrices of
+ * row stride W; the pointers point to the first cell (i = 0) of the row, or
+ * to the cell before the first one of a row segment (see Tiling). The
+ * vector loads may reach up to a vector past either end of a row, into
+ * the padding between the rows of FloatMatrix2D, never into a value used. The
+ * solid cells are skipped with the fluid mask of Obstacles (~0 for fluid
+ * cells, 0 elsewhere) through blends instead of branches, and keep their
+ * values. The vector and scalar versions compute the same values.
+ */
+
+/**
+ * Name of the instruction set used by the kernels.
+ */
+const char *stencilInstructionSet();
+
+/**
+ * Sums over the fluid cells of a row, see stencilResidualRow.
+ */
+struct StencilSums {
+  double residual;        // sum of the residuals
+  double residualSquares; // sum of their squares
+  double rhsSquares;      // sum of the squares of the right hand side
+  unsigned int count;     // number of fluid cells
+};
+
+/**
+ * Cells of the fields stored in 16 bits (see CompactMatrix2D), which the
+ * advection kernels sample from directly, widened as they are read.
+ */
+struct StencilHalf {
+  unsigned short bits; // IEEE half float
+};
+
+struct StencilBfloat {
+  unsigned short bits; // bfloat16, the upper half of a float
+};
+
+/**
+ * One color of a red-black sweep:
+ *   x = (x0 + a.(sum of the 4 neighbours of x + mirror.x)) / c
+ * on the cells where i + parity is even. The neighbours which are not
+ * fluid (walls and obstacles) must hold 0: their mirror condition is
+ * carried by the coefficient mirror of the cell (see
+ * Obstacles::getMirror), so that the sweeps need no setBnd in between.
+ */
+template <typename T>
+void stencilRelaxRow(T *x, const T *x0, const unsigned int *mask,
+                     const float *mirror, unsigned int n, unsigned int W,
+                     unsigned int parity, T a, T c);
+
+/**
+ * One color of a red-black sweep of a row of a 3D grid (see
+ * stencilAdvect3DRow), whose neighbours in the planes before and after are
+ * P cells away:
+ *   x = (x0 + a.(sum of the 6 neighbours of x)) / c
+ * on the cells where i + parity is even. There are no obstacles: the
+ * borders hold the values of the boundary conditions.
+ */
+template <typename T>
+void stencilRelax3DRow(T *x, const T *x0, unsigned int n, unsigned int W, unsigned int P,
+                       unsigned int parity, T a, T c);
+
+/**
+ * Gauss-Seidel sweep of a row, in place and in order:
+ *   x = (x0 + a.(sum of the 4 neighbours of x)) / c
+ * Each cell uses the cell just updated on its left, so this one is scalar.
+ */
+template <typename T>
+void stencilGaussSeidelRow(T *x, const T *x0, const unsigned int *mask,
+                           unsigned int n, unsigned int W, T a, T c);
+
+/**
+ * Residual of the system solved by the relaxations:
+ *   r = x0 - (c.x - a.(sum of the 4 neighbours of x + mirror.x))
+ * summed over the fluid cells of the row into sums. mirror is NULL when the
+ * walls and obstacles hold the values of setBnd rather than 0.
+ */
+template <typename T>
+void stencilResidualRow(const T *x, const T *x0, const unsigned int *mask,
+                        const float *mirror, unsigned int n, unsigned int W,
+                        T a, T c, StencilSums &sums);
+
+/**
+ * Divergence of (u, v) in div, and reset of the pressure p unless p is
+ * NULL.
+ */
+template <typename T>
+void stencilDivergenceRow(T *div, T *p, const T *u, const T *v,
+                          const unsigned int *mask, unsigned int n, unsigned int W,
+                          T h_u, T h_v);
+
+/**
+ * Subtracts the gradient of the pressure p from (u, v).
+ */
+template <typename T>
+void stencilGradientRow(T *u, T *v, const T *p,
+                        const unsigned int *mask, unsigned int n, unsigned int W,
+                        T h_u, T h_v);
+
+/**
+ * Semi-Lagrangian advection of the row j: each fluid cell takes the
+ * bilinear sample of d0 at the point which reaches it along (u, v) within
+ * dt, or keeps its value of d0 when a corner of the sample is solid.
+ * Unlike the other kernels, d, d0, u, v and mask point to the first cell
+ * of the matrices, as the samples may come from any row.
+ *
+ * @param dt0_x dt times the number of interior cells along i
+ * @param dt0_y dt times the number of interior cells along j
+ */
+template <typename T>
+void stencilAdvectRow(T *d, const T *d0, const T *u, const T *v,
+                      const unsigned int *mask, unsigned int j,
+                      unsigned int N_i, unsigned int N_j, unsigned int W,
+                      T dt0_x, T dt0_y);
+
+/**
+ * Same as stencilAdvectRow for nbChannels fields d (sampled from their d0)
+ * carried by the same velocity: the back-traced positions and their
+ * weights are computed once per cell for all the channels. The velocity of
+ * the row j is given by uRow and vRow (its cells 0..N_i + 1) rather than
+ * read from matrices of the size of d: the velocity grid of the solver may
+ * be coarser than the density one, and is then interpolated row by row
+ * (see stencilUpsampleRow). Only the cells first..first + n - 1 of the row
+ * are advected, as in the kernels below: the solver skips the tiles where
+ * the fluid is at rest (see ActiveTiles).
+ */
+template <typename T>
+void stencilAdvectChannelsRow(T *const *d, const T *const *d0, unsigned int nbChannels,
+                              const T *uRow, const T *vRow,
+                              const unsigned int *mask, unsigned int j,
+                              unsigned int first, unsigned int n,
+                              unsigned int N_i, unsigned int N_j, unsigned int W,
+                              T dt0_x, T dt0_y);
+
+/**
+ * Same as stencilAdvectChannelsRow for fields d0 of S: T, or 16-bit cells
+ * (StencilHalf or StencilBfloat), widened to T as they are sampled. The
+ * row is written into the rows dRow of T, which point to its cell 0 and
+ * hold its previous values, for the cells which are not fluid: the solver
+ * stores them back into 16 bits (see FluidSolver2D::setStoragePrecision).
+ */
+template <typename T, typename S>
+void stencilAdvectChannelsToRow(T *const *dRow, const S *const *d0, unsigned int nbChannels,
+                                const T *uRow, const T *vRow,
+                                const unsigned int *mask, unsigned int j,
+                                unsigned int first, unsigned int n,
+                                unsigned int N_i, unsigned int N_j, unsigned int W,
+                                T dt0_x, T dt0_y);
+
+/**
+ * Advection of both components of the velocity along itself: u and v are
+ * sampled from u0 and v0 at the same back-traced positions, computed once.
+ */
+template <typename T>
+void stencilAdvectVelocityRow(T *u, T *v, const T *u0, const T *v0,
+                              const unsigned int *mask, unsigned int j,
+                              unsigned int first, unsigned int n,
+                              unsigned int N_i, unsigned int N_j, unsigned int W,
+                              T dt0_x, T dt0_y);
+
+/**
+ * MacCormack correction of the row j of nbChannels fields, after a
+ * semi-Lagrangian pass has advected each d0 into its d1 (boundary
+ * conditions applied): d1 is sampled back at the point each fluid cell
+ * reaches along (uRow, vRow) within dt, and the cell takes
+ * d1 + (d0 - that sample) / 2, the half of the error of the round trip,
+ * clamped between the four corners of d0 the forward sample interpolated,
+ * so that no new extremum appears. Cells with a solid corner on either
+ * path keep their value of d1. The velocity of the row is given as in
+ * stencilAdvectChannelsRow; the fields and mask point to their first cell.
+ */
+template <typename T>
+void stencilMacCormackChannelsRow(T *const *d, const T *const *d0, const T *const *d1,
+                                  unsigned int nbChannels, const T *uRow, const T *vRow,
+                                  const unsigned int *mask, unsigned int j,
+                                  unsigned int first, unsigned int n,
+                                  unsigned int N_i, unsigned int N_j, unsigned int W,
+                                  T dt0_x, T dt0_y);
+
+/**
+ * Same as stencilMacCormackChannelsRow with d0 of S and the row written
+ * into dRow, as for stencilAdvectChannelsToRow; the forward pass d1 is of
+ * T.
+ */
+template <typename T, typename S>
+void stencilMacCormackChannelsToRow(T *const *dRow, const S *const *d0, const T *const *d1,
+                                    unsigned int nbChannels, const T *uRow, const T *vRow,
+                                    const unsigned int *mask, unsigned int j,
+                                    unsigned int first, unsigned int n,
+                                    unsigned int N_i, unsigned int N_j, unsigned int W,
+                                    T dt0_x, T dt0_y);
+
+/**
+ * Same as stencilMacCormackChannelsRow for both components of the velocity, along
+ * itself (u0, v0), the forward pass having written u1 and v1.
+ */
+template <typename T>
+void stencilMacCormackVelocityRow(T *u, T *v, const T *u0, const T *v0,
+                                  const T *u1, const T *v1,
+                                  const unsigned int *mask, unsigned int j,
+                                  unsigned int first, unsigned int n,
+                                  unsigned int N_i, unsigned int N_j, unsigned int W,
+                                  T dt0_x, T dt0_y);
+
+/**
+ * Trilinear advection of the row (j, k) of nbFields 3D fields laid out like
+ * the ones of FluidSolver3D (cell (i, j, k) at (k.(N_j + 2) + j).(N_i + 2)
+ * + i), which have no obstacles: each d is sampled from its d0 at the
+ * positions which reach the cells along (u, v, w) within dt, computed once
+ * for all the fields. The pointers point to the first cell of the fields.
+ * Like stencilAdvectRow, the vector versions gather the corners of the
+ * samples: eight per field, the four of each of the two planes.
+ */
+template <typename T>
+void stencilAdvect3DRow(T *const *d, const T *const *d0, unsigned int nbFields,
+                        const T *u, const T *v, const T *w, unsigned int j, unsigned int k,
+                        unsigned int N_i, unsigned int N_j, unsigned int N_k,
+                        T dt0_x, T dt0_y, T dt0_z);
+
+/**
+ * Bilinear interpolation of a row of a finer grid between the rows src0
+ * and src1 of a coarser one, at t1 from src0: the cell i of dst lies
+ * between the cells columns[i] and columns[i] + 1 of the rows, at
+ * weights[i] from the first.
+ */
+template <typename T>
+void stencilUpsampleRow(T *dst, const T *src0, const T *src1, T t1,
+                        const unsigned int *columns, const T *weights, unsigned int n);
+
+/**
+ * Conversions of n floats to and from bfloat16 (the upper half of a float:
+ * 8 bits of mantissa, the range of floats) and IEEE half floats (11 bits of
+ * mantissa, up to 65504), rounded to the nearest even.
+ */
+void stencilFloatToBfloatRow(unsigned short *dst, const float *src, unsigned int n);
+void stencilBfloatToFloatRow(float *dst, const unsigned short *src, unsigned int n);
+void stencilFloatToHalfRow(unsigned short *dst, const float *src, unsigned int n);
+void stencilHalfToFloatRow(float *dst, const unsigned short *src, unsigned int n);
+
+#endif
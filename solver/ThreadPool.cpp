@@ -0,0 +1,99 @@
+#include "ThreadPool.hpp"
+
+/**
+ * Constructor
+ *
+ * @param nbThreads Number of threads sharing the work, 0 to use every
+ * hardware thread
+ */
+ThreadPool::ThreadPool(unsigned int nbThreads)
+  : _nbThreads(nbThreads), _generation(0), _pending(0), _stop(false),
+    _body(NULL), _begin(0), _end(0)
+{
+  if (_nbThreads == 0)
+    _nbThreads = std::thread::hardware_concurrency();
+  if (_nbThreads == 0)
+    _nbThreads = 1;
+
+  for (unsigned int id = 1; id < _nbThreads; id++)
+    _workers.push_back(std::thread(&ThreadPool::work, this, id));
+}
+
+ThreadPool::~ThreadPool(){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _start.notify_all();
+  for (unsigned int k = 0; k < _workers.size(); k++)
+    _workers[k].join();
+}
+
+/**
+ * Calls body on contiguous sub-ranges of [begin, end), one per thread, and
+ * returns once every sub-range has been processed.
+ *
+ * @param begin First index of the range
+ * @param end Index after the last one
+ * @param body Function called with the bounds [b, e) of a sub-range
+ */
+void ThreadPool::parallelFor(unsigned int begin, unsigned int end,
+                             const RangeFunction &body){
+  if (begin >= end)
+    return;
+  if (_nbThreads == 1 || end - begin < _nbThreads){
+    body(begin, end);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _body = &body;
+    _begin = begin;
+    _end = end;
+    _pending = _nbThreads - 1;
+    _generation++;
+  }
+  _start.notify_all();
+
+  runChunk(0);
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  _done.wait(lock, [this] { return _pending == 0; });
+  _body = NULL;
+}
+
+/**
+ * Runs the sub-range given to a thread.
+ */
+void ThreadPool::runChunk(unsigned int id){
+  const unsigned int length = _end - _begin;
+  const unsigned int b = _begin + (unsigned long) length * id / _nbThreads;
+  const unsigned int e = _begin + (unsigned long) length * (id + 1) / _nbThreads;
+  if (b < e)
+    (*_body)(b, e);
+}
+
+/**
+ * Main loop of a worker thread.
+ */
+void ThreadPool::work(unsigned int id){
+  unsigned long generation = 0;
+  for (;;){
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _start.wait(lock, [&] { return _stop || _generation != generation; });
+      if (_stop)
+        return;
+      generation = _generation;
+    }
+
+    runChunk(id);
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _pending--;
+    }
+    _done.notify_one();
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <functional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * This class implements a fixed pool of worker threads used to split the
+ * rows of a grid between cores.
+ *
+ * The calling thread takes part in the work: a pool of n threads only
+ * starts n - 1 workers.
+ */
+
+class ThreadPool {
+public:
+  typedef std::function<void (unsigned int, unsigned int)> RangeFunction;
+
+  ThreadPool(unsigned int nbThreads = 1);
+  ~ThreadPool();
+
+  inline unsigned int getNbThreads() const{
+    return _nbThreads;
+  }
+
+  void parallelFor(unsigned int begin, unsigned int end,
+                   const RangeFunction &body);
+
+private:
+  ThreadPool(const ThreadPool &);
+  ThreadPool &operator= (const ThreadPool &);
+
+  void work(unsigned int id);
+  void runChunk(unsigned int id);
+
+  unsigned int _nbThreads;
+  std::vector<std::thread> _workers;
+
+  std::mutex _mutex;
+  std::condition_variable _start;
+  std::condition_variable _done;
+  unsigned long _generation; // incremented for each parallelFor
+  unsigned int _pending;     // workers still running the current range
+  bool _stop;
+
+  const RangeFunction *_body;
+  unsigned int _begin, _end;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#include "Tiling.hpp"
+
+#define TILE_CACHE_BYTES 262144 // smallest L2 cache of current x86 cores
+#define TILE_ALIGN 16          // cells of a cache line (and of 2 AVX vectors)
+
+/**
+ * Constructor: chooses tiles of equal widths, multiples of a cache line,
+ * as wide as the cache allows.
+ *
+ * @param N_i Number of interior columns of the grid
+ * @param nbFields Number of matrices (fields and mask) the sweep streams
+ * @param nbRows Number of rows of each of them in use at the same time: 3
+ * for a single sweep, more when several sweeps are pipelined
+ */
+Tiling::Tiling(unsigned int N_i, unsigned int nbFields, unsigned int nbRows)
+  : _N_i(N_i)
+{
+  unsigned int maxWidth = TILE_CACHE_BYTES / (sizeof(float) * (nbRows ? nbRows : 1)
+                                              * (nbFields ? nbFields : 1));
+  maxWidth -= maxWidth % TILE_ALIGN;
+  if (maxWidth < TILE_ALIGN)
+    maxWidth = TILE_ALIGN;
+
+  _nbTiles = (N_i + maxWidth - 1) / maxWidth;
+  if (_nbTiles <= 1){
+    _nbTiles = 1;
+    _tileWidth = N_i > 0 ? N_i : 1;
+    return;
+  }
+  _tileWidth = (N_i + _nbTiles - 1) / _nbTiles;
+  _tileWidth += (TILE_ALIGN - _tileWidth % TILE_ALIGN) % TILE_ALIGN;
+  _nbTiles = (N_i + _tileWidth - 1) / _tileWidth;
+}
@@ -0,0 +1,54 @@
+#ifndef TILING_HPP_
+#define TILING_HPP_
+
+/**
+ * This class splits the columns 1..N_i of a grid into tiles narrow enough
+ * for the rows a 5-point stencil keeps in use (the rows above, at and below
+ * the current one, for every field it streams) to stay in the L2 cache.
+ *
+ * A sweep then walks the tiles one after the other, and within a tile the
+ * rows in order, each row segment in memory order: every row of a field is
+ * loaded once per tile instead of being evicted before it is read again as
+ * the neighbour of the next row. The cells at the edges of a tile read
+ * their left and right neighbours (the halo) from the adjacent tiles or
+ * from the border columns, so the row kernels run unchanged on the
+ * segments. On grids narrower than one tile a sweep is a plain row by row
+ * traversal.
+ *
+ * The tiles are not made any narrower than the cache needs: short row
+ * segments break the streams the hardware prefetcher follows, and cost
+ * more than the L2 hits they turn into L1 ones.
+ */
+
+class Tiling {
+public:
+  Tiling(unsigned int N_i, unsigned int nbFields, unsigned int nbRows = 3);
+
+  inline unsigned int getNbTiles() const{
+    return _nbTiles;
+  }
+
+  inline unsigned int getTileWidth() const{
+    return _tileWidth;
+  }
+
+  /**
+   * Calls row(j, first, n) on the segments of the rows jBegin..jEnd-1 which
+   * cover the columns first..first+n-1, tile after tile.
+   */
+  template <class RowFunction>
+  void forEachRow(unsigned int jBegin, unsigned int jEnd, RowFunction row) const{
+    for (unsigned int first = 1; first <= _N_i; first += _tileWidth){
+      const unsigned int n = first + _tileWidth <= _N_i + 1 ? _tileWidth : _N_i + 1 - first;
+      for (unsigned int j = jBegin; j < jEnd; j++)
+        row(j, first, n);
+    }
+  }
+
+private:
+  unsigned int _N_i;
+  unsigned int _tileWidth;
+  unsigned int _nbTiles;
+};
+
+#endif
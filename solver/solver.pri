@@ -0,0 +1,53 @@
+# Solver sources shared by every qmake target (GUI, batch, benchmarks).
+
+CONFIG += c++11 thread
+
+# The stencil kernels use SSE2 on x86-64; 'qmake CONFIG+=avx2' builds them
+# for AVX2 processors instead (with the F16C half float conversions, which
+# all of them have).
+avx2: QMAKE_CXXFLAGS += -mavx2 -mf16c
+
+HEADERS += \
+    $$PWD/Segment.hpp \
+    $$PWD/Obstacles.hpp \
+    $$PWD/Matrix3D.hpp \
+    $$PWD/Matrix2D.hpp \
+    $$PWD/Matrix.hpp \
+    $$PWD/Expression.hpp \
+    $$PWD/FluidSolver2D.hpp \
+    $$PWD/FluidSolver3D.hpp \
+    $$PWD/FloatMatrix2D.hpp \
+    $$PWD/CompactMatrix2D.hpp \
+    $$PWD/FieldArena.hpp \
+    $$PWD/ScalarChannels2D.hpp \
+    $$PWD/ActiveTiles.hpp \
+    $$PWD/Aligned.hpp \
+    $$PWD/ThreadPool.hpp \
+    $$PWD/LinearSolver.hpp \
+    $$PWD/Advection.hpp \
+    $$PWD/Multigrid.hpp \
+    $$PWD/ConjugateGradient.hpp \
+    $$PWD/Stencil.hpp \
+    $$PWD/Tiling.hpp \
+    $$PWD/../config.hpp
+
+SOURCES += \
+    $$PWD/Segment.cpp \
+    $$PWD/Obstacles.cpp \
+    $$PWD/FluidSolver2D.cpp \
+    $$PWD/FluidSolver3D.cpp \
+    $$PWD/FloatMatrix2D.cpp \
+    $$PWD/CompactMatrix2D.cpp \
+    $$PWD/FieldArena.cpp \
+    $$PWD/ActiveTiles.cpp \
+    $$PWD/ThreadPool.cpp \
+    $$PWD/LinearSolver.cpp \
+    $$PWD/Advection.cpp \
+    $$PWD/Multigrid.cpp \
+    $$PWD/ConjugateGradient.cpp \
+    $$PWD/Stencil.cpp \
+    $$PWD/Tiling.cpp \
+    $$PWD/../config.cpp
+
+INCLUDEPATH += $$PWD/..
+DEPENDPATH += $$PWD/..